@@ -1,42 +1,151 @@
 #version 440 core
-in vec3 TexCoords;
+//BlackHole.comp is compiled after this file with COMPUTE_TRACER defined, it
+//replaces the fragment inputs, outputs and main
+#ifndef COMPUTE_TRACER
 layout (location = 0) out vec4 fragColor;
 layout (location = 1) out vec4 brightColor;
+#endif
 
 //textures
 uniform sampler2D diskTexture;
 uniform sampler2D bbodyTexture;
 uniform sampler2D noiseTexture;
 uniform samplerCube cubeMap;
+//orbits of the rays leaving the camera (see DeflectionTable.h): 1 / r per
+//impact parameter (rows) and orbital angle (columns), and where each one ends
+uniform sampler2D deflectionTable;
+uniform sampler2D deflectionEnds;
 
-//camera/window related variables
-uniform vec3 camPos;
-uniform vec3 view;
-uniform vec3 right;
-uniform vec3 up;
-uniform float aspectRatio;
-uniform float focalLength;
-uniform float halfWidth;
-uniform float halfHeight;
-
-//Black hole variables
-uniform vec3 BHPos;
-uniform float EHRad;
-uniform float innerDiskRad;
-uniform float outerDiskRad;
-uniform bool applyLensing;
-uniform bool renderDisk;
+//camera/window related variables, written every frame (the same block as
+//color.vert, filled by CameraBlock in RenderManager.cpp)
+layout(std140, binding = 0) uniform CameraBlock
+{
+    mat4 uniform_mvp;
+    vec3 camPos;
+    float aspectRatio;
+    vec3 view;
+    float focalLength;
+    vec3 right;
+    float halfWidth;
+    vec3 up;
+    float halfHeight;
+    float timeElapsed;
+};
+
+//Black hole variables, only written when edited (BlackHoleBlock in RenderManager.cpp)
+layout(std140, binding = 1) uniform BlackHoleBlock
+{
+    vec3 BHPos;
+    float EHRad;
+    float innerDiskRad;
+    float outerDiskRad;
+    float beamExponent;
+};
+//toggles compiled into the permutation (defined by RenderManager), so the
+//code they turn off is removed instead of branched over every step
+#ifdef APPLY_LENSING
+const bool applyLensing = true;
+#else
+const bool applyLensing = false;
+#endif
+#ifdef RENDER_DISK
+const bool renderDisk = true;
+#else
+const bool renderDisk = false;
+#endif
 uniform float diskMax = 4.0;
 const float BHTemperature = 10000.0f;
 const float falloffRate = 10.0f;
-uniform float beamExponent = 2.0f;
 
 //other
-uniform float timeElapsed;
 const int numOctaves = 4;
 const float STEP_SIZE = 0.1f;
 const float PI = 3.14159;
 
+//adaptive integration (Dormand-Prince), marches as far as the 300 fixed steps do
+uniform bool adaptiveStep = true;
+uniform float stepTolerance = 1e-5f;
+const float MARCH_LENGTH = 300.0f * STEP_SIZE;
+const int MAX_ITERATIONS = 300;
+const float MIN_STEP = 0.001f;
+//steps are never longer than this fraction of the distance to the black hole
+const float STEP_DISTANCE_RATIO = 0.5f;
+
+//analytic escape: rays heading away from the black hole leave the march once
+//the weak field formula bends them the rest of the way within a pixel
+uniform bool analyticEscape = true;
+//never closer than this (in event horizon radii), well past the photon sphere
+const float ESCAPE_RADIUS = 3.0f;
+//the error of the formula is about the square of the bending it applies, with
+//this margin it stays below the angle of a pixel
+const float ESCAPE_MARGIN = 2.0f;
+
+//Binet orbit: the rays are integrated in the plane of their orbit, as the
+//inverse radius over the orbital angle (binetStep radians per step)
+uniform bool binetOrbit = false;
+uniform float binetStep = 0.05f;
+//rays still circling after two turns stay on the photon sphere
+const float BINET_MAX_ANGLE = 4.0f * PI;
+
+//inbound rays are rebuilt from the deflection table instead of marched
+uniform bool useDeflectionTable = false;
+//orbital angle of the last column of the table
+uniform float deflectionMaxAngle;
+const int MAX_DISK_CROSSINGS = 8;
+
+//geodesic cache: the scene is symmetric around the y axis, so while only the
+//azimuth of the camera changes the ray of every pixel is the one traced
+//before, rotated around it. CACHE_STORE traces and keeps the results,
+//CACHE_REUSE rotates them by cacheRotation instead of marching
+const int CACHE_OFF = 0;
+const int CACHE_STORE = 1;
+const int CACHE_REUSE = 2;
+uniform int geodesicCacheMode = CACHE_OFF;
+uniform float cacheRotation = 0.0f;
+//direction at infinity and 1 if the ray escaped, 0 if captured, -1 if it must
+//be marched every frame (it hit the disk more often than the cache holds)
+layout(rgba32f, binding = 0) uniform image2D geodesicEscape;
+//radius and azimuth of the first disk hits, two per image (radius 0 if unused)
+layout(rgba32f, binding = 1) uniform image2D geodesicHits0;
+layout(rgba32f, binding = 2) uniform image2D geodesicHits1;
+const int MAX_CACHED_HITS = 4;
+//hits of the ray being traced, kept while recordHits is set
+vec2 diskHits[MAX_CACHED_HITS];
+int diskHitCount = 0;
+bool recordHits = false;
+
+//coarse to fine: COARSE_NODES traces one pixel every coarseStep (the corners
+//of the tiles, into the geodesic cache images), COARSE_REFINE interpolates the
+//pixels of the tiles whose corners agree and marches the rest
+const int COARSE_OFF = 0;
+const int COARSE_NODES = 1;
+const int COARSE_REFINE = 2;
+uniform int coarsePass = COARSE_OFF;
+uniform int coarseStep = 8;
+//corners agree if the lensing stretches the distance between them (on the
+//sky or on the disk) at most this many times
+uniform float coarseMagnification = 4.0f;
+
+//temporal interleave: only one in temporalInterleave pixels (1, 2 or 4) is
+//traced per frame, into a smaller target. temporalPhase picks which one, and
+//TemporalResolve.frag reprojects the rest from the last frame
+uniform int temporalInterleave = 1;
+uniform int temporalPhase = 0;
+//center of the screen pixel being traced
+vec2 pixelCoord = vec2(0.0f);
+
+//march statistics, only gathered when countSteps is set
+uniform bool countSteps = false;
+layout(std430, binding = 0) buffer MarchStats
+{
+    uint marchedSteps;
+    uint savedSteps;
+    uint analyticEscapes;
+    uint tracedRays;
+    //invocations of main, one per pixel of the target unless there is overdraw
+    uint tracedPixels;
+};
+
 //Given a point in cartesian coordinates, converts it
 //to spherical
 vec3 CartesianToSpherical(vec3 p)
@@ -151,13 +260,102 @@ vec3 GetAccretionDiskColor(vec3 intersectionPoint)
     return outColor * diskTextColor;
 }
 
-//Generates a ray given the camera.
-void GenerateRay(out vec3 pos, out vec3 dir)
+//Adds the color of a disk hit, and keeps the hit for the geodesic cache
+void AddDiskHit(vec3 intersectionPoint, inout vec3 color)
+{
+    color += GetAccretionDiskColor(intersectionPoint);
+    if (!recordHits)
+        return;
+    vec3 vec = intersectionPoint - BHPos;
+    if (diskHitCount < MAX_CACHED_HITS)
+        diskHits[diskHitCount] = vec2(length(vec), atan(vec.z, vec.x));
+    diskHitCount++;
+}
+
+//Keeps the result of the ray of this pixel in the geodesic cache
+void StoreGeodesic(vec3 dir, bool escaped)
+{
+    ivec2 pixel = ivec2(pixelCoord);
+    vec4 hits[2] = vec4[2](vec4(0.0f), vec4(0.0f));
+    for (int i = 0; i < min(diskHitCount, MAX_CACHED_HITS); i++)
+    {
+        if (i % 2 == 0)
+            hits[i / 2].xy = diskHits[i];
+        else
+            hits[i / 2].zw = diskHits[i];
+    }
+    float state = diskHitCount > MAX_CACHED_HITS ? -1.0f : (escaped ? 1.0f : 0.0f);
+    imageStore(geodesicEscape, pixel, vec4(dir, state));
+    imageStore(geodesicHits0, pixel, hits[0]);
+    imageStore(geodesicHits1, pixel, hits[1]);
+}
+
+//Reads the cached ray of a pixel: the escape image (see geodesicEscape), and
+//its disk hits relative to the black hole. Returns how many there are
+int LoadGeodesic(ivec2 pixel, out vec4 escape, out vec3 hits[MAX_CACHED_HITS])
+{
+    escape = imageLoad(geodesicEscape, pixel);
+    vec4 stored[2] = vec4[2](imageLoad(geodesicHits0, pixel), imageLoad(geodesicHits1, pixel));
+    int count = 0;
+    for (int i = 0; i < MAX_CACHED_HITS; i++)
+    {
+        vec2 hit = i % 2 == 0 ? stored[i / 2].xy : stored[i / 2].zw;
+        hits[i] = hit.x * vec3(cos(hit.y), 0.0f, sin(hit.y));
+        if (hit.x > 0.0f)
+            count = i + 1;
+    }
+    return count;
+}
+
+//Rebuilds the ray of a pixel from the geodesic cache, rotated around the y
+//axis by the given angle. The disk is shaded again at the rotated hits.
+//Returns false if the ray must be marched
+bool ShadeGeodesic(ivec2 pixel, float rotation, out vec3 dir, out vec3 color, out bool escaped)
+{
+    vec4 escape;
+    vec3 hits[MAX_CACHED_HITS];
+    int count = LoadGeodesic(pixel, escape, hits);
+    color = vec3(0.0, 0.0, 0.0);
+    dir = escape.xyz;
+    escaped = escape.w > 0.0f;
+    if (escape.w < 0.0f)
+        return false;
+
+    float c = cos(rotation), s = sin(rotation);
+    dir = vec3(c * escape.x + s * escape.z, escape.y, c * escape.z - s * escape.x);
+    for (int i = 0; i < count; i++)
+    {
+        vec3 hit = vec3(c * hits[i].x + s * hits[i].z, 0.0f, c * hits[i].z - s * hits[i].x);
+        color += GetAccretionDiskColor(BHPos + hit);
+    }
+    return true;
+}
+
+//Rebuilds the ray of this pixel from the geodesic cache, rotated by the
+//azimuth the camera moved since it was traced
+bool ReuseGeodesic(out vec3 dir, out vec3 color, out bool escaped)
+{
+    return ShadeGeodesic(ivec2(pixelCoord), cacheRotation, dir, color, escaped);
+}
+
+//Screen pixel a fragment traces: with an interleave of 2, every other one
+//of each row in a checkerboard; with 4, one of every 2x2 block
+vec2 GetPixelCoord(ivec2 p)
+{
+    if (temporalInterleave == 2)
+        p.x = 2 * p.x + ((p.y + temporalPhase) & 1);
+    else if (temporalInterleave == 4)
+        p = 2 * p + ivec2(temporalPhase & 1, temporalPhase >> 1);
+    return vec2(p) + 0.5f;
+}
+
+//Direction of the ray leaving the camera through a pixel
+vec3 GetRayDirection(vec2 pixel)
 {
 	vec2 NDC;
-	NDC.x = gl_FragCoord.x - halfWidth;
+	NDC.x = pixel.x - halfWidth;
 	NDC.x /= halfWidth;
-	NDC.y = -(gl_FragCoord.y - halfHeight);
+	NDC.y = -(pixel.y - halfHeight);
 	NDC.y /= halfHeight;
 
 	//computing the pixel position in world using the camera:
@@ -165,8 +363,87 @@ void GenerateRay(out vec3 pos, out vec3 dir)
 	vec3 pixelWorld = camPos + focalLength * view;
     pixelWorld += NDC.x * right / 2.0f + NDC.y * up / (2.0f * aspectRatio);
 
+    return -normalize(camPos - pixelWorld);
+}
+
+//Generates a ray given the camera.
+void GenerateRay(out vec3 pos, out vec3 dir)
+{
     pos = camPos;
-    dir = -normalize(camPos - pixelWorld);
+    dir = GetRayDirection(pixelCoord);
+}
+
+//Pixel of a tile corner, the last ones are clamped to the screen
+ivec2 GetCoarseNode(ivec2 node)
+{
+    return min(node * coarseStep, ivec2(2.0f * halfWidth, 2.0f * halfHeight) - 1);
+}
+
+//Checks whether the results of two tile corners are close enough to
+//interpolate between: the lensing must not stretch the distance between
+//their escape directions, or between their disk hits as seen from the
+//camera, much more than the distance between their pixels
+bool AreNodesClose(vec3 ray0, vec3 ray1, vec4 escape0, vec4 escape1, vec3 hits0[MAX_CACHED_HITS], vec3 hits1[MAX_CACHED_HITS], int count)
+{
+    float limit = coarseMagnification * length(ray1 - ray0);
+    if (escape0.w > 0.0f && length(normalize(escape1.xyz) - normalize(escape0.xyz)) > limit)
+        return false;
+    for (int i = 0; i < count; i++)
+    {
+        if (length(hits1[i] - hits0[i]) > limit * length(BHPos + hits0[i] - camPos))
+            return false;
+    }
+    return true;
+}
+
+//Interpolates the ray of this pixel from the corners of its tile, if they
+//all end the same way (escaped or captured, with as many disk hits) and are
+//close enough. The disk is shaded at the interpolated hits and the sky
+//sampled in the interpolated direction. Returns false if it must be marched
+bool InterpolateGeodesic(out vec3 dir, out vec3 color, out bool escaped)
+{
+    ivec2 p = ivec2(pixelCoord);
+    ivec2 tile = p / coarseStep;
+    ivec2 corners[4] = ivec2[4](GetCoarseNode(tile), GetCoarseNode(tile + ivec2(1, 0)),
+                                GetCoarseNode(tile + ivec2(0, 1)), GetCoarseNode(tile + ivec2(1, 1)));
+    color = vec3(0.0, 0.0, 0.0);
+    dir = vec3(0.0f);
+    escaped = false;
+    for (int i = 0; i < 4; i++)
+    {
+        if (p == corners[i])
+            return ShadeGeodesic(p, 0.0f, dir, color, escaped);
+    }
+
+    vec4 escapes[4];
+    vec3 hits[4][MAX_CACHED_HITS];
+    int counts[4];
+    vec3 rays[4];
+    for (int i = 0; i < 4; i++)
+    {
+        counts[i] = LoadGeodesic(corners[i], escapes[i], hits[i]);
+        rays[i] = GetRayDirection(vec2(corners[i]) + 0.5f);
+        if (escapes[i].w < 0.0f || escapes[i].w != escapes[0].w || counts[i] != counts[0])
+            return false;
+    }
+    if (!AreNodesClose(rays[0], rays[1], escapes[0], escapes[1], hits[0], hits[1], counts[0]) ||
+        !AreNodesClose(rays[2], rays[3], escapes[2], escapes[3], hits[2], hits[3], counts[0]) ||
+        !AreNodesClose(rays[0], rays[2], escapes[0], escapes[2], hits[0], hits[2], counts[0]) ||
+        !AreNodesClose(rays[1], rays[3], escapes[1], escapes[3], hits[1], hits[3], counts[0]))
+        return false;
+
+    vec2 t = vec2(p - corners[0]) / vec2(max(corners[3] - corners[0], ivec2(1)));
+    dir = mix(mix(normalize(escapes[0].xyz), normalize(escapes[1].xyz), t.x),
+              mix(normalize(escapes[2].xyz), normalize(escapes[3].xyz), t.x), t.y);
+    escaped = escapes[0].w > 0.0f;
+    diskHitCount = counts[0];
+    for (int i = 0; i < counts[0]; i++)
+    {
+        vec3 hit = mix(mix(hits[0][i], hits[1][i], t.x), mix(hits[2][i], hits[3][i], t.x), t.y);
+        color += GetAccretionDiskColor(BHPos + hit);
+        diskHits[i] = vec2(length(hit), atan(hit.z, hit.x));
+    }
+    return true;
 }
 
 //Applies the Schwarzschild Geodesic as the "magic potential"
@@ -199,17 +476,366 @@ void IntegrateRungeKutta4(float h2, inout vec3 pos, inout vec3 dir)
         dir += (STEP_SIZE / 6.0) * (du1 + 2.0 * du2 + 2.0 * du3 + du4);
 }
 
+// Performs a Dormand-Prince 5(4) step of size h. du1 holds the acceleration at
+// the start of the step and, once done, the one at its end (first same as last).
+// Returns the estimated error, relative to the magnitude of the new state
+float IntegrateDormandPrince(float h2, float h, vec3 pos, vec3 dir, inout vec3 du1, out vec3 newPos, out vec3 newDir)
+{
+    vec3 dx1 = dir;
+    vec3 dx2, du2, dx3, du3, dx4, du4, dx5, du5, dx6, du6, dx7, du7;
+
+    SchwarzschildGeodesic(h2, pos + h * (dx1 * (1.0 / 5.0)),
+                              dir + h * (du1 * (1.0 / 5.0)), dx2, du2);
+    SchwarzschildGeodesic(h2, pos + h * (dx1 * (3.0 / 40.0) + dx2 * (9.0 / 40.0)),
+                              dir + h * (du1 * (3.0 / 40.0) + du2 * (9.0 / 40.0)), dx3, du3);
+    SchwarzschildGeodesic(h2, pos + h * (dx1 * (44.0 / 45.0) + dx2 * (-56.0 / 15.0) + dx3 * (32.0 / 9.0)),
+                              dir + h * (du1 * (44.0 / 45.0) + du2 * (-56.0 / 15.0) + du3 * (32.0 / 9.0)), dx4, du4);
+    SchwarzschildGeodesic(h2, pos + h * (dx1 * (19372.0 / 6561.0) + dx2 * (-25360.0 / 2187.0) + dx3 * (64448.0 / 6561.0) + dx4 * (-212.0 / 729.0)),
+                              dir + h * (du1 * (19372.0 / 6561.0) + du2 * (-25360.0 / 2187.0) + du3 * (64448.0 / 6561.0) + du4 * (-212.0 / 729.0)), dx5, du5);
+    SchwarzschildGeodesic(h2, pos + h * (dx1 * (9017.0 / 3168.0) + dx2 * (-355.0 / 33.0) + dx3 * (46732.0 / 5247.0) + dx4 * (49.0 / 176.0) + dx5 * (-5103.0 / 18656.0)),
+                              dir + h * (du1 * (9017.0 / 3168.0) + du2 * (-355.0 / 33.0) + du3 * (46732.0 / 5247.0) + du4 * (49.0 / 176.0) + du5 * (-5103.0 / 18656.0)), dx6, du6);
+    //5th order solution
+    newPos = pos + h * (dx1 * (35.0 / 384.0) + dx3 * (500.0 / 1113.0) + dx4 * (125.0 / 192.0) + dx5 * (-2187.0 / 6784.0) + dx6 * (11.0 / 84.0));
+    newDir = dir + h * (du1 * (35.0 / 384.0) + du3 * (500.0 / 1113.0) + du4 * (125.0 / 192.0) + du5 * (-2187.0 / 6784.0) + du6 * (11.0 / 84.0));
+    SchwarzschildGeodesic(h2, newPos, newDir, dx7, du7);
+
+    //difference with the embedded 4th order solution
+    vec3 ex = h * (dx1 * (71.0 / 57600.0) + dx3 * (-71.0 / 16695.0) + dx4 * (71.0 / 1920.0) + dx5 * (-17253.0 / 339200.0) + dx6 * (22.0 / 525.0) + dx7 * (-1.0 / 40.0));
+    vec3 eu = h * (du1 * (71.0 / 57600.0) + du3 * (-71.0 / 16695.0) + du4 * (71.0 / 1920.0) + du5 * (-17253.0 / 339200.0) + du6 * (22.0 / 525.0) + du7 * (-1.0 / 40.0));
+    du1 = du7;
+    vec3 error = max(abs(ex) / (1.0 + abs(newPos)), abs(eu) / (1.0 + abs(newDir)));
+    return max(error.x, max(error.y, error.z));
+}
+
+//Finds where a step crosses the plane of the disk, on the cubic Hermite curve
+//through both ends of the step (the derivative of the position is the direction)
+vec3 FindDiskCrossing(float h, vec3 pos0, vec3 dir0, vec3 pos1, vec3 dir1)
+{
+    float y0 = pos0.y - BHPos.y;
+    float lo = 0.0f, hi = 1.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        float s = (lo + hi) * 0.5f;
+        float s2 = s * s, s3 = s2 * s;
+        float y = (2.0f * s3 - 3.0f * s2 + 1.0f) * pos0.y + (s3 - 2.0f * s2 + s) * h * dir0.y
+                + (3.0f * s2 - 2.0f * s3) * pos1.y + (s3 - s2) * h * dir1.y;
+        if ((y - BHPos.y) * y0 > 0.0f)
+            lo = s;
+        else
+            hi = s;
+    }
+    float s = (lo + hi) * 0.5f;
+    float s2 = s * s, s3 = s2 * s;
+    return (2.0f * s3 - 3.0f * s2 + 1.0f) * pos0 + (s3 - 2.0f * s2 + s) * h * dir0
+         + (3.0f * s2 - 2.0f * s3) * pos1 + (s3 - s2) * h * dir1;
+}
+
+//Deflection a ray still gets on its way to infinity, in the weak field limit:
+//the acceleration integrated along the straight line the ray is on (from pos
+//outwards). rayToBH is the position relative to the black hole
+vec3 GetRemainingDeflection(float h2, vec3 rayToBH, vec3 dir)
+{
+    float r2 = dot(rayToBH, rayToBH);
+    float v = length(dir);
+    vec3 u = dir / v;
+    //part of the position perpendicular to the line, its length is the impact parameter
+    vec3 perp = rayToBH - dot(rayToBH, u) * u;
+    //q = (b / r)^2. f is (2 - sqrt(1 - q) * (2 + q)) / q^2 rewritten to avoid cancelling for small q
+    float q = min(dot(perp, perp) / r2, 1.0f);
+    float f = (3.0f + q) / (2.0f + sqrt(1.0f - q) * (2.0f + q));
+    return (-0.5f * h2 / (v * r2 * r2)) * (sqrt(r2) * u + f * perp);
+}
+
+//Angle of a pixel at the center of the screen, see GenerateRay
+float GetPixelAngle()
+{
+    return 1.0f / (2.0f * halfWidth * focalLength);
+}
+
+//Finishes the march of a ray analytically if it is heading away from the black
+//hole, past the disk, and the weak field formula is accurate enough from here.
+//Returns whether it did (dir then holds its direction at infinity)
+bool EscapeAnalytically(float h2, vec3 pos, inout vec3 dir, float pixelAngle)
+{
+    vec3 rayToBH = pos - BHPos;
+    float r2 = dot(rayToBH, rayToBH);
+    float escapeRad = ESCAPE_RADIUS * EHRad;
+    if (renderDisk)
+        escapeRad = max(escapeRad, outerDiskRad);
+    if (r2 < escapeRad * escapeRad || dot(rayToBH, dir) <= 0.0f)
+        return false;
+
+    //only the bending perpendicular to the ray changes where it ends up
+    vec3 deflection = GetRemainingDeflection(h2, rayToBH, dir);
+    float v2 = dot(dir, dir);
+    vec3 bend = deflection - dot(deflection, dir) / v2 * dir;
+    if (ESCAPE_MARGIN * dot(bend, bend) > pixelAngle * v2)
+        return false;
+    dir += deflection;
+    return true;
+}
+
+//Bends a ray that reached the end of the march heading away from the black
+//hole the rest of the way, so it lands where the analytic escape would take it
+void FinishEscape(float h2, vec3 pos, inout vec3 dir)
+{
+    vec3 rayToBH = pos - BHPos;
+    if (dot(rayToBH, dir) > 0.0f)
+        dir += GetRemainingDeflection(h2, rayToBH, dir);
+}
+
+//Fewest adaptive steps that could cover the rest of the march from a distance
+//r to the black hole: each one is at most STEP_DISTANCE_RATIO * r long
+int GetAdaptiveStepsLeft(float remaining, float r, int iterationsLeft)
+{
+    int steps = 0;
+    float reach = r;
+    while (reach - r < remaining && steps < iterationsLeft)
+    {
+        reach *= 1.0f + STEP_DISTANCE_RATIO;
+        steps++;
+    }
+    return steps;
+}
+
+//Adds the steps of a ray to the march statistics
+void CountSteps(int marched, int saved, bool escapedAnalytically)
+{
+    if (!countSteps)
+        return;
+    atomicAdd(marchedSteps, uint(marched));
+    atomicAdd(savedSteps, uint(saved));
+    if (escapedAnalytically)
+        atomicAdd(analyticEscapes, 1u);
+}
+
+//Ray marching with adaptive steps: long ones far from the black hole and
+//wherever the path is straight, short ones near the photon sphere. The disk
+//is crossed wherever an accepted step changes sides of its plane
+bool RayMarchAdaptive(vec3 pos, inout vec3 dir, out vec3 color)
+{
+  color = vec3(0.0, 0.0, 0.0);
+  vec3 h = cross(pos, dir);
+  float h2 = applyLensing ? dot(h, h) : 0.0f;
+
+  vec3 dx, du;
+  SchwarzschildGeodesic(h2, pos, dir, dx, du);
+  float travelled = 0.0f;
+  float stepSize = min(STEP_DISTANCE_RATIO * length(pos - BHPos), MARCH_LENGTH);
+  float pixelAngle = GetPixelAngle();
+  for (int i = 0; i < MAX_ITERATIONS; i++)
+  {
+      vec3 rayToBH = pos - BHPos;
+      float r2 = dot(rayToBH, rayToBH);
+      if (r2 <= EHRad * EHRad)
+      {
+        CountSteps(i, 0, false);
+        return false;
+      }
+      if (travelled >= MARCH_LENGTH)
+      {
+        if (analyticEscape)
+          FinishEscape(h2, pos, dir);
+        CountSteps(i, 0, false);
+        return true;
+      }
+      if (analyticEscape && EscapeAnalytically(h2, pos, dir, pixelAngle))
+      {
+        CountSteps(i, GetAdaptiveStepsLeft(MARCH_LENGTH - travelled, sqrt(r2), MAX_ITERATIONS - i), true);
+        return true;
+      }
+
+      stepSize = min(stepSize, min(MARCH_LENGTH - travelled, STEP_DISTANCE_RATIO * sqrt(r2)));
+      vec3 newPos, newDir, newDu = du;
+      float error = IntegrateDormandPrince(h2, stepSize, pos, dir, newDu, newPos, newDir);
+      if (error <= stepTolerance || stepSize <= MIN_STEP)
+      {
+          //the step went through the plane of the disk (not counting where it started)
+          float y0 = pos.y - BHPos.y;
+          if (renderDisk && y0 * (newPos.y - BHPos.y) <= 0.0f && y0 != 0.0f)
+          {
+              vec3 intersectionPoint = FindDiskCrossing(stepSize, pos, dir, newPos, newDir);
+              vec3 vec = intersectionPoint - BHPos;
+              float distSq = dot(vec, vec);
+              if (distSq >= innerDiskRad * innerDiskRad && distSq <= outerDiskRad * outerDiskRad)
+                  AddDiskHit(intersectionPoint, color);
+          }
+          pos = newPos;
+          dir = newDir;
+          du = newDu;
+          travelled += stepSize;
+      }
+      //the exponent is 1/4 instead of 1/5 so the CPU packets only need square roots
+      float factor = clamp(0.9f * sqrt(sqrt(stepTolerance / max(error, 1e-20f))), 0.2f, 5.0f);
+      stepSize = max(stepSize * factor, MIN_STEP);
+  }
+  if (analyticEscape)
+    FinishEscape(h2, pos, dir);
+  CountSteps(MAX_ITERATIONS, 0, false);
+  return true;
+}
+
+//Rebuilds the march of an inbound ray from the deflection table, in the plane
+//of its orbit: e1 points from the black hole to the camera and e2 along the
+//ray. Returns whether the ray escaped (dir then holds its direction at infinity)
+bool TraceDeflectionTable(vec3 pos, inout vec3 dir, out vec3 color)
+{
+    color = vec3(0.0, 0.0, 0.0);
+    vec3 e1 = normalize(pos - BHPos);
+    vec3 v = normalize(dir);
+    vec3 tangent = v - dot(v, e1) * e1;
+    //impact parameter over the camera distance, picks the row
+    float s = length(tangent);
+    ivec2 size = textureSize(deflectionTable, 0);
+    float row = s * float(size.y - 1);
+
+    //where the orbit ends, interpolated between the rows around it if they end the same way
+    int row0 = min(int(row), size.y - 1);
+    int row1 = min(row0 + 1, size.y - 1);
+    vec2 end0 = texelFetch(deflectionEnds, ivec2(row0, 0), 0).rg;
+    vec2 end1 = texelFetch(deflectionEnds, ivec2(row1, 0), 0).rg;
+    float t = row - float(row0);
+    vec2 end = end0.g == end1.g ? mix(end0, end1, t) : (t < 0.5f ? end0 : end1);
+    //radial rays have no orbital plane, they fall straight in
+    if (s == 0.0f)
+        return false;
+    vec3 e2 = tangent / s;
+
+    //the orbit goes through the disk plane every half turn, starting where
+    //cos(phi) * e1.y + sin(phi) * e2.y = 0 (not counting the camera itself)
+    if (renderDisk && (e1.y != 0.0f || e2.y != 0.0f))
+    {
+        float node = atan(-e1.y, e2.y);
+        if (node <= 0.0f)
+            node += PI;
+        for (int k = 0; k < MAX_DISK_CROSSINGS; k++)
+        {
+            float phi = node + float(k) * PI;
+            if (phi >= end.r)
+                break;
+            vec2 uv = vec2(phi / deflectionMaxAngle * float(size.x - 1) + 0.5f, row + 0.5f) / vec2(size);
+            float r = 1.0f / texture(deflectionTable, uv).r;
+            if (r >= innerDiskRad && r <= outerDiskRad)
+                AddDiskHit(BHPos + r * (cos(phi) * e1 + sin(phi) * e2), color);
+        }
+    }
+
+    if (end.g > 0.5f)
+        return false;
+    //far enough the ray moves radially, at the angle where it reaches infinity
+    dir = cos(end.r) * e1 + sin(end.r) * e2;
+    return true;
+}
+
+//Binet equation of the geodesic, u'' = 1.5 u^2 - u for u = 1 / r over the
+//orbital angle (the same units as SchwarzschildGeodesic). Without lensing the
+//orbit is a straight line, u'' = -u
+float BinetAcceleration(float u)
+{
+    return (applyLensing ? 1.5f * u * u : 0.0f) - u;
+}
+
+//Marches a ray in the plane of its orbit with the Binet equation: one variable
+//and its derivative instead of the position and direction. e1 points from the
+//black hole to the start and e2 along the ray, like in TraceDeflectionTable.
+//The ray is followed until u reaches 0, so it leaves in its direction at
+//infinity without the analytic escape. Returns whether it escaped
+bool RayMarchBinet(vec3 pos, inout vec3 dir, out vec3 color)
+{
+    color = vec3(0.0, 0.0, 0.0);
+    vec3 rayToBH = pos - BHPos;
+    float r = length(rayToBH);
+    vec3 e1 = rayToBH / r;
+    vec3 v = normalize(dir);
+    vec3 tangent = v - dot(v, e1) * e1;
+    float s = length(tangent);
+    //radial rays have no orbital plane, they fall straight in or leave unbent
+    if (s == 0.0f)
+        return dot(v, e1) > 0.0f;
+    vec3 e2 = tangent / s;
+
+    //du/dphi = -u * (radial part of the direction) / (tangential part)
+    float u = 1.0f / r;
+    float du = -u * dot(v, e1) / s;
+    //the disk plane is crossed every half turn, see TraceDeflectionTable
+    float node = 1e30f;
+    if (renderDisk && (e1.y != 0.0f || e2.y != 0.0f))
+    {
+        node = atan(-e1.y, e2.y);
+        if (node <= 0.0f)
+            node += PI;
+    }
+
+    float h = binetStep;
+    float phi = 0.0f;
+    int i = 0;
+    for (; phi < BINET_MAX_ANGLE; i++)
+    {
+        if (u * EHRad >= 1.0f)
+        {
+            CountSteps(i, 0, false);
+            return false;
+        }
+
+        float k1u = du, k1v = BinetAcceleration(u);
+        float k2u = du + 0.5f * h * k1v, k2v = BinetAcceleration(u + 0.5f * h * k1u);
+        float k3u = du + 0.5f * h * k2v, k3v = BinetAcceleration(u + 0.5f * h * k2u);
+        float k4u = du + h * k3v, k4v = BinetAcceleration(u + h * k3u);
+        float newU = u + h / 6.0f * (k1u + 2.0f * k2u + 2.0f * k3u + k4u);
+        float newDu = du + h / 6.0f * (k1v + 2.0f * k2v + 2.0f * k3v + k4v);
+        //u reaches 0 at infinity, where the ray stops turning
+        bool escaped = newU <= 0.0f;
+        float end = escaped ? phi + h * u / (u - newU) : phi + h;
+
+        //the radius at the crossings, on the cubic Hermite curve through both ends of the step
+        for (; node <= end; node += PI)
+        {
+            float t = (node - phi) / h;
+            float t2 = t * t, t3 = t2 * t;
+            float uNode = (2.0f * t3 - 3.0f * t2 + 1.0f) * u + (t3 - 2.0f * t2 + t) * h * du
+                        + (3.0f * t2 - 2.0f * t3) * newU + (t3 - t2) * h * newDu;
+            float rNode = 1.0f / uNode;
+            if (uNode > 0.0f && rNode >= innerDiskRad && rNode <= outerDiskRad)
+                AddDiskHit(BHPos + rNode * (cos(node) * e1 + sin(node) * e2), color);
+        }
+
+        if (escaped)
+        {
+            dir = cos(end) * e1 + sin(end) * e2;
+            CountSteps(i + 1, 0, false);
+            return true;
+        }
+        u = newU;
+        du = newDu;
+        phi += h;
+    }
+    CountSteps(i, 0, false);
+    return false;
+}
+
 //The bulk of the algorithm. Performs ray marching and checks for intersections
-//while the light gets bent
-vec3 RayMarch(vec3 pos, vec3 dir) 
+//while the light gets bent. Returns whether the ray escaped (dir then holds the
+//direction in which the skybox must be sampled)
+bool RayMarch(vec3 pos, inout vec3 dir, out vec3 color) 
 {
-  vec3 color = vec3(0.0, 0.0, 0.0);
+  //the table only holds bent rays heading towards the black hole
+  if (useDeflectionTable && applyLensing && dot(pos - BHPos, dir) < 0.0f)
+    return TraceDeflectionTable(pos, dir, color);
+  if (binetOrbit)
+    return RayMarchBinet(pos, dir, color);
+  if (adaptiveStep)
+    return RayMarchAdaptive(pos, dir, color);
+
+  color = vec3(0.0, 0.0, 0.0);
 
   // Initial values. This is the angular momentum of orbiting particles.
   //this can be computed just once because our formula works if we fix orbits
   //at the equatorial plane of the Black Hole, meaning this vector will always be the same.
   vec3 h = cross(pos, dir);
   float h2 = dot(h, h);
+  //the direction is not bent without lensing, so there is nothing left to add
+  float escapeH2 = applyLensing ? h2 : 0.0f;
+  float pixelAngle = GetPixelAngle();
  
   vec3 dx = dir;
   for (int i = 0; i < 300; i++) 
@@ -217,36 +843,117 @@ vec3 RayMarch(vec3 pos, vec3 dir)
       vec3 intersectionPoint;
       //Check intersection with disk
       if(renderDisk && IntersectionRayAccretionDisk(pos, dir, intersectionPoint) >= 0.0f)
-           color += GetAccretionDiskColor(intersectionPoint);
+           AddDiskHit(intersectionPoint, color);
 
       vec3 rayToBH = pos - BHPos;
       // Reach event horizon?
       if (dot(rayToBH, rayToBH) <= EHRad * EHRad) 
-        return color;
+      {
+        CountSteps(i, 0, false);
+        return false;
+      }
+
+      //heading away for good, the rest of the bending is analytic
+      if (analyticEscape && EscapeAnalytically(escapeH2, pos, dir, pixelAngle))
+      {
+        CountSteps(i, 300 - i, true);
+        return true;
+      }
 
        //integrate position and direction
       IntegrateRungeKutta4(h2, pos, dir);
   }
 
-  //Finally, add skybox color. We need to sample it at the final ray direction
-  color += texture(cubeMap, dir).rgb;
-  return color;
+  if (analyticEscape)
+    FinishEscape(escapeH2, pos, dir);
+  CountSteps(300, 0, false);
+  return true;
+}
+
+//Screen pixel a fragment (or a texel of the compute target) traces
+vec2 GetTracedPixel(ivec2 fragCoord)
+{
+    if (coarsePass == COARSE_NODES)
+        return vec2(GetCoarseNode(fragCoord)) + 0.5f;
+    return GetPixelCoord(fragCoord);
+}
+
+//the last column or row of an interleaved target may fall off the screen
+bool IsOffScreen()
+{
+    return pixelCoord.x > 2.0f * halfWidth || pixelCoord.y > 2.0f * halfHeight;
+}
+
+//Whether the ray of the pixel goes to the geodesic cache. The corners the
+//refine pass reads are never written by it
+bool IsGeodesicStored()
+{
+    ivec2 pixel = ivec2(pixelCoord);
+    bvec2 onNode = bvec2(pixel.x % coarseStep == 0 || pixel.x == int(2.0f * halfWidth) - 1,
+                         pixel.y % coarseStep == 0 || pixel.y == int(2.0f * halfHeight) - 1);
+    bool isNode = coarsePass == COARSE_REFINE && all(onNode);
+    return coarsePass == COARSE_NODES || (geodesicCacheMode == CACHE_STORE && !isNode);
+}
+
+//Shades the pixel from the cache or the coarse corners
+//returns true if it did, false if its ray must be marched
+bool ResolveWithoutMarch(inout bool store, out vec3 dir, out vec3 color, out bool escaped)
+{
+    if (geodesicCacheMode == CACHE_REUSE && ReuseGeodesic(dir, color, escaped))
+    {
+        store = false;
+        return true;
+    }
+    return coarsePass == COARSE_REFINE && InterpolateGeodesic(dir, color, escaped);
 }
 
+//Marches the ray of the pixel
+bool MarchPixel(out vec3 dir, out vec3 color)
+{
+    vec3 pos;
+    diskHitCount = 0;
+    GenerateRay(pos, dir);
+    bool escaped = RayMarch(pos, dir, color);
+    if (countSteps)
+        atomicAdd(tracedRays, 1u);
+    return escaped;
+}
+
+//Brightness computation for Bloom effect
+vec4 GetBrightColor(vec4 color)
+{
+    vec3 brightnessThreshold = vec3(0.2126, 0.5152, 0.02722);
+    float brightness = dot(vec3(color), brightnessThreshold);
+    if (brightness > 1.0)
+        return color;
+    return vec4(0.0, 0.0, 0.0, 1.0);
+}
+
+#ifndef COMPUTE_TRACER
 ///Main function
 void main()
 {
-   vec3 pos;
-   vec3 dir;
-   GenerateRay(pos, dir);
+   if (countSteps)
+       atomicAdd(tracedPixels, 1u);
+   pixelCoord = GetTracedPixel(ivec2(gl_FragCoord.xy));
+   if (IsOffScreen())
+       discard;
 
-   fragColor = vec4(RayMarch(pos, dir), 1.0);
-
-   //Brightness computation for Bloom effect
-   vec3 brightnessThreshold = vec3(0.2126, 0.5152, 0.02722);
-   float brightness = dot(vec3(fragColor), brightnessThreshold);
-    if(brightness > 1.0)
-        brightColor = fragColor;
-    else
-        brightColor = vec4(0.0, 0.0, 0.0, 1.0);
+   vec3 dir;
+   vec3 color;
+   bool escaped;
+   bool store = IsGeodesicStored();
+   recordHits = store;
+   if (!ResolveWithoutMarch(store, dir, color, escaped))
+       escaped = MarchPixel(dir, color);
+   if (store)
+       StoreGeodesic(dir, escaped);
+   //Finally, add skybox color at the final ray direction. The cubemap is mipmapped, so it
+   //is sampled outside of the (divergent) march to keep the derivatives well defined
+   vec3 sky = texture(cubeMap, dir).rgb;
+   if (escaped)
+       color += sky;
+   fragColor = vec4(color, 1.0);
+   brightColor = GetBrightColor(fragColor);
 }
+#endif
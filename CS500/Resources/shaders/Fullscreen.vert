@@ -0,0 +1,11 @@
+#version 440 core
+
+//A single triangle that covers the screen. Unlike the two triangles of a
+//quad it has no shared edge, so the 2x2 quads along the diagonal are not
+//shaded by both triangles with helper invocations for the pixels outside
+//each one. Drawn with 3 vertices and no attributes
+void main()
+{
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(position * 2.0f - 1.0f, 1.0f, 1.0f);
+}
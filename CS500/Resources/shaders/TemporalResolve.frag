@@ -0,0 +1,76 @@
+#version 440 core
+layout (location = 0) out vec4 fragColor;
+layout (location = 1) out vec4 brightColor;
+in vec2 TexCoords;
+
+//pixels BlackHole.frag traced this frame, packed (see GetPixelCoord there)
+uniform sampler2D traced;
+//last resolved frame, and whether the camera stayed on its orbit since then.
+//The hole is always at the center of the screen, and orbiting around it only
+//rotates the rays with the camera (see geodesicCacheMode in BlackHole.frag),
+//so every pixel keeps looking at the same part of the shadow and the disk.
+//The history is read at the same pixel: only the sky behind slides, and it
+//is smooth enough for the neighborhood clamp below
+uniform sampler2D history;
+uniform bool historyValid;
+uniform int temporalInterleave;
+uniform int temporalPhase;
+
+//Checks whether a screen pixel was traced this frame
+bool IsTraced(ivec2 p)
+{
+    if (temporalInterleave == 2)
+        return ((p.x + p.y + temporalPhase) & 1) == 0;
+    return (p.x & 1) == (temporalPhase & 1) && (p.y & 1) == (temporalPhase >> 1);
+}
+
+//Texel of the traced target that holds a traced screen pixel
+ivec2 GetTracedTexel(ivec2 p)
+{
+    if (temporalInterleave == 2)
+        return ivec2(p.x / 2, p.y);
+    return p / 2;
+}
+
+void main()
+{
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    ivec2 size = textureSize(history, 0);
+    vec3 color;
+    if (IsTraced(p))
+        color = texelFetch(traced, GetTracedTexel(p), 0).rgb;
+    else
+    {
+        //range of the pixels traced around this one. History outside of it is
+        //stale: the photon ring or the edge of the disk moved over this pixel
+        int radius = temporalInterleave == 4 ? 2 : 1;
+        vec3 lo = vec3(1e30f), hi = vec3(-1e30f), sum = vec3(0.0f);
+        float count = 0.0f;
+        for (int y = -radius; y <= radius; y++)
+        {
+            for (int x = -radius; x <= radius; x++)
+            {
+                ivec2 q = p + ivec2(x, y);
+                if (any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, size)) || !IsTraced(q))
+                    continue;
+                vec3 c = texelFetch(traced, GetTracedTexel(q), 0).rgb;
+                lo = min(lo, c);
+                hi = max(hi, c);
+                sum += c;
+                count += 1.0f;
+            }
+        }
+        color = sum / max(count, 1.0f);
+        if (historyValid && count > 0.0f)
+            color = clamp(texelFetch(history, p, 0).rgb, lo, hi);
+    }
+    fragColor = vec4(color, 1.0);
+
+    //Brightness computation for Bloom effect, like BlackHole.frag
+    vec3 brightnessThreshold = vec3(0.2126, 0.5152, 0.02722);
+    float brightness = dot(color, brightnessThreshold);
+    if (brightness > 1.0)
+        brightColor = fragColor;
+    else
+        brightColor = vec4(0.0, 0.0, 0.0, 1.0);
+}
@@ -1,7 +1,20 @@
 #version 440 core
 
 layout(location = 0) in vec3 attr_position;
-layout(location = 0) uniform mat4 uniform_mvp;
+//written every frame, declared as in BlackHole.frag
+layout(std140, binding = 0) uniform CameraBlock
+{
+    mat4 uniform_mvp;
+    vec3 camPos;
+    float aspectRatio;
+    vec3 view;
+    float focalLength;
+    vec3 right;
+    float halfWidth;
+    vec3 up;
+    float halfHeight;
+    float timeElapsed;
+};
 
 out vec3 TexCoords;
 
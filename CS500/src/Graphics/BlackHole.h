@@ -1,19 +1,13 @@
 #pragma once
 #include "../Utilities/pch.hpp"
 #include "GL/glew.h"
+#include "TextureManager.h"
 
-struct Texture
-{
-	std::string dir{ "Resources/Textures/starless_disk.jpg" };
-	GLuint tex{};
-	GLuint vao{};
-	void CreateTexture();
-};
 struct BlackHole
 {
-	Texture* diskTexture;
-	Texture* bbTexture;
-	Texture* noiseTexture;
+	TextureHandle diskTexture;
+	TextureHandle bbTexture;
+	TextureHandle noiseTexture;
 	float EHRad = 1.0f;
 	float innerDiskRad = 2.0f;
 	float outerDiskRad = 8.0f;
@@ -0,0 +1,287 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the CubeMap struct
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "GL/glew.h"
+#include "../Utilities/pch.hpp"
+#include "../Utilities/ThreadPool.h"
+#include "CubeMap.h"
+#include "GpuMemory.h"
+
+/**
+ * Frees the OpenGL texture, waiting for the copies still using the upload ring
+*/
+CubeMap::~CubeMap()
+{
+	for (auto& strip : strips)
+	{
+		if (!strip.staged)
+			continue;
+		strip.copy.wait();
+		Uploads.Fence(strip.region);
+	}
+	GpuMem.Release(GpuMemory::Kind::TEXTURE, tex);
+	glDeleteTextures(1, &tex);
+}
+
+/**
+ * Creates Cubemap data for OpenGL, decoding the faces in parallel.
+ * Blocks until the smallest level is uploaded, the rest is streamed later.
+*/
+void CubeMap::CreateCubemap()
+{
+	RequestFaces();
+	CollectFaces(true);
+	while (state == State::STREAMING && !IsDisplayable())
+		Stream(0);
+}
+
+/**
+ * Queues the decoding (and mip generation and downsampling) of the six faces in the worker threads
+*/
+void CubeMap::RequestFaces()
+{
+	static const char* names[6] = { "right", "left", "top", "bottom", "front", "back" };
+	state = State::LOADING;
+	for (unsigned i = 0; i < faces.size(); ++i)
+	{
+		auto path = dir + "/" + names[i] + ".png";
+		int size = maxSize;
+		faces[i] = Workers.Submit([path, size]()
+		{
+			Image image;
+			if (image.Load(path, 3))
+			{
+				image.GenerateMips();
+				image.ClampSize(size);
+			}
+			return image;
+		});
+	}
+}
+
+/**
+ * Takes the faces the workers are done with. Once all six are decoded the
+ * GPU storage is allocated and the cubemap starts streaming
+ * @param _wait - whether to block until every face is decoded
+ * @return - true if every face is decoded
+*/
+bool CubeMap::CollectFaces(bool _wait)
+{
+	if (state != State::LOADING)
+		return state != State::UNLOADED;
+
+	bool done = true;
+	for (unsigned i = 0; i < faces.size(); ++i)
+	{
+		if (!faces[i].valid())
+			continue;
+		if (!_wait && faces[i].wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			done = false;
+			continue;
+		}
+		images[i] = faces[i].get();
+		if (images[i].data)
+			std::cout << "Cubemap face " << images[i].path << (images[i].cached ? ": mapped " : ": decode ") << images[i].decodeMs << " ms" << std::endl;
+		else
+			std::cout << "Cubemap texture failed to load at path: " << images[i].path << std::endl;
+	}
+
+	if (done)
+		AllocateStorage();
+	return done;
+}
+
+/**
+ * Queues the next strips of the mip chain, smallest levels first, and issues
+ * the uploads of the strips already copied to the upload ring
+ * @param _budget - bytes to queue (at least one strip is always queued)
+ * @return - bytes queued
+*/
+size_t CubeMap::Stream(size_t _budget)
+{
+	if (state != State::STREAMING)
+		return 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	glBindTexture(GL_TEXTURE_CUBE_MAP, tex);
+	IssueStrips();
+	size_t queued = 0;
+	while (queueLevel >= 0 && (queued == 0 || queued < _budget))
+	{
+		if (!QueueStrip(_budget - std::min(_budget, queued)))
+			break;
+		queued += strips.back().size;
+	}
+	//strips that are not staged (no upload ring) are uploaded right away
+	IssueStrips();
+
+	uploadMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	streamFrames++;
+	if (state == State::READY)
+	{
+		for (unsigned i = 0; i < images.size(); ++i)
+			if (images[i].data)
+				std::cout << "Cubemap face " << images[i].path << ": upload " << faceUploadMs[i] << " ms" << std::endl;
+		std::cout << "Cubemap " << dir << " fully streamed: " << levelCount << " levels, upload " << uploadMs << " ms over " << streamFrames << " frames" << std::endl;
+		for (auto& image : images)
+			image.Free();
+	}
+	return queued;
+}
+
+/**
+ * Queues the next strip of rows, copying it to the upload ring in a worker
+ * @param _budget - bytes the strip should not exceed (it has at least one row)
+ * @return - false if the upload ring is full
+*/
+bool CubeMap::QueueStrip(size_t _budget)
+{
+	Strip strip;
+	strip.face = queueFace;
+	strip.level = queueLevel;
+	strip.row = queueRow;
+
+	//faces that failed to load queue an empty strip to keep the level bookkeeping
+	const Image& image = images[queueFace];
+	int height = 1;
+	if (static_cast<int>(image.levels.size()) > queueLevel)
+	{
+		const Image::Level& mip = image.levels[queueLevel];
+		size_t rowBytes = static_cast<size_t>(mip.width) * image.channels;
+		if (Uploads.IsValid())
+			_budget = std::min(_budget, Uploads.GetSize() / 2);
+		height = mip.height;
+		strip.rows = static_cast<int>(std::clamp<size_t>(_budget / rowBytes, 1, mip.height - queueRow));
+		strip.src = mip.data + queueRow * rowBytes;
+		strip.size = strip.rows * rowBytes;
+	}
+
+	if (strip.size && Uploads.IsValid())
+	{
+		if (!Uploads.Allocate(strip.size, strip.region))
+			return false;
+		strip.staged = true;
+		unsigned char* dst = strip.region.ptr;
+		const unsigned char* src = strip.src;
+		size_t size = strip.size;
+		strip.copy = Workers.Submit([dst, src, size]() { std::memcpy(dst, src, size); });
+	}
+
+	queueRow += std::max(strip.rows, 1);
+	if (queueRow >= height)
+	{
+		queueRow = 0;
+		if (++queueFace == faces.size())
+		{
+			queueFace = 0;
+			queueLevel--;
+			strip.completesLevel = true;
+		}
+	}
+	strips.push_back(std::move(strip));
+	return true;
+}
+
+/**
+ * Issues, in order, the uploads of the strips whose copies are done. Lowers
+ * the base level every time the six faces of a level are complete
+*/
+void CubeMap::IssueStrips()
+{
+	while (!strips.empty())
+	{
+		Strip& strip = strips.front();
+		if (strip.staged && strip.copy.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			break;
+
+		if (strip.size)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			const Image::Level& mip = images[strip.face].levels[strip.level];
+			//with an unpack buffer bound the pixel pointer is an offset into it
+			const void* pixels = strip.src;
+			if (strip.staged)
+			{
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, Uploads.GetBuffer());
+				pixels = reinterpret_cast<const void*>(strip.region.offset);
+			}
+			glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + strip.face, strip.level, 0, strip.row, mip.width, strip.rows, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+			if (strip.staged)
+			{
+				Uploads.Fence(strip.region);
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			}
+			faceUploadMs[strip.face] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+
+		if (strip.completesLevel)
+		{
+			residentLevel = strip.level;
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, residentLevel);
+			if (residentLevel == 0)
+				state = State::READY;
+		}
+		strips.pop_front();
+	}
+}
+
+/**
+ * Checks whether the cubemap can be sampled (at least its smallest level is uploaded)
+ * @return - true if it can be shown
+*/
+bool CubeMap::IsDisplayable() const
+{
+	return (state == State::STREAMING || state == State::READY) && residentLevel < levelCount;
+}
+
+/**
+ * Allocates the immutable storage of the whole mip chain
+*/
+void CubeMap::AllocateStorage()
+{
+	const Image* first = nullptr;
+	for (const auto& image : images)
+	{
+		if (image.data)
+		{
+			first = &image;
+			break;
+		}
+	}
+	if (first == nullptr)
+	{
+		state = State::UNLOADED;
+		return;
+	}
+
+	levelCount = static_cast<int>(first->levels.size());
+	residentLevel = levelCount;
+	queueLevel = levelCount - 1;
+	queueFace = 0;
+	queueRow = 0;
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, tex);
+	glTexStorage2D(GL_TEXTURE_CUBE_MAP, levelCount, GL_SRGB8, first->width, first->height);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	//only the levels already uploaded can be sampled
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, levelCount - 1);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+	//SRGB8 is padded to 4 bytes per texel
+	GpuMem.Track(GpuMemory::Kind::TEXTURE, tex, dir, 6 * GpuMemory::GetTextureBytes(first->width, first->height, 4, levelCount));
+	state = State::STREAMING;
+}
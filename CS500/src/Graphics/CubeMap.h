@@ -0,0 +1,85 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the CubeMap struct
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <array>
+#include <deque>
+#include <future>
+#include <string>
+#include "GL/glew.h"
+#include "Image.h"
+#include "UploadRing.h"
+
+/**
+ * Skybox whose faces are decoded by the workers and whose mip chain is
+ * streamed to the GPU from the smallest level to the largest one, so that it
+ * can be shown (blurry) long before level 0 is uploaded.
+ *
+ * Levels are split in strips of rows. The workers copy each strip into the
+ * upload ring and the GL thread issues the upload once the copy is done, so
+ * the render loop never waits on a transfer.
+ */
+struct CubeMap
+{
+	enum class State { UNLOADED, LOADING, STREAMING, READY };
+
+	CubeMap(const std::string& _dir) : dir(_dir) {}
+	~CubeMap();
+	void CreateCubemap();
+	void RequestFaces();
+	bool CollectFaces(bool _wait);
+	size_t Stream(size_t _budget);
+	bool IsDisplayable() const;
+
+	std::string dir{};
+	State state = State::UNLOADED;
+	//faces being decoded by the workers
+	std::array<std::future<Image>, 6> faces{};
+	//decoded faces (with their mip chain), kept until every level is uploaded
+	std::array<Image, 6> images{};
+	//largest face size to upload (0 for no limit), larger faces drop their top levels
+	int maxSize = 0;
+	int levelCount = 0;
+	//largest level whose six faces are on the GPU (levelCount if none)
+	int residentLevel = 0;
+	//next strip to queue
+	int queueLevel = 0;
+	unsigned queueFace = 0;
+	int queueRow = 0;
+	double uploadMs = 0.0;
+	//time spent issuing the strips of each face
+	std::array<double, 6> faceUploadMs{};
+	unsigned streamFrames = 0;
+	GLuint cubemapFBO[6]{};
+	GLuint tex{};
+
+private:
+	struct Strip
+	{
+		unsigned face{};
+		int level{};
+		int row{};
+		int rows{};
+		const unsigned char* src{};
+		size_t size{};
+		//last strip of its level, issuing it makes the level resident
+		bool completesLevel{};
+		bool staged{};
+		UploadRing::Region region{};
+		std::future<void> copy{};
+	};
+
+	void AllocateStorage();
+	bool QueueStrip(size_t _budget);
+	void IssueStrips();
+
+	//strips being copied to the upload ring, in upload order
+	std::deque<Strip> strips;
+};
@@ -0,0 +1,127 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the GPU Memory class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include "../Utilities/pch.hpp"
+#include "../ImGui/imgui.h"
+#include "GpuMemory.h"
+
+namespace
+{
+	static const char* KindNames[] = { "Textures", "Attachments", "Buffers" };
+}
+
+/**
+ * Records the storage of a GL object, replacing any previous entry of it
+ * @param _kind - type of the object
+ * @param _id - GL name of the object
+ * @param _label - name shown in the reports
+ * @param _bytes - size of its storage
+*/
+void GpuMemory::Track(Kind _kind, GLuint _id, const std::string& _label, size_t _bytes)
+{
+	entries[{ _kind, _id }] = { _label, _bytes };
+}
+
+/**
+ * Forgets a GL object that is being deleted
+ * @param _kind - type of the object
+ * @param _id - GL name of the object
+*/
+void GpuMemory::Release(Kind _kind, GLuint _id)
+{
+	entries.erase({ _kind, _id });
+}
+
+/**
+ * Adds up every tracked object
+ * @return - memory in bytes
+*/
+size_t GpuMemory::GetTotal() const
+{
+	size_t total = 0;
+	for (const auto& e : entries)
+		total += e.second.bytes;
+	return total;
+}
+
+/**
+ * Adds up the tracked objects of a type
+ * @param _kind - type of the objects
+ * @return - memory in bytes
+*/
+size_t GpuMemory::GetTotal(Kind _kind) const
+{
+	size_t total = 0;
+	for (const auto& e : entries)
+		if (e.first.first == _kind)
+			total += e.second.bytes;
+	return total;
+}
+
+/**
+ * Prints every tracked object, grouped by type
+*/
+void GpuMemory::LogReport() const
+{
+	for (int k = 0; k < 3; ++k)
+	{
+		Kind kind = static_cast<Kind>(k);
+		std::cout << KindNames[k] << ": " << GetTotal(kind) / 1024 << " KB" << std::endl;
+		for (const auto& e : entries)
+			if (e.first.first == kind)
+				std::cout << "    " << e.second.label << " (" << e.first.second << "): " << e.second.bytes / 1024 << " KB" << std::endl;
+	}
+	std::cout << "GPU memory total: " << GetTotal() / 1024 << " KB" << std::endl;
+}
+
+/**
+ * Shows the ledger in the ImGui panel
+*/
+void GpuMemory::Edit() const
+{
+	if (!ImGui::CollapsingHeader("GPU memory"))
+		return;
+	ImGui::Text("Total: %.1f MB", GetTotal() / (1024.0 * 1024.0));
+	for (int k = 0; k < 3; ++k)
+	{
+		Kind kind = static_cast<Kind>(k);
+		if (!ImGui::TreeNode(KindNames[k], "%s: %.1f MB", KindNames[k], GetTotal(kind) / (1024.0 * 1024.0)))
+			continue;
+		for (const auto& e : entries)
+			if (e.first.first == kind)
+				ImGui::Text("%s: %zu KB", e.second.label.c_str(), e.second.bytes / 1024);
+		ImGui::TreePop();
+	}
+	if (ImGui::Button("Dump to log"))
+		LogReport();
+}
+
+/**
+ * Computes the size of a 2D texture
+ * @param _width - width of level 0
+ * @param _height - height of level 0
+ * @param _bytesPerTexel - size of a texel
+ * @param _levels - number of mip levels, 0 for the full chain
+ * @return - memory in bytes
+*/
+size_t GpuMemory::GetTextureBytes(int _width, int _height, size_t _bytesPerTexel, int _levels)
+{
+	size_t bytes = 0;
+	for (int level = 0, w = _width, h = _height; _levels == 0 || level < _levels; ++level)
+	{
+		bytes += static_cast<size_t>(w) * h * _bytesPerTexel;
+		if (w == 1 && h == 1)
+			break;
+		w = std::max(1, w / 2);
+		h = std::max(1, h / 2);
+	}
+	return bytes;
+}
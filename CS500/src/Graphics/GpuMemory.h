@@ -0,0 +1,48 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the GPU Memory class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <map>
+#include <string>
+#include <utility>
+#include "GL/glew.h"
+#include "../Utilities/Singleton.h"
+
+/**
+ * Ledger of the GPU memory allocated by the renderer. Every texture, frame
+ * buffer attachment and buffer is tracked when its storage is created and
+ * released when it is deleted. Sizes are estimates, drivers may pad them.
+ */
+class GpuMemory
+{
+	MAKE_SINGLETON(GpuMemory)
+public:
+	enum class Kind { TEXTURE, ATTACHMENT, BUFFER };
+
+	void Track(Kind _kind, GLuint _id, const std::string& _label, size_t _bytes);
+	void Release(Kind _kind, GLuint _id);
+	size_t GetTotal() const;
+	size_t GetTotal(Kind _kind) const;
+	void LogReport() const;
+	void Edit() const;
+
+	static size_t GetTextureBytes(int _width, int _height, size_t _bytesPerTexel, int _levels = 1);
+
+private:
+	struct Entry
+	{
+		std::string label{};
+		size_t bytes{};
+	};
+
+	std::map<std::pair<Kind, GLuint>, Entry> entries;
+};
+
+#define GpuMem (GpuMemory::Instance())
@@ -0,0 +1,268 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the Image struct
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include "../Utilities/pch.hpp"
+#include "../Utilities/Profiler.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "../Utilities/stb_image.h"
+#include "TextureArchive.h"
+#include "TextureCache.h"
+#include "Image.h"
+
+/**
+ * Loads an image from the texture archive if it is there, then mapping it
+ * from the texture cache when there is an up to date entry and decoding the
+ * source file with stbi otherwise.
+ * Safe to call from worker threads.
+ * @param _path - path of the source image
+ * @param _channels - channels to convert to
+ * @return - true if success, false otherwise
+*/
+bool Image::Load(const std::string& _path, int _channels)
+{
+	ProfileScope scope("Load " + _path, "io");
+	bool loaded = Open(_path, _channels) || Decode(_path, _channels);
+	scope.AddArg("bytes", static_cast<double>(fileBytes));
+	scope.AddArg("cached", cached);
+	return loaded;
+}
+
+/**
+ * Points the image at the baked pixels of a source, from the texture archive
+ * or an up to date texture cache entry. Nothing is decoded.
+ * Safe to call from worker threads.
+ * @param _path - path of the source image
+ * @param _channels - channels the caller expects
+ * @return - true if the source was baked, false otherwise
+*/
+bool Image::Open(const std::string& _path, int _channels)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	if (!Archive.Find(_path, _channels, *this) && !TextureCache::Open(_path, _channels, *this))
+		return false;
+	decodeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return true;
+}
+
+/**
+ * Decodes an image file using stbi. Safe to call from worker threads.
+ * @param _path - path of the image
+ * @param _channels - channels to convert to, 0 keeps the ones in the file
+ * @return - true if success, false otherwise
+*/
+bool Image::Decode(const std::string& _path, int _channels)
+{
+	Free();
+	path = _path;
+	auto start = std::chrono::high_resolution_clock::now();
+	int fileChannels = 0;
+	decoded = stbi_load(path.c_str(), &width, &height, &fileChannels, _channels);
+	channels = _channels ? _channels : fileChannels;
+	std::error_code ec;
+	fileBytes = static_cast<size_t>(std::filesystem::file_size(path, ec));
+	if (ec)
+		fileBytes = 0;
+	data = decoded;
+	if (data)
+		levels.push_back({ width, height, data });
+	decodeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return data != nullptr;
+}
+
+/**
+ * Takes ownership of a mapped cache file, pointing the levels straight into it
+ * @param _file - the mapping
+ * @param _width - width of level 0
+ * @param _height - height of level 0
+ * @param _channels - channels per pixel
+ * @param _offsets - offset of each level from the start of the file
+ * @return - true if success, false otherwise
+*/
+bool Image::Map(MappedFile&& _file, int _width, int _height, int _channels, const std::vector<size_t>& _offsets)
+{
+	Free();
+	mapping = std::move(_file);
+	if (!SetLevels(mapping.GetData(), mapping.GetSize(), _width, _height, _channels, _offsets))
+		return false;
+	fileBytes = mapping.GetSize();
+	return true;
+}
+
+/**
+ * Points the levels into memory owned by someone else (i.e. the texture
+ * archive), which has to outlive the image
+ * @param _base - start of the memory the offsets are relative to
+ * @param _size - size of that memory
+ * @param _width - width of level 0
+ * @param _height - height of level 0
+ * @param _channels - channels per pixel
+ * @param _offsets - offset of each level from _base
+ * @return - true if success, false otherwise
+*/
+bool Image::View(const unsigned char* _base, size_t _size, int _width, int _height, int _channels, const std::vector<size_t>& _offsets)
+{
+	Free();
+	if (!SetLevels(_base, _size, _width, _height, _channels, _offsets))
+		return false;
+	for (const auto& level : levels)
+		fileBytes += static_cast<size_t>(level.width) * level.height * channels;
+	return true;
+}
+
+/**
+ * Fills the mip chain from packed levels
+ * @param _base - start of the memory the offsets are relative to
+ * @param _size - size of that memory
+ * @param _width - width of level 0
+ * @param _height - height of level 0
+ * @param _channels - channels per pixel
+ * @param _offsets - offset of each level from _base
+ * @return - true if success, false if a level is out of bounds
+*/
+bool Image::SetLevels(const unsigned char* _base, size_t _size, int _width, int _height, int _channels, const std::vector<size_t>& _offsets)
+{
+	width = _width;
+	height = _height;
+	channels = _channels;
+	int w = width, h = height;
+	for (size_t offset : _offsets)
+	{
+		size_t levelSize = static_cast<size_t>(w) * h * channels;
+		if (offset + levelSize > _size)
+		{
+			Free();
+			return false;
+		}
+		levels.push_back({ w, h, _base + offset });
+		w = std::max(1, w / 2);
+		h = std::max(1, h / 2);
+	}
+	data = levels.empty() ? nullptr : levels[0].data;
+	cached = true;
+	return data != nullptr;
+}
+
+/**
+ * Generates the full mip chain on the CPU with a box filter
+*/
+void Image::GenerateMips()
+{
+	if (levels.size() != 1)
+		return;
+	ProfileScope scope("GenerateMips " + path, "io");
+
+	//compute the size of the whole chain so that the storage is never reallocated
+	size_t total = 0;
+	for (int w = width, h = height; w > 1 || h > 1;)
+	{
+		w = std::max(1, w / 2);
+		h = std::max(1, h / 2);
+		total += static_cast<size_t>(w) * h * channels;
+	}
+	mipStorage.resize(total);
+
+	unsigned char* dst = mipStorage.data();
+	while (levels.back().width > 1 || levels.back().height > 1)
+	{
+		Level src = levels.back();
+		Level mip{ std::max(1, src.width / 2), std::max(1, src.height / 2), dst };
+		for (int y = 0; y < mip.height; ++y)
+		{
+			int y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+			for (int x = 0; x < mip.width; ++x)
+			{
+				int x0 = std::min(2 * x, src.width - 1), x1 = std::min(2 * x + 1, src.width - 1);
+				for (int c = 0; c < channels; ++c)
+				{
+					unsigned sum = src.data[(y0 * src.width + x0) * channels + c] + src.data[(y0 * src.width + x1) * channels + c] +
+						src.data[(y1 * src.width + x0) * channels + c] + src.data[(y1 * src.width + x1) * channels + c];
+					*dst++ = static_cast<unsigned char>((sum + 2) / 4);
+				}
+			}
+		}
+		levels.push_back(mip);
+	}
+}
+
+/**
+ * Drops the mip levels larger than a size, so that the next one becomes
+ * level 0. Needs the mip chain (mapped or generated)
+ * @param _maxSize - maximum width and height, 0 for no limit
+*/
+void Image::ClampSize(int _maxSize)
+{
+	if (_maxSize <= 0 || levels.empty())
+		return;
+	size_t drop = 0;
+	while (drop + 1 < levels.size() && std::max(levels[drop].width, levels[drop].height) > _maxSize)
+		drop++;
+	if (drop == 0)
+		return;
+	levels.erase(levels.begin(), levels.begin() + drop);
+	width = levels[0].width;
+	height = levels[0].height;
+	data = levels[0].data;
+}
+
+/**
+ * Releases the pixel data
+*/
+void Image::Free()
+{
+	stbi_image_free(decoded);
+	decoded = nullptr;
+	data = nullptr;
+	levels.clear();
+	fileBytes = 0;
+	mipStorage.clear();
+	mipStorage.shrink_to_fit();
+	mapping.Close();
+	cached = false;
+	sourceHash = 0;
+}
+
+Image::Image(Image&& _other) noexcept
+{
+	*this = std::move(_other);
+}
+
+Image& Image::operator=(Image&& _other) noexcept
+{
+	if (this != &_other)
+	{
+		Free();
+		//moving the vectors and the mapping keeps the level pointers valid
+		path = std::move(_other.path);
+		width = _other.width;
+		height = _other.height;
+		channels = _other.channels;
+		data = _other.data;
+		levels = std::move(_other.levels);
+		decodeMs = _other.decodeMs;
+		fileBytes = _other.fileBytes;
+		cached = _other.cached;
+		sourceHash = _other.sourceHash;
+		decoded = _other.decoded;
+		mipStorage = std::move(_other.mipStorage);
+		mapping = std::move(_other.mapping);
+		_other.decoded = nullptr;
+		_other.data = nullptr;
+		_other.levels.clear();
+	}
+	return *this;
+}
+
+Image::~Image()
+{
+	Free();
+}
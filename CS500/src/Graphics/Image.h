@@ -0,0 +1,71 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the Image struct
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../Utilities/MappedFile.h"
+
+/**
+ * CPU side pixel data, either decoded from disk or mapped from the texture
+ * cache. It does not touch OpenGL, so it can be loaded from any thread and
+ * handed to the GL thread for uploading.
+ */
+struct Image
+{
+	struct Level
+	{
+		int width{};
+		int height{};
+		const unsigned char* data{};
+	};
+
+	bool Load(const std::string& _path, int _channels);
+	bool Open(const std::string& _path, int _channels);
+	bool Decode(const std::string& _path, int _channels = 0);
+	bool Map(MappedFile&& _file, int _width, int _height, int _channels, const std::vector<size_t>& _offsets);
+	bool View(const unsigned char* _base, size_t _size, int _width, int _height, int _channels, const std::vector<size_t>& _offsets);
+	void GenerateMips();
+	void ClampSize(int _maxSize);
+	void Free();
+	size_t GetSize() const { return static_cast<size_t>(width) * height * channels; }
+
+	Image() = default;
+	Image(Image&& _other) noexcept;
+	Image& operator=(Image&& _other) noexcept;
+	Image(const Image&) = delete;
+	Image& operator=(const Image&) = delete;
+	~Image();
+
+	std::string path{};
+	int width{};
+	int height{};
+	int channels{};
+	//level 0 pixels
+	const unsigned char* data{};
+	//mip chain, level 0 included. Tightly packed rows
+	std::vector<Level> levels{};
+	//time spent decoding (or mapping), in milliseconds
+	double decodeMs{};
+	//size of the file the pixels were read from
+	size_t fileBytes{};
+	//whether the pixels come from the texture cache (or archive)
+	bool cached{};
+	//hash of the source file recorded when it was baked, 0 if decoded
+	uint64_t sourceHash{};
+
+private:
+	bool SetLevels(const unsigned char* _base, size_t _size, int _width, int _height, int _channels, const std::vector<size_t>& _offsets);
+
+	unsigned char* decoded{};
+	std::vector<unsigned char> mipStorage{};
+	MappedFile mapping{};
+};
@@ -8,14 +8,20 @@
 //	Author:			Jon Zapata (j.zapata@digipen.edu)
 // ----------------------------------------------------------------------------
 
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include "GL/glew.h"
 #include "../Utilities/pch.hpp"
 #include "../ImGui/imgui.h"
-#define STB_IMAGE_IMPLEMENTATION
-#include "../Utilities/stb_image.h"
 #include "../Utilities/ImGuiManager.h"
+#include "../Utilities/Profiler.h"
+#include "../Utilities/ThreadPool.h"
+#include "../Raytracer/CpuTracer.h"
 #include "BlackHole.h"
+#include "GpuMemory.h"
+#include "TextureArchive.h"
+#include "UniformRing.h"
 #include "RenderManager.h"
 
 namespace
@@ -24,12 +30,247 @@ namespace
 	static unsigned bloomIterations = 10;
 	static unsigned quadVAO = 0;
 	static unsigned quadVBO;
-	static unsigned skyboxVAO;
-	static unsigned skyboxVBO;
+	static unsigned fullscreenVAO = 0;
 	static float timeElapsed = 0.0f;
+	//compiled into the black hole shader, each combination is a permutation
 	static bool mbApplyLensing = true;
 	static bool mbRenderDisk = true;
+	//BlackHole.comp dispatched over 8x8 tiles instead of rasterizing the
+	//fullscreen triangle, also a permutation
+	static bool mbComputeTracer = false;
+	//Dormand-Prince integration, and the error it allows per step
+	static bool mbAdaptiveStep = true;
+	static float stepTolerance = 1e-5f;
+	//the inverse radius integrated over the orbital angle instead, binetStep radians per step
+	static bool mbBinetOrbit = false;
+	static float binetStep = 0.05f;
+	//outbound rays finished with the weak field formula
+	static bool mbAnalyticEscape = true;
+	//march statistics of the shader, read back every frame while enabled (it stalls the pipeline)
+	static bool mbCountSteps = false;
+	static GLuint marchStatsBuffer = 0;
+	static const size_t marchStatsCounters = 5;
+	static GLuint marchStats[marchStatsCounters]{};
+	//pixels of the targets the tracer ran over this frame, the shader counts
+	//one invocation per pixel (marchStats[4]) unless some are shaded twice
+	static GLuint tracerPixels = 0;
+	//orbits of the rays for the current camera distance, rebuilt by the workers when it changes
+	static bool mbUseDeflectionTable = false;
+	static DeflectionTable deflectionTable;
+	static std::future<DeflectionTable> pendingDeflectionTable;
+	//table taken from the workers, being copied to the upload ring. It only
+	//replaces deflectionTable once its upload is issued
+	static DeflectionTable stagedDeflectionTable;
+	static UploadRing::Region deflectionRegion;
+	static std::future<void> deflectionCopy;
+	static GLuint deflectionTex = 0;
+	static GLuint deflectionEndTex = 0;
+	//rays of the last traced frame, reused while the camera only orbits around
+	//the y axis (see geodesicCacheMode in BlackHole.frag)
+	static bool mbReuseGeodesics = true;
+	enum GeodesicCacheMode { CACHE_OFF, CACHE_STORE, CACHE_REUSE };
+	static const size_t geodesicImages = 3;
+	static GLuint geodesicCache[geodesicImages]{};
+	static const char* geodesicImageNames[geodesicImages] = { "Geodesic cache escape", "Geodesic cache hits 0", "Geodesic cache hits 1" };
+	//everything the cached rays depend on but the azimuth of the camera
+	struct GeodesicKey
+	{
+		glm::ivec2 size{};
+		//height of the camera and distance to the axis of the black hole
+		float height = 0.0f;
+		float distance = 0.0f;
+		float EHRad = 0.0f;
+		float innerDiskRad = 0.0f;
+		float outerDiskRad = 0.0f;
+		float stepTolerance = 0.0f;
+		float binetStep = 0.0f;
+		//coarse to fine frames store interpolated rays
+		int coarseStep = 0;
+		float coarseMagnification = 0.0f;
+		bool applyLensing = false;
+		bool renderDisk = false;
+		bool adaptiveStep = false;
+		bool binetOrbit = false;
+		bool analyticEscape = false;
+		bool deflectionTable = false;
+	};
+	static GeodesicKey cachedGeodesics{};
+	static bool mbGeodesicsCached = false;
+	static float cachedAzimuth = 0.0f;
+	//the camera moves a little every frame even at the same height and distance
+	static const float orbitTolerance = 1e-5f;
+	static unsigned reusedGeodesicFrames = 0;
+
+	/**
+	 * Checks whether the rays of two geodesic keys are the same up to a rotation
+	 * around the y axis
+	 * @param _a - first key
+	 * @param _b - second key
+	 * @return - true if the cache of one can be rotated into the other
+	*/
+	bool IsSameGeodesicKey(const GeodesicKey& _a, const GeodesicKey& _b)
+	{
+		float tolerance = orbitTolerance * glm::length(glm::vec2(_a.height, _a.distance));
+		bool sameOrbit = std::abs(_a.height - _b.height) <= tolerance && std::abs(_a.distance - _b.distance) <= tolerance;
+		return sameOrbit && _a.size == _b.size && _a.EHRad == _b.EHRad && _a.innerDiskRad == _b.innerDiskRad && _a.outerDiskRad == _b.outerDiskRad
+			&& _a.stepTolerance == _b.stepTolerance && _a.applyLensing == _b.applyLensing && _a.renderDisk == _b.renderDisk
+			&& _a.adaptiveStep == _b.adaptiveStep && _a.binetOrbit == _b.binetOrbit && _a.binetStep == _b.binetStep && _a.analyticEscape == _b.analyticEscape && _a.deflectionTable == _b.deflectionTable
+			&& _a.coarseStep == _b.coarseStep && _a.coarseMagnification == _b.coarseMagnification;
+	}
+	//what the cache was compared against last frame: with temporal interleave
+	//on, it is only stored once the camera stops changing height or distance
+	static GeodesicKey lastGeodesics{};
+	//temporal interleave (1, 2 or 4 pixels per traced one) of the frames that
+	//are marched, the rest of the pixels are reprojected from the last frame
+	static int temporalInterleave = 1;
+	static int frameInterleave = 1;
+	static unsigned temporalFrame = 0;
+	static GLuint tracedFBO = 0;
+	static GLuint tracedColor = 0;
+	static GLuint historyColor = 0;
+	static bool mbHistoryValid = false;
+	static TracerCamera historyCamera{};
+	//coarse to fine (see coarsePass in BlackHole.frag): the frames that trace
+	//the rays trace one pixel every coarseStep first, 0 traces them all. They
+	//are never interleaved
+	enum CoarsePass { COARSE_OFF, COARSE_NODES, COARSE_REFINE };
+	static int coarseStep = 0;
+	static float coarseMagnification = 4.0f;
+	static bool mbCoarseFrame = false;
+
+	/**
+	 * Picks the pixels the interleaved frame traces. The 2x2 blocks are visited
+	 * diagonally first, so the history around every pixel is never too old
+	 * @return - phase of the temporalPhase uniforms
+	*/
+	int GetTemporalPhase()
+	{
+		static const int phases[4] = { 0, 3, 1, 2 };
+		return frameInterleave == 4 ? phases[temporalFrame % 4] : static_cast<int>(temporalFrame % 2);
+	}
+
+	/**
+	 * Picks the permutation of the black hole shader for the toggles
+	 * @return - index in blackHoleVariants, a bit per define
+	*/
+	size_t GetBlackHoleVariant()
+	{
+		return (mbApplyLensing ? 1 : 0) | (mbRenderDisk ? 2 : 0) | (mbComputeTracer ? 4 : 0);
+	}
+	//handles of the uniforms of BlackHole.frag. They are found in the same
+	//order in every permutation, so they index the table of any of them
+	struct BlackHoleUniforms
+	{
+		UniformHandle<int> diskTexture, bbodyTexture, noiseTexture, cubeMap, deflectionTable, deflectionEnds;
+		UniformHandle<bool> adaptiveStep, binetOrbit, analyticEscape, countSteps, useDeflectionTable;
+		UniformHandle<float> stepTolerance, binetStep, deflectionMaxAngle, cacheRotation, coarseMagnification;
+		UniformHandle<int> geodesicCacheMode, coarsePass, coarseStep, temporalInterleave, temporalPhase;
+		//compute tracer only
+		UniformHandle<glm::ivec2> targetSize;
+		UniformHandle<bool> writeScene, writeBright;
+	};
+	static BlackHoleUniforms bhUniforms;
+
+	/**
+	 * Finds the handles of the black hole uniforms in a permutation
+	 * @param _shader - the permutation
+	 * @return - the handles
+	*/
+	BlackHoleUniforms FindBlackHoleUniforms(Shader& _shader)
+	{
+		BlackHoleUniforms u;
+		u.diskTexture = _shader.FindUniform<int>("diskTexture");
+		u.bbodyTexture = _shader.FindUniform<int>("bbodyTexture");
+		u.noiseTexture = _shader.FindUniform<int>("noiseTexture");
+		u.cubeMap = _shader.FindUniform<int>("cubeMap");
+		u.deflectionTable = _shader.FindUniform<int>("deflectionTable");
+		u.deflectionEnds = _shader.FindUniform<int>("deflectionEnds");
+		u.adaptiveStep = _shader.FindUniform<bool>("adaptiveStep");
+		u.binetOrbit = _shader.FindUniform<bool>("binetOrbit");
+		u.analyticEscape = _shader.FindUniform<bool>("analyticEscape");
+		u.countSteps = _shader.FindUniform<bool>("countSteps");
+		u.useDeflectionTable = _shader.FindUniform<bool>("useDeflectionTable");
+		u.stepTolerance = _shader.FindUniform<float>("stepTolerance");
+		u.binetStep = _shader.FindUniform<float>("binetStep");
+		u.deflectionMaxAngle = _shader.FindUniform<float>("deflectionMaxAngle");
+		u.cacheRotation = _shader.FindUniform<float>("cacheRotation");
+		u.coarseMagnification = _shader.FindUniform<float>("coarseMagnification");
+		u.geodesicCacheMode = _shader.FindUniform<int>("geodesicCacheMode");
+		u.coarsePass = _shader.FindUniform<int>("coarsePass");
+		u.coarseStep = _shader.FindUniform<int>("coarseStep");
+		u.temporalInterleave = _shader.FindUniform<int>("temporalInterleave");
+		u.temporalPhase = _shader.FindUniform<int>("temporalPhase");
+		u.targetSize = _shader.FindUniform<glm::ivec2>("targetSize");
+		u.writeScene = _shader.FindUniform<bool>("writeScene");
+		u.writeBright = _shader.FindUniform<bool>("writeBright");
+		return u;
+	}
+	//std140 layouts of the uniform blocks of BlackHole.frag, checked against
+	//the shader at startup. The camera one is written every frame (a copy per
+	//frame in flight), the black hole one only when edited
+	struct CameraBlock
+	{
+		glm::mat4 mvp;
+		glm::vec3 camPos;
+		float aspectRatio;
+		glm::vec3 view;
+		float focalLength;
+		glm::vec3 right;
+		float halfWidth;
+		glm::vec3 up;
+		float halfHeight;
+		float timeElapsed;
+		float padding[3];
+	};
+	struct BlackHoleBlock
+	{
+		glm::vec3 BHPos;
+		float EHRad;
+		float innerDiskRad;
+		float outerDiskRad;
+		float beamExponent;
+		float padding;
+	};
+	enum UniformBlockBinding { CAMERA_BLOCK, BLACK_HOLE_BLOCK };
+	static const unsigned framesInFlight = 3;
+	static UniformRing cameraBlock;
+	static GLuint blackHoleBlockBuffer = 0;
+
+	/**
+	 * Computes the size of the target an interleaved frame is traced into
+	 * @param _size - size of the window
+	 * @return - texels of the target
+	*/
+	glm::ivec2 GetInterleavedSize(glm::ivec2 _size)
+	{
+		return { (_size.x + 1) / 2, frameInterleave == 4 ? (_size.y + 1) / 2 : _size.y };
+	}
+	//uniforms of the post processing shaders set every frame
+	static UniformHandle<bool> bloomHorizontal;
+	static UniformHandle<bool> bloomEnabled;
+	static UniformHandle<int> resolveInterleave;
+	static UniformHandle<int> resolvePhase;
+	static UniformHandle<bool> resolveHistoryValid;
 	static bool mbApplyBloom = true;
+	static bool mbPrefetchSkyboxes = true;
+	//largest skybox face uploaded, 0 for full resolution
+	static int maxSkySize = 0;
+	//RGBA16F
+	static const size_t HDRBytesPerTexel = 8;
+	//megabytes of skybox mip levels uploaded per frame
+	static int streamBudgetMB = 16;
+	//staging memory for texture uploads
+	static const size_t uploadRingSize = 64 * 1024 * 1024;
+	//every texture baked by the bake tool, optional
+	static const char* textureArchivePath = "Cache/Resources.bpak";
+	//timings of Initialize, for chrome://tracing
+	static const char* startupTracePath = "startup_trace.json";
+	//frames to wait after startup before decoding the unused skyboxes
+	static const unsigned prefetchDelay = 120;
+	static unsigned frameCount = 0;
+	//uniforms of the last frame, for the CPU reference
+	static TracerCamera uploadedCamera;
+	static float uploadedTime = 0.0f;
 }
 
 /**
@@ -39,35 +280,107 @@ namespace
 */
 void RenderManager::Initialize(int _width, int _height)
 {
+	Profile.BeginSession(startupTracePath);
+	int64_t start = Profile.GetTimestamp();
 	window.GenerateWindow("cs500_j.zapata", { _width, _height });
+	{
+		ProfileScope scope("ThreadPool::Initialize");
+		Workers.Initialize();
+	}
+	{
+		ProfileScope scope("TextureArchive::Open");
+		Archive.Open(textureArchivePath);
+	}
 
 	InitializeOpenGL();
+	{
+		ProfileScope scope("UploadRing::Initialize");
+		Uploads.Initialize(uploadRingSize);
+	}
 
 	camera.Initialize();
 	camera.SetProjection(60.0f, { _width, _height }, 0.001f, 1000.0f);
 
 	CreateShaders();
 	CreateQuadTexture();
-	CreateSkybox();
+	CreateFullscreenTriangle();
 	InitializeBH();
 	CreateDiskTexture();
 	CreateBBTexture();
 	CreateNoiseTexture();
 	CreateCubemaps();
 	CreateBuffers();
+	GpuMem.LogReport();
 
-	ImGuiMgr.Initialize();
+	{
+		ProfileScope scope("ImGui::Initialize");
+		ImGuiMgr.Initialize();
+	}
+	Profile.AddEvent("RenderManager::Initialize", "startup", start, Profile.GetTimestamp());
+	Profile.EndSession();
+	initialized = true;
 }
 
 /**
- * Clears the resources
+ * Clears the resources. Called by main while the singletons it releases into
+ * (GpuMem, Uploads, Archive and Workers) are still alive: they are created in
+ * Initialize, after this one, so they are destroyed before ~RenderManager
 */
 void RenderManager::Shutdown()
 {
+	if (!initialized)
+		return;
+	initialized = false;
 	for (auto& c : cubemaps)
 		delete c.second;
-	delete BH->diskTexture;
-	delete BH->bbTexture;
+	cubemaps.clear();
+	if (deflectionCopy.valid())
+		deflectionCopy.wait();
+	Uploads.Shutdown();
+	if (pendingDeflectionTable.valid())
+		pendingDeflectionTable.wait();
+	for (GLuint* tex : { &deflectionTex, &deflectionEndTex })
+	{
+		if (*tex == 0)
+			continue;
+		GpuMem.Release(GpuMemory::Kind::TEXTURE, *tex);
+		glDeleteTextures(1, tex);
+		*tex = 0;
+	}
+	if (tracedFBO)
+	{
+		GpuMem.Release(GpuMemory::Kind::ATTACHMENT, tracedColor);
+		GpuMem.Release(GpuMemory::Kind::TEXTURE, historyColor);
+		glDeleteTextures(1, &tracedColor);
+		glDeleteTextures(1, &historyColor);
+		glDeleteFramebuffers(1, &tracedFBO);
+		tracedFBO = tracedColor = historyColor = 0;
+	}
+	for (GLuint& tex : geodesicCache)
+	{
+		if (tex == 0)
+			continue;
+		GpuMem.Release(GpuMemory::Kind::TEXTURE, tex);
+		glDeleteTextures(1, &tex);
+		tex = 0;
+	}
+	cameraBlock.Shutdown();
+	if (blackHoleBlockBuffer)
+	{
+		GpuMem.Release(GpuMemory::Kind::BUFFER, blackHoleBlockBuffer);
+		glDeleteBuffers(1, &blackHoleBlockBuffer);
+		blackHoleBlockBuffer = 0;
+	}
+	if (marchStatsBuffer)
+	{
+		GpuMem.Release(GpuMemory::Kind::BUFFER, marchStatsBuffer);
+		glDeleteBuffers(1, &marchStatsBuffer);
+		marchStatsBuffer = 0;
+	}
+	//releasing the handles frees the textures
+	delete BH;
+	BH = nullptr;
+	Archive.Close();
 }
 
 /**
@@ -105,17 +418,24 @@ void RenderManager::RenderAll()
 }
 
 /**
- * Frees allocated memory
+ * Frees allocated memory. Shutdown already ran from main, so it does nothing here
 */
 RenderManager::~RenderManager()
 {
 	Shutdown();
+	//the black hole one is in blackHoleVariants
+	shaders.erase(ShaderType::BLACK_HOLE);
 	for (auto& s : shaders)
 	{
 		delete s.second;
 		s.second = nullptr;
 	}
 	shaders.clear();
+	for (Shader*& variant : blackHoleVariants)
+	{
+		delete variant;
+		variant = nullptr;
+	}
 }
 
 /**
@@ -125,8 +445,18 @@ void RenderManager::RenderScene()
 {
 	shaders[ShaderType::BLACK_HOLE]->Use();
 	UploadGenericUniforms();
+	UpdateDeflectionTable();
+	UpdateGeodesicCache();
+	UpdateCubemaps();
 	RenderBH();
-	RenderCubeMap();
+	RenderCoarseNodes();
+	if (frameInterleave > 1)
+		TraceBlackHole(GetInterleavedSize(window.GetWindowSize()), tracedColor, 0);
+	else
+		TraceBlackHole(window.GetWindowSize(), colorBuffers[0], colorBuffers[1]);
+	ResolveTemporal();
+	ReadMarchStats();
+	cameraBlock.Fence();
 }
 
 /**
@@ -142,7 +472,7 @@ void RenderManager::BloomFirstPass()
 	for (unsigned int i = 0; i < bloomIterations; i++)
 	{
 		glBindFramebuffer(GL_FRAMEBUFFER, bloomFBO[horizontal]);
-		shaders[ShaderType::BLOOM_FIRST]->SetUniform("horizontal", horizontal);
+		shaders[ShaderType::BLOOM_FIRST]->SetUniform(bloomHorizontal, horizontal);
 		glBindTexture(GL_TEXTURE_2D, i == 0 ? colorBuffers[1] : bloomColorBuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
 		RenderToQuadTexture();
 		horizontal = !horizontal;
@@ -168,7 +498,7 @@ void RenderManager::BloomSecondPass()
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, bloomColorBuffers[!horizontal]);
 
-	shaders[ShaderType::BLOOM_SECOND]->SetUniform("bloom", mbApplyBloom);
+	shaders[ShaderType::BLOOM_SECOND]->SetUniform(bloomEnabled, mbApplyBloom);
 	RenderToQuadTexture();
 }
 
@@ -177,6 +507,7 @@ void RenderManager::BloomSecondPass()
 */
 void RenderManager::CreateQuadTexture()
 {
+	ProfileScope scope("CreateQuadTexture");
 	float quadVertices[] = 
 	{
 		// positions        // texture Coords
@@ -191,6 +522,7 @@ void RenderManager::CreateQuadTexture()
 	glBindVertexArray(quadVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+	GpuMem.Track(GpuMemory::Kind::BUFFER, quadVBO, "Quad vertices", sizeof(quadVertices));
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(1);
@@ -198,60 +530,13 @@ void RenderManager::CreateQuadTexture()
 
 }
 
-void RenderManager::CreateSkybox()
-{
-	float skyboxVertices[] = {
-		// positions          
-		-1.0f,  1.0f, -1.0f,
-		-1.0f, -1.0f, -1.0f,
-		 1.0f, -1.0f, -1.0f,
-		 1.0f, -1.0f, -1.0f,
-		 1.0f,  1.0f, -1.0f,
-		-1.0f,  1.0f, -1.0f,
-
-		-1.0f, -1.0f,  1.0f,
-		-1.0f, -1.0f, -1.0f,
-		-1.0f,  1.0f, -1.0f,
-		-1.0f,  1.0f, -1.0f,
-		-1.0f,  1.0f,  1.0f,
-		-1.0f, -1.0f,  1.0f,
-
-		 1.0f, -1.0f, -1.0f,
-		 1.0f, -1.0f,  1.0f,
-		 1.0f,  1.0f,  1.0f,
-		 1.0f,  1.0f,  1.0f,
-		 1.0f,  1.0f, -1.0f,
-		 1.0f, -1.0f, -1.0f,
-
-		-1.0f, -1.0f,  1.0f,
-		-1.0f,  1.0f,  1.0f,
-		 1.0f,  1.0f,  1.0f,
-		 1.0f,  1.0f,  1.0f,
-		 1.0f, -1.0f,  1.0f,
-		-1.0f, -1.0f,  1.0f,
-
-		-1.0f,  1.0f, -1.0f,
-		 1.0f,  1.0f, -1.0f,
-		 1.0f,  1.0f,  1.0f,
-		 1.0f,  1.0f,  1.0f,
-		-1.0f,  1.0f,  1.0f,
-		-1.0f,  1.0f, -1.0f,
-
-		-1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f,  1.0f,
-		 1.0f, -1.0f, -1.0f,
-		 1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f,  1.0f,
-		 1.0f, -1.0f,  1.0f
-	};
-
-	glGenVertexArrays(1, &skyboxVAO);
-	glGenBuffers(1, &skyboxVBO);
-	glBindVertexArray(skyboxVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+/**
+ * Creates the vertex array of the fullscreen triangle, which has no
+ * attributes (see Fullscreen.vert)
+*/
+void RenderManager::CreateFullscreenTriangle()
+{
+	glGenVertexArrays(1, &fullscreenVAO);
 }
 
 /**
@@ -270,9 +555,12 @@ void RenderManager::RenderToQuadTexture()
 */
 void RenderManager::CreateBuffers()
 {
+	ProfileScope scope("CreateBuffers");
 	CreateHDRFrameBuffer();
 	CreateColorBuffers();
 	CreateBloomFrameBuffers();
+	CreateGeodesicCache();
+	CreateTemporalBuffers();
 }
 
 /**
@@ -280,10 +568,40 @@ void RenderManager::CreateBuffers()
 */
 void RenderManager::CreateShaders()
 {
+	ProfileScope scope("CreateShaders");
 	shaders[ShaderType::SIMPLE] = new Shader("Resources/shaders/color.vert", "Resources/shaders/color.frag");
-	shaders[ShaderType::BLACK_HOLE] = new Shader("Resources/shaders/color.vert", "Resources/shaders/BlackHole.frag");
+	//every permutation up front, so toggling them does not stall
+	for (size_t i = 0; i < blackHoleVariants.size(); ++i)
+	{
+		std::vector<std::string> defines;
+		if (i & 1)
+			defines.push_back("APPLY_LENSING");
+		if (i & 2)
+			defines.push_back("RENDER_DISK");
+		if (i & 4)
+		{
+			defines.push_back("COMPUTE_TRACER");
+			blackHoleVariants[i] = new Shader({ "Resources/shaders/BlackHole.frag", "Resources/shaders/BlackHole.comp" }, defines);
+		}
+		else
+			blackHoleVariants[i] = new Shader("Resources/shaders/Fullscreen.vert", "Resources/shaders/BlackHole.frag", defines);
+		bhUniforms = FindBlackHoleUniforms(*blackHoleVariants[i]);
+	}
+	//a permutation may compile out any of them, but not every permutation
+	for (const std::string& name : blackHoleVariants[0]->GetUniformHandleNames())
+	{
+		if (std::none_of(blackHoleVariants.begin(), blackHoleVariants.end(), [&name](const Shader* _variant) { return _variant->HasUniform(name); }))
+			std::cout << "Uniform: " << name << " not found." << std::endl;
+	}
+	shaders[ShaderType::BLACK_HOLE] = blackHoleVariants[GetBlackHoleVariant()];
 	shaders[ShaderType::BLOOM_FIRST] = new Shader("Resources/shaders/BloomFirstPass.vert", "Resources/shaders/BloomFirstPass.frag");
 	shaders[ShaderType::BLOOM_SECOND] = new Shader("Resources/shaders/BloomSecondPass.vert", "Resources/shaders/BloomSecondPass.frag");
+	shaders[ShaderType::TEMPORAL_RESOLVE] = new Shader("Resources/shaders/TemporalResolve.vert", "Resources/shaders/TemporalResolve.frag");
+	bloomHorizontal = shaders[ShaderType::BLOOM_FIRST]->FindUniform<bool>("horizontal");
+	bloomEnabled = shaders[ShaderType::BLOOM_SECOND]->FindUniform<bool>("bloom");
+	resolveInterleave = shaders[ShaderType::TEMPORAL_RESOLVE]->FindUniform<int>("temporalInterleave");
+	resolvePhase = shaders[ShaderType::TEMPORAL_RESOLVE]->FindUniform<int>("temporalPhase");
+	resolveHistoryValid = shaders[ShaderType::TEMPORAL_RESOLVE]->FindUniform<bool>("historyValid");
 	shaders[ShaderType::BLACK_HOLE]->Use();
 }
 
@@ -313,11 +631,62 @@ void RenderManager::CreateColorBuffers()
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorBuffers[i], 0);
+		GpuMem.Track(GpuMemory::Kind::ATTACHMENT, colorBuffers[i], i == 0 ? "HDR scene" : "HDR brightness",
+			GpuMemory::GetTextureBytes(window.GetWindowSize().x, window.GetWindowSize().y, HDRBytesPerTexel));
 	}
 	unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
 	glDrawBuffers(2, attachments);
 }
 
+/**
+ * Creates the images the shader keeps the rays of every pixel in
+*/
+void RenderManager::CreateGeodesicCache()
+{
+	glm::ivec2 size = window.GetWindowSize();
+	glGenTextures(static_cast<GLsizei>(geodesicImages), geodesicCache);
+	for (size_t i = 0; i < geodesicImages; ++i)
+	{
+		glBindTexture(GL_TEXTURE_2D, geodesicCache[i]);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, size.x, size.y);
+		GpuMem.Track(GpuMemory::Kind::TEXTURE, geodesicCache[i], geodesicImageNames[i],
+			GpuMemory::GetTextureBytes(size.x, size.y, 4 * sizeof(float)));
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/**
+ * Creates the target the interleaved frames are traced into (half as wide as
+ * the window, big enough for both interleaves), and the history they are
+ * reprojected from
+*/
+void RenderManager::CreateTemporalBuffers()
+{
+	glm::ivec2 size = window.GetWindowSize();
+	glGenFramebuffers(1, &tracedFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, tracedFBO);
+	glGenTextures(1, &tracedColor);
+	glBindTexture(GL_TEXTURE_2D, tracedColor);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, (size.x + 1) / 2, size.y);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tracedColor, 0);
+	GpuMem.Track(GpuMemory::Kind::ATTACHMENT, tracedColor, "Interleaved trace", GpuMemory::GetTextureBytes((size.x + 1) / 2, size.y, HDRBytesPerTexel));
+
+	//same format as the HDR scene, it is copied every frame
+	glGenTextures(1, &historyColor);
+	glBindTexture(GL_TEXTURE_2D, historyColor);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, size.x, size.y);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	GpuMem.Track(GpuMemory::Kind::TEXTURE, historyColor, "Temporal history", GpuMemory::GetTextureBytes(size.x, size.y, HDRBytesPerTexel));
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, HDRFBO);
+
+	shaders[ShaderType::TEMPORAL_RESOLVE]->SetUniform("traced", 0);
+	shaders[ShaderType::TEMPORAL_RESOLVE]->SetUniform("history", 1);
+}
+
 /**
  * Generates both frame buffers for the Bloom effect. 
 */
@@ -338,12 +707,12 @@ void RenderManager::CreateBloomFrameBuffers()
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, bloomColorBuffers[i], 0);
+		GpuMem.Track(GpuMemory::Kind::ATTACHMENT, bloomColorBuffers[i], i == 0 ? "Bloom ping" : "Bloom pong",
+			GpuMemory::GetTextureBytes(window.GetWindowSize().x, window.GetWindowSize().y, HDRBytesPerTexel));
 	}
 
 	//upload the respective uniforms
-	shaders[ShaderType::BLOOM_FIRST]->Use();
 	shaders[ShaderType::BLOOM_FIRST]->SetUniform("image", 0);
-	shaders[ShaderType::BLOOM_SECOND]->Use();
 	shaders[ShaderType::BLOOM_SECOND]->SetUniform("scene", 0);
 	shaders[ShaderType::BLOOM_SECOND]->SetUniform("blurredScene", 1);
 }
@@ -353,11 +722,9 @@ void RenderManager::CreateBloomFrameBuffers()
 */
 void RenderManager::CreateDiskTexture()
 {
-	BH->diskTexture = new Texture();
-	BH->diskTexture->dir = "Resources/Textures/starless_disk.jpg";
-	BH->diskTexture->CreateTexture();
-	shaders[ShaderType::BLACK_HOLE]->Use();
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("diskTexture", 0);
+	ProfileScope scope("CreateDiskTexture");
+	BH->diskTexture = TexManager.Load("Resources/Textures/starless_disk.jpg");
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.diskTexture, 0);
 }
 
 /**
@@ -365,20 +732,20 @@ void RenderManager::CreateDiskTexture()
 */
 void RenderManager::CreateBBTexture()
 {
-	BH->bbTexture = new Texture();
-	BH->bbTexture->dir = "Resources/Textures/noise.png";
-	BH->bbTexture->CreateTexture();
-	shaders[ShaderType::BLACK_HOLE]->Use();
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("bbodyTexture", 1);
+	ProfileScope scope("CreateBBTexture");
+	BH->bbTexture = TexManager.Load("Resources/Textures/noise.png");
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.bbodyTexture, 1);
 }
 
+/**
+ * Creates the noise texture for the accretion disk. It shares the
+ * GL texture with the Black Body one
+*/
 void RenderManager::CreateNoiseTexture()
 {
-	BH->noiseTexture = new Texture();
-	BH->noiseTexture->dir = "Resources/Textures/noise.png";
-	BH->noiseTexture->CreateTexture();
-	shaders[ShaderType::BLACK_HOLE]->Use();
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("noiseTexture", 2);
+	ProfileScope scope("CreateNoiseTexture");
+	BH->noiseTexture = TexManager.Load("Resources/Textures/noise.png");
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.noiseTexture, 2);
 }
 
 /**
@@ -386,27 +753,111 @@ void RenderManager::CreateNoiseTexture()
 */
 void RenderManager::InitializeBH()
 {
+	ProfileScope scope("InitializeBH");
 	BH = new BlackHole();
-	float aspectRatio = (float)window.GetWindowSize().x / (float)window.GetWindowSize().y;
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("halfWidth", (float)window.GetWindowSize().x / 2.0f);
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("halfHeight", (float)window.GetWindowSize().y / 2.0f);
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("aspectRatio", aspectRatio);
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("focalLength", 1.0f);
+	UploadBHUniforms();
+
+	//every permutation shares the blocks, the one with both toggles uses them all
+	const Shader* shader = blackHoleVariants.back();
+	shader->CheckUniformBlock("CameraBlock", sizeof(CameraBlock), {
+		{ "uniform_mvp", offsetof(CameraBlock, mvp) }, { "camPos", offsetof(CameraBlock, camPos) },
+		{ "aspectRatio", offsetof(CameraBlock, aspectRatio) }, { "view", offsetof(CameraBlock, view) },
+		{ "focalLength", offsetof(CameraBlock, focalLength) }, { "right", offsetof(CameraBlock, right) },
+		{ "halfWidth", offsetof(CameraBlock, halfWidth) }, { "up", offsetof(CameraBlock, up) },
+		{ "halfHeight", offsetof(CameraBlock, halfHeight) }, { "timeElapsed", offsetof(CameraBlock, timeElapsed) } });
+	shader->CheckUniformBlock("BlackHoleBlock", sizeof(BlackHoleBlock), {
+		{ "BHPos", offsetof(BlackHoleBlock, BHPos) }, { "EHRad", offsetof(BlackHoleBlock, EHRad) },
+		{ "innerDiskRad", offsetof(BlackHoleBlock, innerDiskRad) }, { "outerDiskRad", offsetof(BlackHoleBlock, outerDiskRad) },
+		{ "beamExponent", offsetof(BlackHoleBlock, beamExponent) } });
+	cameraBlock.Initialize(CAMERA_BLOCK, sizeof(CameraBlock), framesInFlight, "Camera uniforms");
+	glGenBuffers(1, &blackHoleBlockBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, blackHoleBlockBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(BlackHoleBlock), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, BLACK_HOLE_BLOCK, blackHoleBlockBuffer);
+	GpuMem.Track(GpuMemory::Kind::BUFFER, blackHoleBlockBuffer, "Black hole uniforms", sizeof(BlackHoleBlock));
+	UploadBHBlock();
+
+	//counters of the MarchStats block
+	glGenBuffers(1, &marchStatsBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, marchStatsBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(marchStats), marchStats, GL_DYNAMIC_READ);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	GpuMem.Track(GpuMemory::Kind::BUFFER, marchStatsBuffer, "March statistics", sizeof(marchStats));
+}
+
+/**
+ * Uploads the uniforms of the black hole shader that are not set every frame
+ * (the editor changes them) to the permutation in use
+*/
+void RenderManager::UploadBHUniforms()
+{
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.diskTexture, 0);
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.bbodyTexture, 1);
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.noiseTexture, 2);
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.cubeMap, 3);
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.adaptiveStep, mbAdaptiveStep);
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.stepTolerance, stepTolerance);
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.binetOrbit, mbBinetOrbit);
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.binetStep, binetStep);
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.analyticEscape, mbAnalyticEscape);
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.countSteps, mbCountSteps);
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.deflectionTable, 4);
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.deflectionEnds, 5);
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.deflectionMaxAngle, DeflectionTable::MaxAngle);
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.coarseMagnification, coarseMagnification);
+}
+
+/**
+ * Writes the black hole and disk parameters to their uniform block
+*/
+void RenderManager::UploadBHBlock()
+{
+	BlackHoleBlock block{};
+	block.BHPos = glm::vec3(0.0f);
+	block.EHRad = BH->EHRad;
+	block.innerDiskRad = BH->innerDiskRad;
+	block.outerDiskRad = BH->outerDiskRad;
+	block.beamExponent = BH->beamExp;
+	glBindBuffer(GL_UNIFORM_BUFFER, blackHoleBlockBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
 
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("BHPos", glm::vec3(0.0f));
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("EHRad", BH->EHRad);
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("innerDiskRad", BH->innerDiskRad);
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("outerDiskRad", BH->outerDiskRad);
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("beamExponent", BH->beamExp);
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("applyLensing", mbApplyLensing);
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("renderDisk", mbRenderDisk);
+/**
+ * Switches to the permutation of the black hole shader for the current
+ * toggles, and gives it the uniforms the last one had
+*/
+void RenderManager::SelectBlackHoleVariant()
+{
+	Shader* variant = blackHoleVariants[GetBlackHoleVariant()];
+	if (variant == shaders[ShaderType::BLACK_HOLE])
+		return;
+	shaders[ShaderType::BLACK_HOLE] = variant;
+	UploadBHUniforms();
 }
 
 /**
- * Renders the Black Hole (aka binds both its textures)
+ * Renders the Black Hole (aka binds both its textures, and the march statistics if counted)
 */
 void RenderManager::RenderBH()
 {
+	if (mbCountSteps)
+	{
+		GLuint zero[marchStatsCounters]{};
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, marchStatsBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), zero);
+		tracerPixels = 0;
+	}
+	//interleaved frames trace into the smaller target, see ResolveTemporal
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.temporalInterleave, frameInterleave);
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.temporalPhase, GetTemporalPhase());
+	if (frameInterleave > 1)
+	{
+		glm::ivec2 size = GetInterleavedSize(window.GetWindowSize());
+		glBindFramebuffer(GL_FRAMEBUFFER, tracedFBO);
+		glViewport(0, 0, size.x, size.y);
+	}
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, BH->diskTexture->tex);
 	glActiveTexture(GL_TEXTURE1);
@@ -416,20 +867,316 @@ void RenderManager::RenderBH()
 }
 
 /**
- * Renders the cube map
+ * Keeps the deflection table in sync with the camera distance and the event
+ * horizon. A new one is built by the workers whenever they change, the
+ * shader marches the rays until it is ready
+*/
+void RenderManager::UpdateDeflectionTable()
+{
+	bool valid = false;
+	if (mbUseDeflectionTable)
+	{
+		if (deflectionCopy.valid())
+		{
+			if (deflectionCopy.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+				UploadDeflectionTable();
+		}
+		else if (pendingDeflectionTable.valid() && pendingDeflectionTable.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+			StageDeflectionTable();
+		float camRadius = glm::length(uploadedCamera.position);
+		valid = deflectionTable.IsBuiltFor(camRadius, BH->EHRad);
+		if (!valid && !pendingDeflectionTable.valid() && !deflectionCopy.valid())
+		{
+			float EHRad = BH->EHRad;
+			pendingDeflectionTable = Workers.Submit([camRadius, EHRad]()
+			{
+				DeflectionTable table;
+				table.Build(camRadius, EHRad);
+				return table;
+			});
+		}
+	}
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.useDeflectionTable, valid);
+	if (valid)
+	{
+		glActiveTexture(GL_TEXTURE4);
+		glBindTexture(GL_TEXTURE_2D, deflectionTex);
+		glActiveTexture(GL_TEXTURE5);
+		glBindTexture(GL_TEXTURE_2D, deflectionEndTex);
+	}
+}
+
+/**
+ * Takes the table the workers built and has a worker copy it to the upload
+ * ring, so the GL thread only issues the upload. Without an upload ring it is
+ * uploaded from client memory right away, and while the ring is full the
+ * table waits in the workers' future for a later frame
 */
-void RenderManager::RenderCubeMap()
+void RenderManager::StageDeflectionTable()
+{
+	size_t tableBytes = sizeof(float) * DeflectionTable::AngleSamples * DeflectionTable::ImpactSamples;
+	size_t endBytes = sizeof(float) * 2 * DeflectionTable::ImpactSamples;
+	bool staged = Uploads.IsValid() && tableBytes + endBytes <= Uploads.GetSize();
+	if (staged && !Uploads.Allocate(tableBytes + endBytes, deflectionRegion))
+		return;
+
+	stagedDeflectionTable = pendingDeflectionTable.get();
+	if (!staged)
+	{
+		UploadDeflectionTable();
+		return;
+	}
+	deflectionCopy = Workers.Submit([tableBytes, endBytes]()
+	{
+		std::memcpy(deflectionRegion.ptr, stagedDeflectionTable.inverseRadius.data(), tableBytes);
+		std::memcpy(deflectionRegion.ptr + tableBytes, stagedDeflectionTable.ends.data(), endBytes);
+	});
+}
+
+/**
+ * Uploads the staged deflection table (from the upload ring once its copy is
+ * done), creating its textures the first time
+*/
+void RenderManager::UploadDeflectionTable()
+{
+	if (deflectionTex == 0)
+	{
+		glGenTextures(1, &deflectionTex);
+		glBindTexture(GL_TEXTURE_2D, deflectionTex);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, DeflectionTable::AngleSamples, DeflectionTable::ImpactSamples);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		GpuMem.Track(GpuMemory::Kind::TEXTURE, deflectionTex, "Deflection table",
+			GpuMemory::GetTextureBytes(DeflectionTable::AngleSamples, DeflectionTable::ImpactSamples, sizeof(float)));
+
+		//read with texelFetch
+		glGenTextures(1, &deflectionEndTex);
+		glBindTexture(GL_TEXTURE_2D, deflectionEndTex);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG32F, DeflectionTable::ImpactSamples, 1);
+		GpuMem.Track(GpuMemory::Kind::TEXTURE, deflectionEndTex, "Deflection table ends",
+			GpuMemory::GetTextureBytes(DeflectionTable::ImpactSamples, 1, 2 * sizeof(float)));
+	}
+	//with an unpack buffer bound the pixel pointers are offsets into it
+	const void* table = stagedDeflectionTable.inverseRadius.data();
+	const void* ends = stagedDeflectionTable.ends.data();
+	bool staged = deflectionCopy.valid();
+	if (staged)
+	{
+		deflectionCopy.get();
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, Uploads.GetBuffer());
+		table = reinterpret_cast<const void*>(deflectionRegion.offset);
+		ends = reinterpret_cast<const void*>(deflectionRegion.offset + sizeof(float) * DeflectionTable::AngleSamples * DeflectionTable::ImpactSamples);
+	}
+	glBindTexture(GL_TEXTURE_2D, deflectionTex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DeflectionTable::AngleSamples, DeflectionTable::ImpactSamples, GL_RED, GL_FLOAT, table);
+	glBindTexture(GL_TEXTURE_2D, deflectionEndTex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DeflectionTable::ImpactSamples, 1, GL_RG, GL_FLOAT, ends);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	if (staged)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		Uploads.Fence(deflectionRegion);
+	}
+	deflectionTable = std::move(stagedDeflectionTable);
+	std::cout << "Deflection table for a camera distance of " << deflectionTable.camRadius << " built in " << deflectionTable.buildMs << " ms" << std::endl;
+}
+
+/**
+ * Decides whether the shader traces the rays again or rotates the cached ones,
+ * and how many of them it traces. Orbiting the camera around the y axis only
+ * rotates them, anything else (its height or distance, the resolution, the
+ * black hole or how the rays are marched) needs a new trace. With temporal
+ * interleave on, the cache is only traced in full once the camera stops
+ * changing height or distance; until then the frames are interleaved.
+ * Coarse to fine frames always fill the whole cache
+*/
+void RenderManager::UpdateGeodesicCache()
+{
+	GeodesicCacheMode mode = CACHE_OFF;
+	mbCoarseFrame = coarseStep > 1;
+	frameInterleave = mbCoarseFrame ? 1 : temporalInterleave;
+	if (mbReuseGeodesics)
+	{
+		glm::vec3 pos = uploadedCamera.position;
+		GeodesicKey key;
+		key.size = window.GetWindowSize();
+		key.height = pos.y;
+		key.distance = glm::length(glm::vec2(pos.x, pos.z));
+		key.EHRad = BH->EHRad;
+		key.innerDiskRad = BH->innerDiskRad;
+		key.outerDiskRad = BH->outerDiskRad;
+		key.stepTolerance = stepTolerance;
+		key.applyLensing = mbApplyLensing;
+		key.renderDisk = mbRenderDisk;
+		key.adaptiveStep = mbAdaptiveStep;
+		key.binetOrbit = mbBinetOrbit;
+		key.binetStep = binetStep;
+		key.analyticEscape = mbAnalyticEscape;
+		key.coarseStep = mbCoarseFrame ? coarseStep : 0;
+		key.coarseMagnification = mbCoarseFrame ? coarseMagnification : 0.0f;
+		key.deflectionTable = mbUseDeflectionTable && deflectionTable.IsBuiltFor(glm::length(pos), BH->EHRad);
+
+		//the azimuth is measured like the theta of the camera
+		float azimuth = std::atan2(pos.x, pos.z);
+		bool settled = IsSameGeodesicKey(key, lastGeodesics);
+		lastGeodesics = key;
+		if (mbGeodesicsCached && IsSameGeodesicKey(key, cachedGeodesics))
+		{
+			mode = CACHE_REUSE;
+			frameInterleave = 1;
+			mbCoarseFrame = false;
+			reusedGeodesicFrames++;
+			//the images were written by the last traced frame
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.cacheRotation, azimuth - cachedAzimuth);
+		}
+		else if (frameInterleave == 1 || settled)
+		{
+			mode = CACHE_STORE;
+			frameInterleave = 1;
+			reusedGeodesicFrames = 0;
+			cachedGeodesics = key;
+			cachedAzimuth = azimuth;
+			mbGeodesicsCached = true;
+		}
+		else
+			mbGeodesicsCached = false;
+	}
+	else
+		mbGeodesicsCached = false;
+	//the refine pass of a coarse frame reads back the corners it traced
+	GLenum access = mbCoarseFrame ? GL_READ_WRITE : mode == CACHE_STORE ? GL_WRITE_ONLY : GL_READ_ONLY;
+	for (size_t i = 0; i < geodesicImages; ++i)
+		glBindImageTexture(static_cast<GLuint>(i), geodesicCache[i], 0, GL_FALSE, 0, access, GL_RGBA32F);
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.geodesicCacheMode, static_cast<int>(mode));
+}
+
+/**
+ * Traces the corners of the coarse tiles into the geodesic cache images (see
+ * COARSE_NODES in BlackHole.frag), one per pixel of the traced target. The
+ * frame is then rendered by the refine pass
+*/
+void RenderManager::RenderCoarseNodes()
+{
+	Shader* shader = shaders[ShaderType::BLACK_HOLE];
+	if (!mbCoarseFrame)
+	{
+		shader->SetUniform(bhUniforms.coarsePass, static_cast<int>(COARSE_OFF));
+		return;
+	}
+	glm::ivec2 size = window.GetWindowSize();
+	glm::ivec2 nodes = (size + coarseStep - 1) / coarseStep + 1;
+	shader->SetUniform(bhUniforms.coarseStep, coarseStep);
+	shader->SetUniform(bhUniforms.coarsePass, static_cast<int>(COARSE_NODES));
+	glBindFramebuffer(GL_FRAMEBUFFER, tracedFBO);
+	glViewport(0, 0, nodes.x, nodes.y);
+	TraceBlackHole(nodes, 0, 0);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	glBindFramebuffer(GL_FRAMEBUFFER, HDRFBO);
+	glViewport(0, 0, size.x, size.y);
+	shader->SetUniform(bhUniforms.coarsePass, static_cast<int>(COARSE_REFINE));
+}
+
+/**
+ * Fills the pixels an interleaved frame did not trace, reprojecting the last
+ * frame, and keeps the result as the history of the next one
+*/
+void RenderManager::ResolveTemporal()
+{
+	if (temporalInterleave == 1)
+	{
+		mbHistoryValid = false;
+		return;
+	}
+	glm::ivec2 size = window.GetWindowSize();
+	if (frameInterleave > 1)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, HDRFBO);
+		glViewport(0, 0, size.x, size.y);
+		Shader* resolve = shaders[ShaderType::TEMPORAL_RESOLVE];
+		resolve->Use();
+		resolve->SetUniform(resolveInterleave, frameInterleave);
+		resolve->SetUniform(resolvePhase, GetTemporalPhase());
+		//the history only lines up while the camera orbits at the same height
+		//and distance, within a pixel (see TemporalResolve.frag)
+		glm::vec3 now = uploadedCamera.position, before = historyCamera.position;
+		float elevation = std::abs(std::asin(now.y / glm::length(now)) - std::asin(before.y / glm::length(before)));
+		float zoom = std::abs(glm::length(now) - glm::length(before)) / glm::length(now);
+		float pixelAngle = 1.0f / size.x;
+		resolve->SetUniform(resolveHistoryValid, mbHistoryValid && std::max(elevation, zoom) <= pixelAngle);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, tracedColor);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, historyColor);
+		RenderToQuadTexture();
+		shaders[ShaderType::BLACK_HOLE]->Use();
+		temporalFrame++;
+	}
+	glCopyImageSubData(colorBuffers[0], GL_TEXTURE_2D, 0, 0, 0, 0, historyColor, GL_TEXTURE_2D, 0, 0, 0, 0, size.x, size.y, 1);
+	historyCamera = uploadedCamera;
+	mbHistoryValid = true;
+}
+
+/**
+ * Reads back the steps the shader marched this frame, if they are being counted.
+ * Waits for the frame to be rendered
+*/
+void RenderManager::ReadMarchStats()
+{
+	if (!mbCountSteps)
+		return;
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, marchStatsBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(marchStats), marchStats);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+/**
+ * Traces the rays of the black hole into the bound target, rasterizing a
+ * fullscreen triangle, or into the given textures with the compute tracer
+ * (the results are the same)
+ * @param _size - texels of the target, the viewport
+ * @param _scene - texture the color goes to, 0 for none
+ * @param _bright - texture the brightness goes to, 0 for none
+*/
+void RenderManager::TraceBlackHole(glm::ivec2 _size, GLuint _scene, GLuint _bright)
+{
+	tracerPixels += _size.x * _size.y;
+	if (!mbComputeTracer)
+	{
+		RenderFullscreenTriangle();
+		return;
+	}
+	Shader* shader = shaders[ShaderType::BLACK_HOLE];
+	shader->SetUniform(bhUniforms.targetSize, _size);
+	shader->SetUniform(bhUniforms.writeScene, _scene != 0);
+	shader->SetUniform(bhUniforms.writeBright, _bright != 0);
+	if (_scene)
+		glBindImageTexture(3, _scene, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+	if (_bright)
+		glBindImageTexture(4, _bright, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubemaps[currentCubeMap]->tex);
+	glDispatchCompute((_size.x + 7) / 8, (_size.y + 7) / 8, 1);
+	//the next passes sample, copy or render over the target
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+}
+
+/**
+ * Runs the bound black hole shader once per pixel of the viewport
+*/
+void RenderManager::RenderFullscreenTriangle()
 {
 	glDisable(GL_BLEND);
-	glDisable(GL_CULL_FACE);
-	glCullFace(GL_FRONT);
-	glBindVertexArray(cubemaps[currentCubeMap]->vao);
+	glDisable(GL_DEPTH_TEST);
+	glBindVertexArray(fullscreenVAO);
 	glActiveTexture(GL_TEXTURE3);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, cubemaps[currentCubeMap]->tex);
-	glDrawArrays(GL_TRIANGLES, 0, 36);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
 	glBindVertexArray(0);
-	glCullFace(GL_BACK); // set depth function back to default
-	glEnable(GL_CULL_FACE);
+	glEnable(GL_DEPTH_TEST);
 }
 
 /**
@@ -443,132 +1190,280 @@ void RenderManager::Edit()
 		if(mbApplyBloom)
 			ImGui::SliderInt("Bloom Iterations", (int*)&bloomIterations, 1, 50);
 
-		shaders[ShaderType::BLACK_HOLE]->Use();
 		//Black hole
 		if (ImGui::Checkbox("Apply Lensing", &mbApplyLensing))
-			shaders[ShaderType::BLACK_HOLE]->SetUniform("applyLensing", mbApplyLensing);
+			SelectBlackHoleVariant();
 		if (ImGui::Checkbox("Render Disk", &mbRenderDisk))
-			shaders[ShaderType::BLACK_HOLE]->SetUniform("renderDisk", mbRenderDisk);
+			SelectBlackHoleVariant();
+		if (ImGui::Checkbox("Compute tracer", &mbComputeTracer))
+			SelectBlackHoleVariant();
+		if (ImGui::Checkbox("Adaptive step", &mbAdaptiveStep))
+			shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.adaptiveStep, mbAdaptiveStep);
+		if (mbAdaptiveStep && ImGui::SliderFloat("Step tolerance", &stepTolerance, 1e-7f, 1e-2f, "%.1e", ImGuiSliderFlags_Logarithmic))
+			shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.stepTolerance, stepTolerance);
+		if (ImGui::Checkbox("Binet orbit", &mbBinetOrbit))
+			shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.binetOrbit, mbBinetOrbit);
+		if (mbBinetOrbit && ImGui::SliderFloat("Orbit step (radians)", &binetStep, 0.005f, 0.2f, "%.3f", ImGuiSliderFlags_Logarithmic))
+			shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.binetStep, binetStep);
+		ImGui::Checkbox("Deflection table", &mbUseDeflectionTable);
+		static const char* interleaveNames[] = { "Off", "1 in 2 pixels", "1 in 4 pixels" };
+		int interleave = temporalInterleave == 4 ? 2 : temporalInterleave - 1;
+		if (ImGui::Combo("Temporal interleave", &interleave, interleaveNames, static_cast<int>(std::size(interleaveNames))))
+			temporalInterleave = interleave == 2 ? 4 : interleave + 1;
+		static const int coarseSteps[] = { 0, 4, 8, 16 };
+		static const char* coarseStepNames[] = { "Off", "4 pixels", "8 pixels", "16 pixels" };
+		int coarse = static_cast<int>(std::find(std::begin(coarseSteps), std::end(coarseSteps), coarseStep) - std::begin(coarseSteps));
+		if (ImGui::Combo("Coarse to fine", &coarse, coarseStepNames, static_cast<int>(std::size(coarseStepNames))))
+			coarseStep = coarseSteps[coarse];
+		if (coarseStep && ImGui::SliderFloat("Coarse magnification", &coarseMagnification, 1.0f, 16.0f, "%.1f", ImGuiSliderFlags_Logarithmic))
+			shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.coarseMagnification, coarseMagnification);
+		ImGui::Checkbox("Reuse geodesics", &mbReuseGeodesics);
+		if (mbReuseGeodesics)
+			ImGui::Text("Geodesics reused for %u frames", reusedGeodesicFrames);
+		if (ImGui::Checkbox("Analytic escape", &mbAnalyticEscape))
+			shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.analyticEscape, mbAnalyticEscape);
+		if (ImGui::Checkbox("Count steps", &mbCountSteps))
+			shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.countSteps, mbCountSteps);
+		if (mbCountSteps)
+		{
+			float pixels = static_cast<float>(window.GetWindowSize().x * window.GetWindowSize().y);
+			ImGui::Text("Steps per pixel: %.1f, saved: %.1f", marchStats[0] / pixels, marchStats[1] / pixels);
+			ImGui::Text("Steps saved per frame: %u (%.1f%% of the rays escaped analytically)", marchStats[1], 100.0f * marchStats[2] / pixels);
+			ImGui::Text("Rays traced: %.1f%% of the pixels", 100.0f * marchStats[3] / pixels);
+			ImGui::Text("Tracer invocations: %u for %u pixels (overdraw %d)", marchStats[4], tracerPixels,
+				static_cast<int>(marchStats[4] - tracerPixels));
+		}
 
 		//Accretion Disk
 		if (ImGui::SliderFloat("Inner Disk Radius", &BH->innerDiskRad, 2.0f, BH->outerDiskRad - 2.0f))
-			shaders[ShaderType::BLACK_HOLE]->SetUniform("innerDiskRad", BH->innerDiskRad);
+			UploadBHBlock();
 		if(ImGui::SliderFloat("Outer Disk Radius", &BH->outerDiskRad, 4.0f, 20.0f))
-			shaders[ShaderType::BLACK_HOLE]->SetUniform("outerDiskRad", BH->outerDiskRad);
+			UploadBHBlock();
 		if (ImGui::SliderFloat("Beam exponent", &BH->beamExp, -15.0f, 15.0f))
-			shaders[ShaderType::BLACK_HOLE]->SetUniform("beamExponent", BH->beamExp);
+			UploadBHBlock();
 
 		//Skybox
-		if (ImGui::RadioButton("Space", currentCubeMap == CubemapType::SPACE))
-			currentCubeMap = CubemapType::SPACE;
+		if (ImGui::RadioButton("Space", requestedCubeMap == CubemapType::SPACE))
+			SelectCubemap(CubemapType::SPACE);
 
 		ImGui::SameLine();
-		if (ImGui::RadioButton("Lake", currentCubeMap == CubemapType::LAKE))
-			currentCubeMap = CubemapType::LAKE;
+		if (ImGui::RadioButton("Lake", requestedCubeMap == CubemapType::LAKE))
+			SelectCubemap(CubemapType::LAKE);
 		ImGui::SameLine();
-		if (ImGui::RadioButton("Cotton candy", currentCubeMap == CubemapType::PINK))
-			currentCubeMap = CubemapType::PINK;
+		if (ImGui::RadioButton("Cotton candy", requestedCubeMap == CubemapType::PINK))
+			SelectCubemap(CubemapType::PINK);
+		if (requestedCubeMap != currentCubeMap)
+			ImGui::Text("Loading skybox...");
+		ImGui::Checkbox("Prefetch skyboxes", &mbPrefetchSkyboxes);
+		ImGui::SliderInt("Sky stream budget (MB/frame)", &streamBudgetMB, 1, 128);
+		static const int skySizes[] = { 0, 4096, 2048, 1024, 512 };
+		static const char* skySizeNames[] = { "Full", "4096", "2048", "1024", "512" };
+		//sizes set from the command line are not in the list
+		int skySize = static_cast<int>(std::find(std::begin(skySizes), std::end(skySizes), maxSkySize) - std::begin(skySizes));
+		if (skySize == static_cast<int>(std::size(skySizes)))
+			skySize = -1;
+		if (ImGui::Combo("Max sky resolution", &skySize, skySizeNames, static_cast<int>(std::size(skySizeNames))))
+			SetMaxSkySize(skySizes[skySize]);
+
+		if (ImGui::Button("Compare with CPU reference"))
+			CompareWithCpuReference();
+
+		TexManager.Edit();
+		GpuMem.Edit();
 	}
 	ImGui::End();
 }
 
+/**
+ * Renders the last frame with the CPU tracer and compares it with the HDR
+ * scene the shader rendered. Blocks until the CPU frame is done
+*/
+void RenderManager::CompareWithCpuReference()
+{
+	TracerScene scene;
+	scene.width = window.GetWindowSize().x;
+	scene.height = window.GetWindowSize().y;
+	scene.camera = uploadedCamera;
+	scene.EHRad = BH->EHRad;
+	scene.innerDiskRad = BH->innerDiskRad;
+	scene.outerDiskRad = BH->outerDiskRad;
+	scene.beamExponent = BH->beamExp;
+	scene.timeElapsed = uploadedTime;
+	scene.applyLensing = mbApplyLensing;
+	scene.renderDisk = mbRenderDisk;
+	scene.adaptiveStep = mbAdaptiveStep;
+	scene.stepTolerance = stepTolerance;
+	scene.binetOrbit = mbBinetOrbit;
+	scene.binetStep = binetStep;
+	scene.analyticEscape = mbAnalyticEscape;
+	if (mbUseDeflectionTable && deflectionTable.IsBuiltFor(glm::length(uploadedCamera.position), BH->EHRad))
+		scene.deflectionTable = &deflectionTable;
+	scene.coarseStep = mbCoarseFrame ? coarseStep : 0;
+	scene.coarseMagnification = coarseMagnification;
+
+	std::vector<glm::vec3> gpu(static_cast<size_t>(scene.width) * scene.height);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, HDRFBO);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, scene.width, scene.height, GL_RGB, GL_FLOAT, gpu.data());
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+	CubeMap* sky = cubemaps[currentCubeMap];
+	TracerImages images;
+	images.Load(sky->dir, maxSkySize);
+	images.Bind(scene);
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<glm::vec3> cpu;
+	CpuTracer tracer(scene);
+	TileScheduler::Stats stats = tracer.Render(cpu);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	CpuTracer::MarchStats march = tracer.GetMarchStats();
+
+	CpuTracer::Comparison result = CpuTracer::CompareFrames(gpu, cpu);
+	std::cout << "CPU reference rendered in " << ms << " ms (" << stats.threads.size() << " threads, " << stats.GetEfficiency() * 100.0f << "% busy): max error " << result.maxError << ", mean error " << result.meanError
+		<< ", " << result.withinTolerance * 100.0f << "% of the pixels within " << CpuTracer::Tolerance << "/255" << std::endl;
+	std::cout << "CPU reference marched " << static_cast<double>(march.steps) / march.rays << " steps per ray, "
+		<< march.savedSteps << " steps saved by the analytic escape" << std::endl;
+	if (result.withinTolerance < CpuTracer::MinWithinTolerance)
+		std::cout << "WARNING: the shader does not match the CPU reference" << (sky->state != CubeMap::State::READY ? " (the skybox is still streaming)" : "") << std::endl;
+}
+
 /**
  * Initializes OpenGL context
 */
 void RenderManager::InitializeOpenGL() const
 {
+	ProfileScope scope("InitializeOpenGL");
 	glEnable(GL_CULL_FACE);
 	glCullFace(GL_BACK);
 	glFrontFace(GL_CCW);
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	//CPU images (and their mip levels) have tightly packed rows
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 }
 
 /**
- * Creates the Cubemap 
+ * Creates the Cubemaps. Only the one on screen is loaded, the rest are
+ * loaded when selected (or prefetched once the application is idle)
 */
 void RenderManager::CreateCubemaps()
 {
-	cubemaps[CubemapType::SPACE] = new CubeMap();
-	cubemaps[CubemapType::SPACE]->CreateCubemap("Resources/Cubemaps/Nebula");
-	cubemaps[CubemapType::LAKE] = new CubeMap();
-	cubemaps[CubemapType::LAKE]->CreateCubemap("Resources/Cubemaps/Lake");
-	cubemaps[CubemapType::PINK] = new CubeMap();
-	cubemaps[CubemapType::PINK]->CreateCubemap("Resources/Cubemaps/CottonCandy");
+	ProfileScope scope("CreateCubemaps");
+	auto start = std::chrono::high_resolution_clock::now();
 
-	shaders[ShaderType::BLACK_HOLE]->Use();
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("cubeMap", 3);
+	cubemaps[CubemapType::SPACE] = new CubeMap("Resources/Cubemaps/Nebula");
+	cubemaps[CubemapType::LAKE] = new CubeMap("Resources/Cubemaps/Lake");
+	cubemaps[CubemapType::PINK] = new CubeMap("Resources/Cubemaps/CottonCandy");
+	for (auto& c : cubemaps)
+	{
+		c.second->maxSize = maxSkySize;
+	}
+	requestedCubeMap = currentCubeMap;
+	cubemaps[currentCubeMap]->CreateCubemap();
+
+	double totalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "Cubemap created in " << totalMs << " ms using " << Workers.GetWorkerCount() << " workers" << std::endl;
+
+	shaders[ShaderType::BLACK_HOLE]->SetUniform(bhUniforms.cubeMap, 3);
 }
 
 /**
- * Uploads camera variables to the shader
+ * Frees every cubemap and loads the current one again, to apply a new
+ * resolution limit
 */
-void RenderManager::UploadGenericUniforms()
+void RenderManager::ReloadCubemaps()
 {
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("camPos", camera.GetPosition());
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("view", camera.GetView());
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("up", camera.GetUp());
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("right", camera.GetRight());
-
-	camera.Update();
-	auto view = glm::mat4(glm::mat3(camera.GetViewMat()));
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("uniform_mvp", camera.GetProj() * view);
-	timeElapsed += 0.016f;
-	shaders[ShaderType::BLACK_HOLE]->SetUniform("timeElapsed", timeElapsed / 2.0f);
+	for (auto& c : cubemaps)
+		delete c.second;
+	cubemaps.clear();
+	CreateCubemaps();
 }
 
 /**
- * Creates texture data for OpenGL using stbi
+ * Limits the resolution of the skyboxes. Call before Initialize to avoid
+ * loading them twice
+ * @param _maxSize - largest face size, 0 for full resolution
 */
-void Texture::CreateTexture()
+void RenderManager::SetMaxSkySize(int _maxSize)
 {
-	glGenTextures(1, &tex);
-	glBindTexture(GL_TEXTURE_2D, tex);
-	// set the texture wrapping/filtering options (on the currently bound texture object)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// load and generate the texture
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load(dir.c_str(), &width, &height, &nrChannels, 0);
-	if (data)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else
-		std::cout << "Failed to load texture" << std::endl;
+	maxSkySize = std::max(0, _maxSize);
+	if (!cubemaps.empty())
+		ReloadCubemaps();
+}
 
-	stbi_image_free(data);
+/**
+ * Requests a cubemap to be shown. The current one stays on screen
+ * until the new one is fully uploaded
+ * @param _type - the cubemap to show
+*/
+void RenderManager::SelectCubemap(CubemapType _type)
+{
+	requestedCubeMap = _type;
+	if (cubemaps[_type]->state == CubeMap::State::UNLOADED)
+		cubemaps[_type]->RequestFaces();
 }
 
 /**
- * Creates Cubemap data for OpenGL using stbi
+ * Streams the mip levels of the current and requested cubemaps within the
+ * per frame budget and prefetches the unused ones after startup
 */
-void CubeMap::CreateCubemap(const std::string& _dir)
+void RenderManager::UpdateCubemaps()
 {
-	vao = skyboxVAO;
-	glGenTextures(1, &tex);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, tex);
-	std::vector<std::string> faces{ "right", "left", "top", "bottom", "front", "back" };
-	//generate 1 image per face
-	int width, height, comp;
-	for (GLuint i = 0; i < faces.size(); ++i)
+	frameCount++;
+	CubeMap* requested = cubemaps[requestedCubeMap];
+	requested->CollectFaces(false);
+
+	size_t budget = static_cast<size_t>(streamBudgetMB) * 1024 * 1024;
+	budget -= std::min(budget, cubemaps[currentCubeMap]->Stream(budget));
+	if (requestedCubeMap != currentCubeMap && budget > 0)
+		requested->Stream(budget);
+	//the smallest levels are only shown early at startup, when there is no
+	//sky on screen. Later on the current one stays until the new one is ready
+	if (requestedCubeMap != currentCubeMap && requested->state == CubeMap::State::READY)
+		currentCubeMap = requestedCubeMap;
+
+	//prefetching only decodes the faces, they are not uploaded (and do not use
+	//any VRAM) until the cubemap gets selected
+	if (mbPrefetchSkyboxes && frameCount > prefetchDelay && currentCubeMap == requestedCubeMap)
 	{
-		auto path = _dir + "/" + faces[i] + ".png";
-		unsigned char* data = stbi_load(path.c_str(), &width, &height, &comp, 0);
-		if (data)
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_SRGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		else
-			std::cout << "Cubemap texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
+		for (auto& c : cubemaps)
+		{
+			if (c.second->state == CubeMap::State::UNLOADED)
+			{
+				c.second->RequestFaces();
+				break;
+			}
+		}
 	}
+}
 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+/**
+ * Uploads camera variables to the shader, all at once in the camera block
+*/
+void RenderManager::UploadGenericUniforms()
+{
+	CameraBlock block{};
+	glm::vec2 size = window.GetWindowSize();
+	block.camPos = camera.GetPosition();
+	block.view = camera.GetView();
+	block.up = camera.GetUp();
+	block.right = camera.GetRight();
+	block.aspectRatio = size.x / size.y;
+	block.focalLength = 1.0f;
+	block.halfWidth = size.x / 2.0f;
+	block.halfHeight = size.y / 2.0f;
+	uploadedCamera.position = camera.GetPosition();
+	uploadedCamera.view = camera.GetView();
+	uploadedCamera.up = camera.GetUp();
+	uploadedCamera.right = camera.GetRight();
 
+	camera.Update();
+	auto view = glm::mat4(glm::mat3(camera.GetViewMat()));
+	block.mvp = camera.GetProj() * view;
+	timeElapsed += 0.016f;
+	uploadedTime = timeElapsed / 2.0f;
+	block.timeElapsed = uploadedTime;
+	cameraBlock.Write(&block);
 }
@@ -15,17 +15,10 @@
 #include "Shader.h"
 #include "Window.h"
 #include "Camera.h"
+#include "CubeMap.h"
 
 struct BlackHole;
 
-struct CubeMap
-{
-	void CreateCubemap(const std::string& _dir);
-	GLuint cubemapFBO[6]{};
-	GLuint tex{};
-	GLuint vao{};
-};
-
 enum class PolygonMode_t { Solid, Wireframe, PointCloud };
 enum class DrawMode_t {Triangles, Points, Lines};
 
@@ -45,39 +38,63 @@ public:
 	const Camera& GetCamera() const { return camera; }
 	Camera& GetCamera() { return camera; }
 	const Window& GetWindow() const { return window; }
+	void SetMaxSkySize(int _maxSize);
 
 private:
-	enum class ShaderType {SIMPLE, BLACK_HOLE, BLOOM_FIRST, BLOOM_SECOND};
+	enum class ShaderType {SIMPLE, BLACK_HOLE, BLOOM_FIRST, BLOOM_SECOND, TEMPORAL_RESOLVE};
 	enum class CubemapType {SPACE, LAKE, PINK};
 
 	void RenderScene();
 	void BloomFirstPass();
 	void BloomSecondPass();
 	void CreateQuadTexture();
-	void CreateSkybox();
+	void CreateFullscreenTriangle();
 	void RenderToQuadTexture();
 	void CreateBuffers();
 	void CreateShaders();
 	void CreateHDRFrameBuffer();
 	void CreateColorBuffers();
 	void CreateBloomFrameBuffers();
+	void CreateGeodesicCache();
+	void CreateTemporalBuffers();
 	void CreateDiskTexture();
 	void CreateBBTexture();
 	void CreateNoiseTexture();
 	void InitializeBH();
+	void UploadBHUniforms();
+	void UploadBHBlock();
+	void SelectBlackHoleVariant();
 	void RenderBH();
-	void RenderCubeMap();
+	void ReadMarchStats();
+	void UpdateDeflectionTable();
+	void StageDeflectionTable();
+	void UploadDeflectionTable();
+	void UpdateGeodesicCache();
+	void RenderCoarseNodes();
+	void TraceBlackHole(glm::ivec2 _size, GLuint _scene, GLuint _bright);
+	void ResolveTemporal();
+	void RenderFullscreenTriangle();
 	void Edit();
 	void InitializeOpenGL() const;
 	void CreateCubemaps();
+	void ReloadCubemaps();
+	void SelectCubemap(CubemapType _type);
+	void UpdateCubemaps();
 	void UploadGenericUniforms();
+	void CompareWithCpuReference();
 
 	std::unordered_map<ShaderType, Shader*> shaders{};
+	//permutations of BlackHole.frag (and BlackHole.comp), shaders holds the one in use
+	std::array<Shader*, 8> blackHoleVariants{};
 	std::unordered_map<CubemapType, CubeMap*> cubemaps;
 	CubemapType currentCubeMap = CubemapType::SPACE;
+	//cubemap picked by the user, shown once it finishes loading
+	CubemapType requestedCubeMap = CubemapType::SPACE;
 	Window window;
 	Camera camera;
-	BlackHole* BH;
+	BlackHole* BH{};
+	//resources are alive, Shutdown frees them once
+	bool initialized = false;
 	GLuint bloomFBO[2]{};
 	GLuint bloomColorBuffers[2]{};
 	GLuint colorBuffers[2]{};
@@ -9,21 +9,65 @@
 // ----------------------------------------------------------------------------
 
 #include "../Utilities/pch.hpp"
+#include <filesystem>
 #include <sys/stat.h>
 #include <GL/glew.h>
 #include <GL/GL.h>
+#include "../Utilities/Hash.h"
+#include "../Utilities/Profiler.h"
 #include "Shader.h"
 
+namespace
+{
+    static const std::string BinaryCacheDir = "Cache/Shaders/";
+    static const uint32_t BinaryMagic = 0x4e494253; //"SBIN"
+
+    struct BinaryHeader
+    {
+        uint32_t magic = BinaryMagic;
+        uint32_t format{};
+        uint32_t length{};
+    };
+
+    std::string GetBinaryPath(uint64_t key)
+    {
+        return BinaryCacheDir + HashToString(key) + ".bin";
+    }
+
+    /**
+     * Adds a #define for each name right after the #version line of a shader
+     * @param code - the shader source
+     * @param defines - the names to define
+     * @return - the source of the permutation
+    */
+    std::string AddDefines(const std::string& code, const std::vector<std::string>& defines)
+    {
+        std::string lines;
+        for (const std::string& define : defines)
+            lines += "#define " + define + "\n";
+        size_t version = code.find("#version");
+        size_t start = version == std::string::npos ? 0 : code.find('\n', version);
+        if (start == std::string::npos)
+            return code + "\n" + lines;
+        if (version != std::string::npos)
+            start++;
+        return code.substr(0, start) + lines + code.substr(start);
+    }
+}
+
 
 /**
  * Generates a shader program. This was done following learnopengl.
  * @param vertShader - the vertexShader to create
  * @param fragShader - the fragment shader to create
+ * @param defines - names defined in both shaders, to compile a permutation
 */
-void Shader::GenerateShaderProgram(const std::string& vertShader, const std::string& fragShader)
+void Shader::GenerateShaderProgram(const std::string& vertShader, const std::string& fragShader, const std::vector<std::string>& defines)
 {
+    ProfileScope scope("Shader " + vertShader + " " + fragShader);
     vert = vertShader;
     frag = fragShader;
+    this->defines = defines;
     std::string vertexCode;
     std::string fragmentCode;
     std::ifstream vShaderFile;
@@ -44,21 +88,181 @@ void Shader::GenerateShaderProgram(const std::string& vertShader, const std::str
         vShaderFile.close();
         fShaderFile.close();
         // convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+        vertexCode = AddDefines(vShaderStream.str(), defines);
+        fragmentCode = AddDefines(fShaderStream.str(), defines);
     }
     catch (std::ifstream::failure& )
     {
         std::cout << "ERROR: Shader file not successfully read" << std::endl;
     }
-     CompileShader(vertexCode.c_str(), fragmentCode.c_str());
-   
+
+    //compiling is slow (specially the black hole), try the driver's binary first
+    uint64_t key = GetBinaryKey(vertexCode, fragmentCode);
+    bool binary = LoadProgramBinary(key);
+    scope.AddArg("binary", binary);
+    if (!binary)
+    {
+        CompileShader(vertexCode.c_str(), fragmentCode.c_str());
+        SaveProgramBinary(key);
+    }
+    ReflectUniforms();
+}
+
+/**
+ * Generates a compute program from several files, compiled one after the
+ * other as a single shader. Only the first one has the #version line
+ * @param compShaders - the files of the compute shader, in order
+ * @param defines - names defined in the shader, to compile a permutation
+*/
+void Shader::GenerateComputeProgram(const std::vector<std::string>& compShaders, const std::vector<std::string>& defines)
+{
+    std::string name;
+    for (const std::string& file : compShaders)
+        name += " " + file;
+    ProfileScope scope("Shader" + name);
+    comp = compShaders;
+    this->defines = defines;
+    std::string computeCode;
+    for (const std::string& file : compShaders)
+    {
+        std::ifstream cShaderFile(file);
+        if (!cShaderFile)
+        {
+            std::cout << "ERROR: Shader file not successfully read" << std::endl;
+            continue;
+        }
+        std::stringstream cShaderStream;
+        cShaderStream << cShaderFile.rdbuf();
+        computeCode += cShaderStream.str() + "\n";
+    }
+    computeCode = AddDefines(computeCode, defines);
+
+    uint64_t key = GetBinaryKey("", computeCode);
+    bool binary = LoadProgramBinary(key);
+    scope.AddArg("binary", binary);
+    if (!binary)
+    {
+        CompileComputeShader(computeCode.c_str());
+        SaveProgramBinary(key);
+    }
+    ReflectUniforms();
+}
+
+/**
+ * Computes the key of the program binary. Binaries are only valid for the
+ * exact same sources, driver and GPU
+ * @param vertexCode - the vertex shader source
+ * @param fragmentCode - the fragment shader source
+ * @return - the key
+*/
+uint64_t Shader::GetBinaryKey(const std::string& vertexCode, const std::string& fragmentCode) const
+{
+    uint64_t key = HashString(vertexCode);
+    key = HashString(fragmentCode, key);
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+    {
+        const char* str = reinterpret_cast<const char*>(glGetString(name));
+        key = HashString(str ? str : "", key);
+    }
+    return key;
+}
+
+/**
+ * Creates the program from the binary cache. A binary rejected by the driver
+ * is deleted so that it gets rebuilt
+ * @param key - key of the program binary
+ * @return - true if success, false otherwise
+*/
+bool Shader::LoadProgramBinary(uint64_t key)
+{
+    std::string path = GetBinaryPath(key);
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+
+    //the length is only trusted once the magic matches and the file holds it
+    uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+    BinaryHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    bool valid = file && header.magic == BinaryMagic && header.length > 0 &&
+        header.length <= fileSize - sizeof(header);
+    std::vector<char> binary(valid ? header.length : 0);
+    if (valid)
+        valid = static_cast<bool>(file.read(binary.data(), binary.size()));
+    file.close();
+
+    if (valid)
+    {
+        ID = glCreateProgram();
+        glProgramBinary(ID, header.format, binary.data(), header.length);
+        int success;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (success)
+            return true;
+        glDeleteProgram(ID);
+        ID = 0;
+    }
+
+    std::cout << "Shader binary " << path << " rejected, recompiling" << std::endl;
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    return false;
+}
+
+/**
+ * Writes the binary of the linked program to the cache
+ * @param key - key of the program binary
+*/
+void Shader::SaveProgramBinary(uint64_t key) const
+{
+    int success = 0, formats = 0, length = 0;
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (!success || formats == 0 || length == 0)
+        return;
+
+    BinaryHeader header;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(ID, length, &length, &format, binary.data());
+    header.format = format;
+    header.length = length;
+
+    //written aside and renamed, so that a failed write never leaves a
+    //truncated binary in the cache
+    std::string path = GetBinaryPath(key);
+    std::string tmpPath = path + ".tmp";
+    std::error_code ec;
+    std::filesystem::create_directories(BinaryCacheDir, ec);
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), length);
+        file.close();
+        if (!file)
+        {
+            std::cout << "Could not write shader binary " << path << std::endl;
+            std::filesystem::remove(tmpPath, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec)
+    {
+        std::cout << "Could not write shader binary " << path << ": " << ec.message() << std::endl;
+        std::filesystem::remove(tmpPath, ec);
+    }
 }
 
 void Shader::RecompileShader()
 {
     if (ID > 0) glDeleteProgram(ID);
-    GenerateShaderProgram(vert, frag);
+    if (!comp.empty())
+        GenerateComputeProgram(comp, defines);
+    else
+        GenerateShaderProgram(vert, frag, defines);
 }
 
 /**
@@ -97,6 +301,7 @@ void Shader::CompileShader(const char * vertShaderCode, const char* fragShaderCo
     ID = glCreateProgram();
     glAttachShader(ID, vertex);
     glAttachShader(ID, fragment);
+    glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(ID);  
     glGetProgramiv(ID, GL_LINK_STATUS, &success);
     if (!success)
@@ -110,6 +315,37 @@ void Shader::CompileShader(const char * vertShaderCode, const char* fragShaderCo
     glDeleteShader(fragment);
 }
 
+/**
+ * Compiles a compute shader
+ * @param compShaderCode - the compute shader code to compile
+*/
+void Shader::CompileComputeShader(const char* compShaderCode)
+{
+    unsigned compute = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(compute, 1, &compShaderCode, NULL);
+    glCompileShader(compute);
+    int success;
+    char InfoLog[1024];
+    glGetShaderiv(compute, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(compute, 1024, NULL, InfoLog);
+        std::cout << "Compile Error for compute" << std::endl;
+    }
+
+    ID = glCreateProgram();
+    glAttachShader(ID, compute);
+    glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(ID);
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(ID, 1024, NULL, InfoLog);
+        std::cout << "Link Error" << std::endl;
+    }
+    glDeleteShader(compute);
+}
+
 /**
  * Default constructor
 */
@@ -131,129 +367,200 @@ void Shader::Use()
     glUseProgram((GLint)ID);
 }
 
-Shader::Shader(const std::string& vertShader, const std::string& fragShader)
+Shader::Shader(const std::string& vertShader, const std::string& fragShader, const std::vector<std::string>& defines)
 {
-    GenerateShaderProgram(vertShader, fragShader);
+    GenerateShaderProgram(vertShader, fragShader, defines);
 }
 
+Shader::Shader(const std::vector<std::string>& compShaders, const std::vector<std::string>& defines)
+{
+    GenerateComputeProgram(compShaders, defines);
+}
 
-void Shader::SetUniform(const std::string& name, float x, float y, float z) const
+/**
+ * Reports a uniform the program does not have. Permutations compile out the
+ * uniforms their defines make unused, so they are expected to miss some
+ * @param name - the name of the uniform
+*/
+void Shader::ReportMissingUniform(const std::string& name) const
 {
-    int loc = GetUniformLocation(name);
+    if (defines.empty())
+        std::cout << "Uniform: " << name << " not found." << std::endl;
+}
 
-    if (loc >= 0)
-    {
-        glUniform3f(loc, x, y, z);
-    }
-    else
+/**
+ * Reads the location of every active uniform of the linked program, so that
+ * setting them never asks the driver. The handles found before (if it was
+ * recompiled) are pointed to the new locations
+*/
+void Shader::ReflectUniforms()
+{
+    locations.clear();
+    int count = 0;
+    glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+    const GLenum props[] = { GL_NAME_LENGTH, GL_LOCATION };
+    std::string name;
+    for (int i = 0; i < count; ++i)
     {
-        std::cout << "Uniform: " << name << " not found." << std::endl;
+        int values[2]{};
+        glGetProgramResourceiv(ID, GL_UNIFORM, i, 2, props, 2, NULL, values);
+        //members of uniform blocks have no location
+        if (values[1] < 0)
+            continue;
+        name.resize(values[0]);
+        glGetProgramResourceName(ID, GL_UNIFORM, i, values[0], NULL, &name[0]);
+        name.resize(values[0] - 1);
+        //arrays are reported as their first element
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            name.resize(name.size() - 3);
+        locations[name] = values[1];
     }
+    for (size_t i = 0; i < handleNames.size(); ++i)
+        handleLocations[i] = FindLocation(handleNames[i]);
 }
 
-void Shader::SetUniform(const std::string& name, const glm::vec2& v) const
+/**
+ * Checks the layout of a uniform block against the C++ struct that fills it,
+ * reporting every difference
+ * @param block - the name of the block
+ * @param size - size of the struct
+ * @param members - name and offset in the struct of each member
+ * @return - true if they match
+*/
+bool Shader::CheckUniformBlock(const std::string& block, size_t size, const std::vector<std::pair<std::string, size_t>>& members) const
 {
-    int loc = GetUniformLocation(name);
-
-    if (loc >= 0)
+    GLuint index = glGetProgramResourceIndex(ID, GL_UNIFORM_BLOCK, block.c_str());
+    if (index == GL_INVALID_INDEX)
     {
-        glUniform2f(loc, v.x, v.y);
+        std::cout << "Uniform block: " << block << " not found." << std::endl;
+        return false;
     }
-    else
+    const GLenum sizeProp = GL_BUFFER_DATA_SIZE;
+    int blockSize = 0;
+    glGetProgramResourceiv(ID, GL_UNIFORM_BLOCK, index, 1, &sizeProp, 1, NULL, &blockSize);
+    bool valid = static_cast<size_t>(blockSize) == size;
+    if (!valid)
+        std::cout << "Uniform block: " << block << " is " << blockSize << " bytes, its struct " << size << std::endl;
+    for (const auto& member : members)
     {
-        std::cout << "Uniform: " << name << " not found." << std::endl;
+        const GLenum offsetProp = GL_OFFSET;
+        int offset = -1;
+        GLuint memberIndex = glGetProgramResourceIndex(ID, GL_UNIFORM, member.first.c_str());
+        if (memberIndex != GL_INVALID_INDEX)
+            glGetProgramResourceiv(ID, GL_UNIFORM, memberIndex, 1, &offsetProp, 1, NULL, &offset);
+        if (offset < 0 || static_cast<size_t>(offset) != member.second)
+        {
+            std::cout << "Uniform block: " << block << "." << member.first << " at offset " << offset << ", in its struct at " << member.second << std::endl;
+            valid = false;
+        }
     }
+    return valid;
+}
+
+/**
+ * Adds a uniform to the table of handles. Unknown names are reported here,
+ * once, instead of every time they are set
+ * @param name - the name of the uniform
+ * @return - index of the handle
+*/
+int Shader::AddUniformHandle(const std::string& name)
+{
+    int location = FindLocation(name);
+    if (location < 0)
+        ReportMissingUniform(name);
+    handleNames.push_back(name);
+    handleLocations.push_back(location);
+    return static_cast<int>(handleNames.size()) - 1;
+}
+
+/**
+ * Looks up the reflected location of a uniform
+ * @param name - the name of the uniform
+ * @return - the location, -1 if it is not active
+*/
+int Shader::FindLocation(const std::string& name) const
+{
+    auto it = locations.find(name);
+    return it == locations.end() ? -1 : it->second;
+}
+
+//uniforms are set on the program directly, it does not need to be in use.
+//GL ignores location -1, so the uniforms a permutation lacks are skipped
+void Shader::Upload(int location, float val) const { glProgramUniform1f(ID, location, val); }
+void Shader::Upload(int location, int val) const { glProgramUniform1i(ID, location, val); }
+void Shader::Upload(int location, bool val) const { glProgramUniform1i(ID, location, val); }
+void Shader::Upload(int location, const glm::vec2& v) const { glProgramUniform2f(ID, location, v.x, v.y); }
+void Shader::Upload(int location, const glm::ivec2& v) const { glProgramUniform2i(ID, location, v.x, v.y); }
+void Shader::Upload(int location, const glm::vec3& v) const { glProgramUniform3f(ID, location, v.x, v.y, v.z); }
+void Shader::Upload(int location, const glm::vec4& v) const { glProgramUniform4f(ID, location, v.x, v.y, v.z, v.w); }
+void Shader::Upload(int location, const glm::mat3& m) const { glProgramUniformMatrix3fv(ID, location, 1, GL_FALSE, &m[0][0]); }
+void Shader::Upload(int location, const glm::mat4& m) const { glProgramUniformMatrix4fv(ID, location, 1, GL_FALSE, &m[0][0]); }
+
+void Shader::SetUniform(const std::string& name, float x, float y, float z) const
+{
+    this->SetUniform(name, glm::vec3(x, y, z));
+}
+
+void Shader::SetUniform(const std::string& name, const glm::vec2& v) const
+{
+    Upload(GetUniformLocation(name), v);
 }
 
 void Shader::SetUniform(const std::string& name, const glm::vec3& v) const
 {
-    this->SetUniform(name, v.x, v.y, v.z);
+    Upload(GetUniformLocation(name), v);
 }
 
 void Shader::SetUniform(const std::string& name, const glm::vec4& v) const
 {
-    int loc = GetUniformLocation(name);
-
-    if (loc >= 0)
-    {
-        glUniform4f(loc, v.x, v.y, v.z, v.w);
-    }
-    else
-    {
-        std::cout << "Uniform: " << name << " not found." << std::endl;
-    }
+    Upload(GetUniformLocation(name), v);
 }
 
 void Shader::SetUniform(const std::string& name, const glm::mat4& m) const
 {
-    int loc = GetUniformLocation(name);
-    if (loc >= 0)
-    {
-        glUniformMatrix4fv(loc, 1, GL_FALSE, &m[0][0]);
-    }
-    else
-    {
-        std::cout << "Uniform: " << name << " not found." << std::endl;
-    }
+    Upload(GetUniformLocation(name), m);
 }
 
 void Shader::SetUniform(const std::string& name, const glm::mat3& m) const
 {
-    int loc = GetUniformLocation(name);
-
-    if (loc >= 0)
-    {
-        glUniformMatrix3fv(loc, 1, GL_FALSE, &m[0][0]);
-    }
-    else
-    {
-        std::cout << "Uniform: " << name << " not found." << std::endl;
-    }
+    Upload(GetUniformLocation(name), m);
 }
 
 void Shader::SetUniform(const std::string& name, float val) const
 {
-    int loc = GetUniformLocation(name);
-
-    if (loc >= 0)
-    {
-        glUniform1f(loc, val);
-    }
-    else
-    {
-        std::cout << "Uniform: " << name << " not found." << std::endl;
-    }
+    Upload(GetUniformLocation(name), val);
 }
 
 void Shader::SetUniform(const std::string& name, int val) const
 {
-    int loc = GetUniformLocation(name);
-
-    if (loc >= 0)
-    {
-        glUniform1i(loc, val);
-    }
-    else
-    {
-        std::cout << "Uniform: " << name << " not found." << std::endl;
-    }
+    Upload(GetUniformLocation(name), val);
 }
 
 void Shader::SetUniform(const std::string& name, bool val) const
 {
-    int loc = GetUniformLocation(name);
-
-    if (loc >= 0)
-    {
-        glUniform1i(loc, val);
-    }
-    else
-    {
-        std::cout << "Uniform: " << name << " not found." << std::endl;
-    }
+    Upload(GetUniformLocation(name), val);
 }
 
+/**
+ * Looks up a uniform by name, reporting it if the program does not have it.
+ * Prefer FindUniform for the ones set every frame
+ * @param name - the name of the uniform
+ * @return - the location, -1 if it is not active
+*/
 int Shader::GetUniformLocation(const std::string& name) const
 {
-    return glGetUniformLocation(ID, name.c_str());
+    int location = FindLocation(name);
+    if (location < 0)
+        ReportMissingUniform(name);
+    return location;
+}
+
+/**
+ * Checks whether the program uses a uniform
+ * @param name - the name of the uniform
+ * @return - true if it is active
+*/
+bool Shader::HasUniform(const std::string& name) const
+{
+    return FindLocation(name) >= 0;
 }
@@ -10,19 +10,37 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <glm/glm.hpp>
 
+/**
+ * Handle of a uniform, an index in the uniform table of the shader it was
+ * found in. T is the type it is set with
+*/
+template <typename T>
+struct UniformHandle
+{
+    using Type = T;
+    int index = -1;
+};
+
 class Shader
 {
 public:
-    void GenerateShaderProgram(const std::string& vertShader, const std::string& fragShader);
+    void GenerateShaderProgram(const std::string& vertShader, const std::string& fragShader, const std::vector<std::string>& defines = {});
+    void GenerateComputeProgram(const std::vector<std::string>& compShaders, const std::vector<std::string>& defines = {});
     void RecompileShader();
     void CompileShader(const char* vertShaderCode, const char* fragShaderCode);
+    void CompileComputeShader(const char* compShaderCode);
     unsigned GetProgramID() const;
     void Use();
 
-    Shader(const std::string& vertShader, const std::string& fragShader);
+    Shader(const std::string& vertShader, const std::string& fragShader, const std::vector<std::string>& defines = {});
+    Shader(const std::vector<std::string>& compShaders, const std::vector<std::string>& defines = {});
 
     void SetUniform(const std::string& name, float x, float y, float z) const;
     void SetUniform(const std::string& name, const glm::vec2& v) const;
@@ -34,12 +52,47 @@ public:
     void SetUniform(const std::string& name, int val) const;
     void SetUniform(const std::string& name, bool val) const;
     int  GetUniformLocation(const std::string& name) const;
+    bool HasUniform(const std::string& name) const;
+
+    template <typename T>
+    UniformHandle<T> FindUniform(const std::string& name) { return { AddUniformHandle(name) }; }
+    template <typename T>
+    void SetUniform(UniformHandle<T> handle, const typename UniformHandle<T>::Type& value) const { Upload(handleLocations[handle.index], value); }
+    const std::vector<std::string>& GetUniformHandleNames() const { return handleNames; }
+    bool CheckUniformBlock(const std::string& block, size_t size, const std::vector<std::pair<std::string, size_t>>& members) const;
 
     Shader();
     ~Shader();
 
 private:
+    uint64_t GetBinaryKey(const std::string& vertexCode, const std::string& fragmentCode) const;
+    bool LoadProgramBinary(uint64_t key);
+    void SaveProgramBinary(uint64_t key) const;
+    void ReportMissingUniform(const std::string& name) const;
+    void ReflectUniforms();
+    int  AddUniformHandle(const std::string& name);
+    int  FindLocation(const std::string& name) const;
+
+    void Upload(int location, float val) const;
+    void Upload(int location, int val) const;
+    void Upload(int location, bool val) const;
+    void Upload(int location, const glm::vec2& v) const;
+    void Upload(int location, const glm::ivec2& v) const;
+    void Upload(int location, const glm::vec3& v) const;
+    void Upload(int location, const glm::vec4& v) const;
+    void Upload(int location, const glm::mat3& m) const;
+    void Upload(int location, const glm::mat4& m) const;
+
     int ID;
     std::string vert;
     std::string frag;
+    //sources of a compute program, compiled as one
+    std::vector<std::string> comp;
+    //permutation of the sources, a #define for each
+    std::vector<std::string> defines;
+    //active uniforms of the linked program, reflected once
+    std::unordered_map<std::string, int> locations;
+    //uniform table, the location of each handle (-1 if not active)
+    std::vector<std::string> handleNames;
+    std::vector<int> handleLocations;
 };
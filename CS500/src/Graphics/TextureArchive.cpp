@@ -0,0 +1,254 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the Texture Archive class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include "../Utilities/pch.hpp"
+#include "../Utilities/Hash.h"
+#include "../Utilities/ThreadPool.h"
+#include "Image.h"
+#include "TextureArchive.h"
+#include "TextureCache.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	//textures start on a cache line
+	static const uint64_t DataAlignment = 64;
+	static const char Padding[DataAlignment]{};
+
+	/**
+	 * Finds every png and jpg image under a directory
+	 * @param _root - directory to walk recursively
+	 * @param _sources - where the paths are added
+	*/
+	void FindImages(const std::string& _root, std::vector<std::string>& _sources)
+	{
+		std::error_code ec;
+		for (const auto& entry : fs::recursive_directory_iterator(_root, ec))
+		{
+			if (!entry.is_regular_file())
+				continue;
+			std::string extension = entry.path().extension().string();
+			std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+			if (extension == ".png" || extension == ".jpg" || extension == ".jpeg")
+				_sources.push_back(entry.path().generic_string());
+		}
+	}
+}
+
+/**
+ * Maps an archive, replacing the one already open
+ * @param _path - path of the archive
+ * @return - true if success, false otherwise
+*/
+bool TextureArchive::Open(const std::string& _path)
+{
+	Close();
+	if (!file.Open(_path))
+		return false;
+
+	TextureArchiveHeader header;
+	if (file.GetSize() >= sizeof(header))
+		std::memcpy(&header, file.GetData(), sizeof(header));
+	if (file.GetSize() < sizeof(header) || header.magic != TextureArchiveHeader::Magic || header.version != TextureArchiveHeader::Version ||
+		header.indexOffset % alignof(TextureArchiveEntry) != 0 ||
+		header.indexOffset + static_cast<uint64_t>(header.entryCount) * sizeof(TextureArchiveEntry) > file.GetSize())
+	{
+		std::cout << "Invalid texture archive: " << _path << std::endl;
+		file.Close();
+		return false;
+	}
+
+	index = reinterpret_cast<const TextureArchiveEntry*>(file.GetData() + header.indexOffset);
+	entryCount = header.entryCount;
+	std::cout << "Texture archive " << _path << ": " << entryCount << " textures, " << file.GetSize() / (1024 * 1024) << " MB" << std::endl;
+	return true;
+}
+
+/**
+ * Unmaps the archive. No image may still point into it
+*/
+void TextureArchive::Close()
+{
+	file.Close();
+	index = nullptr;
+	entryCount = 0;
+}
+
+/**
+ * Looks a texture up. Safe to call from worker threads
+ * @param _source - path of the source image
+ * @param _channels - channels the caller expects
+ * @param _image - image pointing into the archive
+ * @return - true if the archive has the texture, false otherwise
+*/
+bool TextureArchive::Find(const std::string& _source, int _channels, Image& _image) const
+{
+	if (!IsOpen())
+		return false;
+
+	std::string path = TextureCache::GetKey(_source);
+	uint64_t hash = HashString(path);
+	const TextureArchiveEntry* end = index + entryCount;
+	const TextureArchiveEntry* entry = std::lower_bound(index, end, hash,
+		[](const TextureArchiveEntry& _entry, uint64_t _hash) { return _entry.pathHash < _hash; });
+	for (; entry != end && entry->pathHash == hash; ++entry)
+	{
+		if (path.compare(0, TextureArchiveEntry::MaxPath, entry->path) != 0)
+			continue;
+		if (entry->channels != static_cast<uint32_t>(_channels) || entry->levelCount == 0 || entry->levelCount > TextureArchiveEntry::MaxLevels)
+			return false;
+		std::vector<size_t> offsets(entry->levelOffsets, entry->levelOffsets + entry->levelCount);
+		if (!_image.View(file.GetData(), file.GetSize(), entry->width, entry->height, entry->channels, offsets))
+			return false;
+		_image.path = _source;
+		_image.sourceHash = entry->sourceHash;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Bakes every image under some directories into an archive. The images are
+ * decoded in parallel a few at a time, and written in the order of their
+ * paths so that the same inputs always give the same archive
+ * @param _path - path of the archive
+ * @param _roots - directories to walk recursively
+ * @param _maxSize - largest width and height stored (smaller mips become level 0), 0 for no limit
+ * @return - true if every image was baked, false otherwise
+*/
+bool TextureArchive::Write(const std::string& _path, const std::vector<std::string>& _roots, int _maxSize)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<std::string> found;
+	for (const auto& root : _roots)
+		FindImages(root, found);
+	//directories are walked in no particular order, and overlapping roots
+	//find the same image under different paths
+	std::map<std::string, std::string> byKey;
+	for (const auto& source : found)
+		byKey.emplace(TextureCache::GetKey(source), source);
+	std::vector<std::string> keys, sources;
+	for (const auto& k : byKey)
+	{
+		keys.push_back(k.first);
+		sources.push_back(k.second);
+	}
+
+	//write to a temporary file first so that a half written archive is never mapped
+	std::string tmpPath = _path + ".tmp";
+	std::error_code ec;
+	if (fs::path(_path).has_parent_path())
+		fs::create_directories(fs::path(_path).parent_path(), ec);
+	std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		std::cout << "Could not write texture archive: " << tmpPath << std::endl;
+		return false;
+	}
+	TextureArchiveHeader header;
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	//the images are written in order, the workers only decode up to a few
+	//images ahead of the one being written
+	size_t inFlight = 2 * std::max(1u, Workers.GetWorkerCount());
+	std::vector<Image> images(sources.size());
+	std::vector<uint64_t> hashes(sources.size());
+	std::vector<std::future<bool>> jobs(sources.size());
+	auto submit = [&](size_t _i)
+	{
+		jobs[_i] = Workers.Submit([&, _i]()
+		{
+			const std::string& source = sources[_i];
+			Image& image = images[_i];
+			//every texture of the renderer is uploaded as RGB
+			if (keys[_i].size() >= TextureArchiveEntry::MaxPath || !image.Decode(source, 3) || !HashFile(source, hashes[_i]))
+			{
+				std::cout << "Failed to bake " << source << std::endl;
+				return false;
+			}
+			image.GenerateMips();
+			image.ClampSize(_maxSize);
+			return true;
+		});
+	};
+	for (size_t i = 0; i < std::min(inFlight, sources.size()); ++i)
+		submit(i);
+
+	bool success = true;
+	uint64_t offset = sizeof(header);
+	std::vector<TextureArchiveEntry> entries;
+	for (size_t i = 0; i < sources.size(); ++i)
+	{
+		bool decoded = jobs[i].get();
+		if (i + inFlight < sources.size())
+			submit(i + inFlight);
+		success = decoded && success;
+		if (!decoded)
+			continue;
+
+		const std::string& source = sources[i];
+		Image& image = images[i];
+		TextureArchiveEntry entry;
+		std::strncpy(entry.path, keys[i].c_str(), TextureArchiveEntry::MaxPath - 1);
+		entry.pathHash = HashString(keys[i]);
+		entry.sourceHash = hashes[i];
+		entry.width = image.width;
+		entry.height = image.height;
+		entry.channels = image.channels;
+		entry.levelCount = static_cast<uint32_t>(std::min<size_t>(image.levels.size(), TextureArchiveEntry::MaxLevels));
+
+		uint64_t aligned = (offset + DataAlignment - 1) / DataAlignment * DataAlignment;
+		out.write(Padding, static_cast<std::streamsize>(aligned - offset));
+		offset = aligned;
+		for (uint32_t l = 0; l < entry.levelCount; ++l)
+		{
+			const Image::Level& level = image.levels[l];
+			std::streamsize size = static_cast<std::streamsize>(level.width) * level.height * image.channels;
+			entry.levelOffsets[l] = offset;
+			out.write(reinterpret_cast<const char*>(level.data), size);
+			offset += size;
+		}
+		entries.push_back(entry);
+		std::cout << "Baked " << source << " (" << image.width << "x" << image.height << ", " << entry.levelCount << " levels)" << std::endl;
+		image.Free();
+	}
+
+
+	//Find binary searches the hash, entries with the same hash keep the order
+	//of their paths
+	std::stable_sort(entries.begin(), entries.end(), [](const TextureArchiveEntry& _a, const TextureArchiveEntry& _b) { return _a.pathHash < _b.pathHash; });
+	uint64_t aligned = (offset + DataAlignment - 1) / DataAlignment * DataAlignment;
+	out.write(Padding, static_cast<std::streamsize>(aligned - offset));
+	header.indexOffset = aligned;
+	header.entryCount = static_cast<uint32_t>(entries.size());
+	out.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(TextureArchiveEntry)));
+	out.seekp(0);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.close();
+	if (!out)
+	{
+		std::cout << "Could not write texture archive: " << tmpPath << std::endl;
+		return false;
+	}
+	fs::rename(tmpPath, _path, ec);
+	if (ec)
+		return false;
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "Packed " << entries.size() << "/" << sources.size() << " images into " << _path << " ("
+		<< (header.indexOffset + entries.size() * sizeof(TextureArchiveEntry)) / (1024 * 1024) << " MB) in " << ms << " ms" << std::endl;
+	return success;
+}
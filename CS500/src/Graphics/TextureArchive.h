@@ -0,0 +1,77 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the Texture Archive class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../Utilities/MappedFile.h"
+#include "../Utilities/Singleton.h"
+
+struct Image;
+
+/**
+ * Every baked texture packed in a single file. The runtime maps it once and
+ * looks textures up in its index, so loading a texture from it touches no
+ * other file. Entries are trusted as they are (the sources are not checked),
+ * the archive has to be baked again when the assets change.
+ *
+ * Layout: TextureArchiveHeader, the pixels of every texture (the levels of a
+ * texture are tightly packed, largest first) and the index, an array of
+ * TextureArchiveEntry sorted by the hash of their path. Paths are the keys of
+ * TextureCache::GetKey, relative to Resources/.
+ */
+struct TextureArchiveHeader
+{
+	static const uint32_t Magic = 0x4b415042; //"BPAK"
+	static const uint32_t Version = 3;
+
+	uint32_t magic = Magic;
+	uint32_t version = Version;
+	uint32_t entryCount{};
+	uint32_t reserved{};
+	uint64_t indexOffset{};
+};
+
+struct TextureArchiveEntry
+{
+	static const uint32_t MaxPath = 128;
+	static const uint32_t MaxLevels = 16;
+
+	//TextureCache::GetKey of the source
+	char path[MaxPath]{};
+	uint64_t pathHash{};
+	//hash of the source file, the content key of the texture manager
+	uint64_t sourceHash{};
+	uint32_t width{};
+	uint32_t height{};
+	uint32_t channels{};
+	uint32_t levelCount{};
+	uint64_t levelOffsets[MaxLevels]{};
+};
+
+class TextureArchive
+{
+	MAKE_SINGLETON(TextureArchive)
+public:
+	bool Open(const std::string& _path);
+	void Close();
+	bool IsOpen() const { return index != nullptr; }
+	bool Find(const std::string& _source, int _channels, Image& _image) const;
+
+	static bool Write(const std::string& _path, const std::vector<std::string>& _roots, int _maxSize);
+
+private:
+	MappedFile file;
+	const TextureArchiveEntry* index{};
+	uint32_t entryCount{};
+};
+
+#define Archive (TextureArchive::Instance())
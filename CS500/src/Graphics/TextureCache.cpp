@@ -0,0 +1,227 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the texture cache
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include "../Utilities/pch.hpp"
+#include "../Utilities/Hash.h"
+#include "../Utilities/MappedFile.h"
+#include "../Utilities/ThreadPool.h"
+#include "Image.h"
+#include "TextureCache.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	static const std::string CacheRoot = "Cache/";
+	static const std::string ResourcesRoot = "Resources/";
+	static const std::string CacheExtension = ".btex";
+
+	/**
+	 * Retrieves the size and last write time of a file
+	 * @param _path - the file
+	 * @param _size - its size in bytes
+	 * @param _time - its last write time, in file clock ticks
+	 * @return - true if success, false otherwise
+	*/
+	bool GetSourceInfo(const std::string& _path, uint64_t& _size, int64_t& _time)
+	{
+		std::error_code ec;
+		_size = static_cast<uint64_t>(fs::file_size(_path, ec));
+		if (ec)
+			return false;
+		_time = static_cast<int64_t>(fs::last_write_time(_path, ec).time_since_epoch().count());
+		return !ec;
+	}
+
+	/**
+	 * Checks whether a cache entry still matches its source. The hash is only
+	 * computed when the size or write time changed
+	 * @param _source - the source image
+	 * @param _header - header of the cache entry
+	 * @return - true if the entry can be used
+	*/
+	bool IsFresh(const std::string& _source, const TextureCacheHeader& _header)
+	{
+		uint64_t size = 0;
+		int64_t time = 0;
+		//the cache may be shipped without the sources
+		if (!GetSourceInfo(_source, size, time))
+			return true;
+		if (size == _header.sourceSize && time == _header.sourceTime)
+			return true;
+
+		uint64_t hash = 0;
+		return size == _header.sourceSize && HashFile(_source, hash) && hash == _header.sourceHash;
+	}
+}
+
+/**
+ * Computes the key of a source image, its path relative to Resources/. The
+ * cache and the archive both look textures up with it
+ * @param _source - path of the source image (i.e. ./Resources/Textures/noise.png)
+ * @return - the key (i.e. Textures/noise.png)
+*/
+std::string TextureCache::GetKey(const std::string& _source)
+{
+	//./Resources/..., absolute paths and the like have to give the key the
+	//runtime looks up
+	std::error_code ec;
+	fs::path relative = fs::relative(_source, ResourcesRoot, ec);
+	std::string key = relative.generic_string();
+	if (ec || relative.empty() || key.compare(0, 2, "..") == 0)
+		key = fs::path(_source).lexically_normal().generic_string();
+	return key;
+}
+
+/**
+ * Computes where the cache entry of a source image lives
+ * @param _source - path of the source image (i.e. Resources/Textures/noise.png)
+ * @return - path of the cache entry (i.e. Cache/Textures/noise.png.btex)
+*/
+std::string TextureCache::GetCachePath(const std::string& _source)
+{
+	return CacheRoot + GetKey(_source) + CacheExtension;
+}
+
+/**
+ * Maps the cache entry of a source image
+ * @param _source - path of the source image
+ * @param _channels - channels the caller expects
+ * @param _image - image pointing into the mapping
+ * @return - true if there is an up to date entry, false otherwise
+*/
+bool TextureCache::Open(const std::string& _source, int _channels, Image& _image)
+{
+	MappedFile file;
+	if (!file.Open(GetCachePath(_source)) || file.GetSize() < sizeof(TextureCacheHeader))
+		return false;
+
+	TextureCacheHeader header;
+	std::memcpy(&header, file.GetData(), sizeof(header));
+	if (header.magic != TextureCacheHeader::Magic || header.version != TextureCacheHeader::Version ||
+		header.channels != static_cast<uint32_t>(_channels) || header.levelCount == 0 ||
+		header.levelCount > TextureCacheHeader::MaxLevels)
+		return false;
+
+	if (!IsFresh(_source, header))
+	{
+		std::cout << "Texture cache is stale for " << _source << ", decoding the source" << std::endl;
+		return false;
+	}
+
+	std::vector<size_t> offsets(header.levelOffsets, header.levelOffsets + header.levelCount);
+	if (!_image.Map(std::move(file), header.width, header.height, header.channels, offsets))
+		return false;
+	_image.path = _source;
+	_image.sourceHash = header.sourceHash;
+	return true;
+}
+
+/**
+ * Writes the cache entry of a source image
+ * @param _source - path of the source image
+ * @param _image - decoded image, with its mip chain
+ * @return - true if success, false otherwise
+*/
+bool TextureCache::Write(const std::string& _source, const Image& _image)
+{
+	if (_image.levels.empty() || _image.levels.size() > TextureCacheHeader::MaxLevels)
+		return false;
+
+	TextureCacheHeader header;
+	if (!GetSourceInfo(_source, header.sourceSize, header.sourceTime) || !HashFile(_source, header.sourceHash))
+		return false;
+	header.width = _image.width;
+	header.height = _image.height;
+	header.channels = _image.channels;
+	header.levelCount = static_cast<uint32_t>(_image.levels.size());
+	uint64_t offset = sizeof(header);
+	for (uint32_t i = 0; i < header.levelCount; ++i)
+	{
+		header.levelOffsets[i] = offset;
+		offset += static_cast<uint64_t>(_image.levels[i].width) * _image.levels[i].height * _image.channels;
+	}
+
+	//write to a temporary file first so that a half written entry is never mapped
+	std::string path = GetCachePath(_source);
+	std::string tmpPath = path + ".tmp";
+	std::error_code ec;
+	fs::create_directories(fs::path(path).parent_path(), ec);
+	{
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		for (const auto& level : _image.levels)
+			file.write(reinterpret_cast<const char*>(level.data), static_cast<std::streamsize>(level.width) * level.height * _image.channels);
+		if (!file)
+			return false;
+	}
+	fs::rename(tmpPath, path, ec);
+	return !ec;
+}
+
+/**
+ * Decodes a source image, generates its mip chain and writes its cache entry
+ * @param _source - path of the source image
+ * @return - true if success, false otherwise
+*/
+bool TextureCache::Bake(const std::string& _source)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	Image image;
+	//every texture of the renderer is uploaded as RGB
+	if (!image.Decode(_source, 3))
+	{
+		std::cout << "Failed to bake " << _source << ": could not decode it" << std::endl;
+		return false;
+	}
+	image.GenerateMips();
+	if (!Write(_source, image))
+	{
+		std::cout << "Failed to bake " << _source << ": could not write " << GetCachePath(_source) << std::endl;
+		return false;
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "Baked " << _source << " (" << image.width << "x" << image.height << ", " << image.levels.size() << " levels) in " << ms << " ms" << std::endl;
+	return true;
+}
+
+/**
+ * Bakes, in parallel, every png and jpg image found under a directory
+ * @param _root - directory to walk recursively
+ * @return - amount of images baked
+*/
+unsigned TextureCache::BakeDirectory(const std::string& _root)
+{
+	std::vector<std::future<bool>> jobs;
+	std::error_code ec;
+	for (const auto& entry : fs::recursive_directory_iterator(_root, ec))
+	{
+		if (!entry.is_regular_file())
+			continue;
+		std::string extension = entry.path().extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		if (extension != ".png" && extension != ".jpg" && extension != ".jpeg")
+			continue;
+		std::string source = entry.path().generic_string();
+		jobs.push_back(Workers.Submit([source]() { return Bake(source); }));
+	}
+
+	unsigned baked = 0;
+	for (auto& job : jobs)
+		baked += job.get() ? 1 : 0;
+	std::cout << "Baked " << baked << "/" << jobs.size() << " images from " << _root << " into " << CacheRoot << std::endl;
+	return baked;
+}
@@ -0,0 +1,52 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the texture cache
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <cstdint>
+#include <string>
+
+struct Image;
+
+/**
+ * Pre-baked textures. Every source image under Resources/ can be baked into a
+ * .btex file holding the raw pixels of its whole mip chain, so that at runtime
+ * the file is just mapped and uploaded (no decoding, no glGenerateMipmap).
+ *
+ * Layout: TextureCacheHeader followed by the levels, tightly packed, largest
+ * first. Entries remember the size, write time and hash of their source; an
+ * entry whose source changed is ignored and the source is decoded instead.
+ */
+struct TextureCacheHeader
+{
+	static const uint32_t Magic = 0x58455442; //"BTEX"
+	static const uint32_t Version = 1;
+	static const uint32_t MaxLevels = 16;
+
+	uint32_t magic = Magic;
+	uint32_t version = Version;
+	uint64_t sourceHash{};
+	uint64_t sourceSize{};
+	int64_t sourceTime{};
+	uint32_t width{};
+	uint32_t height{};
+	uint32_t channels{};
+	uint32_t levelCount{};
+	uint64_t levelOffsets[MaxLevels]{};
+};
+
+namespace TextureCache
+{
+	std::string GetKey(const std::string& _source);
+	std::string GetCachePath(const std::string& _source);
+	bool Open(const std::string& _source, int _channels, Image& _image);
+	bool Write(const std::string& _source, const Image& _image);
+	bool Bake(const std::string& _source);
+	unsigned BakeDirectory(const std::string& _root);
+}
@@ -0,0 +1,161 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the Texture Manager class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include "GL/glew.h"
+#include "../Utilities/pch.hpp"
+#include "../Utilities/Hash.h"
+#include "../Utilities/Profiler.h"
+#include "../ImGui/imgui.h"
+#include "GpuMemory.h"
+#include "Image.h"
+#include "TextureManager.h"
+
+namespace
+{
+	//RGB8 textures are padded to 4 bytes per texel by the drivers
+	static const size_t BytesPerTexel = 4;
+}
+
+/**
+ * Returns a handle to the texture of a file, loading it only if neither the
+ * path nor its contents are already on the GPU
+ * @param _path - path of the image
+ * @return - the shared texture
+*/
+TextureHandle TextureManager::Load(const std::string& _path)
+{
+	if (auto texture = byPath[_path].lock())
+		return texture;
+
+	//baked textures carry the hash of their source, so only a texture that
+	//has to be decoded reads its source twice (the cache may also be shipped
+	//without the sources, then the path is the key)
+	Image image;
+	uint64_t hash = 0;
+	if (image.Open(_path, 3))
+		hash = image.sourceHash;
+	else if (!HashFile(_path, hash))
+		hash = HashString(_path);
+
+	if (auto texture = byContent[hash].lock())
+	{
+		byPath[_path] = texture;
+		return texture;
+	}
+
+	Prune();
+	auto texture = std::make_shared<Texture>();
+	texture->dir = _path;
+	texture->contentHash = hash;
+	if (image.cached || image.Decode(_path, 3))
+		texture->CreateTexture(image);
+	else
+		std::cout << "Failed to load texture" << std::endl;
+	byPath[_path] = texture;
+	byContent[hash] = texture;
+	return texture;
+}
+
+/**
+ * Adds up the GPU memory of every live texture
+ * @return - memory in bytes
+*/
+size_t TextureManager::GetTotalVRAM() const
+{
+	size_t total = 0;
+	for (const auto& t : byContent)
+		if (auto texture = t.second.lock())
+			total += texture->vramBytes;
+	return total;
+}
+
+/**
+ * Prints every live texture with its GPU memory
+*/
+void TextureManager::LogReport() const
+{
+	for (const auto& t : byContent)
+	{
+		if (auto texture = t.second.lock())
+		{
+			std::cout << "Texture " << texture->dir << " (" << texture->width << "x" << texture->height << "): "
+				<< texture->vramBytes / 1024 << " KB, " << t.second.use_count() << " handles" << std::endl;
+		}
+	}
+	std::cout << "Textures total: " << GetTotalVRAM() / 1024 << " KB" << std::endl;
+}
+
+/**
+ * Lists every live texture in the ImGui panel
+*/
+void TextureManager::Edit() const
+{
+	if (!ImGui::CollapsingHeader("Textures"))
+		return;
+	for (const auto& t : byContent)
+	{
+		if (auto texture = t.second.lock())
+		{
+			ImGui::Text("%s (%dx%d): %zu KB, %ld handles", texture->dir.c_str(), texture->width, texture->height,
+				texture->vramBytes / 1024, t.second.use_count());
+		}
+	}
+	ImGui::Text("Total: %zu KB", GetTotalVRAM() / 1024);
+}
+
+/**
+ * Removes the entries of textures that were already freed
+*/
+void TextureManager::Prune()
+{
+	for (auto it = byPath.begin(); it != byPath.end();)
+		it = it->second.expired() ? byPath.erase(it) : std::next(it);
+	for (auto it = byContent.begin(); it != byContent.end();)
+		it = it->second.expired() ? byContent.erase(it) : std::next(it);
+}
+
+/**
+ * Creates texture data for OpenGL
+ * @param _image - the pixels, with the mip chain if they come from the cache
+*/
+void Texture::CreateTexture(const Image& _image)
+{
+	ProfileScope scope("CreateTexture " + dir);
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	// set the texture wrapping/filtering options (on the currently bound texture object)
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	//uploaded from client memory, not the upload ring: the texture is used as
+	//soon as Load returns, so the copy to the ring would run on this thread too
+	for (GLint i = 0; i < static_cast<GLint>(_image.levels.size()); ++i)
+		glTexImage2D(GL_TEXTURE_2D, i, GL_RGB, _image.levels[i].width, _image.levels[i].height, 0, GL_RGB, GL_UNSIGNED_BYTE, _image.levels[i].data);
+	if (_image.levels.size() == 1)
+		glGenerateMipmap(GL_TEXTURE_2D);
+	else
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(_image.levels.size()) - 1);
+
+	width = _image.width;
+	height = _image.height;
+	vramBytes = GpuMemory::GetTextureBytes(width, height, BytesPerTexel, 0);
+	GpuMem.Track(GpuMemory::Kind::TEXTURE, tex, dir, vramBytes);
+}
+
+/**
+ * Frees the OpenGL texture
+*/
+Texture::~Texture()
+{
+	GpuMem.Release(GpuMemory::Kind::TEXTURE, tex);
+	glDeleteTextures(1, &tex);
+}
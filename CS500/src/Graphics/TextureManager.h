@@ -0,0 +1,63 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the Texture Manager class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "GL/glew.h"
+#include "../Utilities/Singleton.h"
+
+struct Image;
+
+struct Texture
+{
+	std::string dir{ "Resources/Textures/starless_disk.jpg" };
+	GLuint tex{};
+	GLuint vao{};
+	uint64_t contentHash{};
+	int width{};
+	int height{};
+	//estimated GPU memory of the whole mip chain
+	size_t vramBytes{};
+	void CreateTexture(const Image& _image);
+
+	Texture() = default;
+	Texture(const Texture&) = delete;
+	Texture& operator=(const Texture&) = delete;
+	~Texture();
+};
+
+//Shared ownership of a texture. The GL texture is freed with the last handle
+using TextureHandle = std::shared_ptr<Texture>;
+
+/**
+ * Hands out textures keyed by path and by content hash, so that requesting the
+ * same file (or two files with the same contents) twice shares one GL texture.
+ */
+class TextureManager
+{
+	MAKE_SINGLETON(TextureManager)
+public:
+	TextureHandle Load(const std::string& _path);
+	size_t GetTotalVRAM() const;
+	void LogReport() const;
+	void Edit() const;
+
+private:
+	void Prune();
+
+	//weak references, the textures are owned by the handles
+	std::unordered_map<std::string, std::weak_ptr<Texture>> byPath;
+	std::unordered_map<uint64_t, std::weak_ptr<Texture>> byContent;
+};
+
+#define TexManager (TextureManager::Instance())
@@ -0,0 +1,125 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the Uniform Ring class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include <cstring>
+#include "GL/glew.h"
+#include "../Utilities/pch.hpp"
+#include "GpuMemory.h"
+#include "UniformRing.h"
+
+namespace
+{
+	//a frame should never take this long, past it the copy is overwritten anyway
+	static const GLuint64 FenceTimeout = 1000000000;
+}
+
+/**
+ * Creates the buffer and maps it. Without persistent mapping there is a
+ * single copy, updated with glBufferSubData
+ * @param _binding - uniform block binding point of the buffer
+ * @param _size - size of the block in bytes
+ * @param _copies - frames that may be in flight
+ * @param _label - name of the buffer in the GPU memory report
+ * @return - true if the buffer is persistently mapped
+*/
+bool UniformRing::Initialize(GLuint _binding, size_t _size, unsigned _copies, const std::string& _label)
+{
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	binding = _binding;
+	size = _size;
+	stride = (_size + alignment - 1) / alignment * alignment;
+	current = 0;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	if (GLEW_ARB_buffer_storage)
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_UNIFORM_BUFFER, stride * _copies, nullptr, flags);
+		mapped = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, stride * _copies, flags));
+	}
+	if (mapped == nullptr)
+	{
+		std::cout << "Persistent mapping not supported, " << _label << " will be updated with glBufferSubData" << std::endl;
+		glDeleteBuffers(1, &buffer);
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		_copies = 1;
+		glBufferData(GL_UNIFORM_BUFFER, stride, nullptr, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, 0, size);
+	fences.assign(_copies, nullptr);
+	GpuMem.Track(GpuMemory::Kind::BUFFER, buffer, _label, stride * _copies);
+	return mapped != nullptr;
+}
+
+/**
+ * Unmaps and frees the buffer
+*/
+void UniformRing::Shutdown()
+{
+	for (GLsync& fence : fences)
+		glDeleteSync(fence);
+	fences.clear();
+	if (buffer)
+	{
+		if (mapped)
+		{
+			glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		}
+		GpuMem.Release(GpuMemory::Kind::BUFFER, buffer);
+		glDeleteBuffers(1, &buffer);
+	}
+	buffer = 0;
+	mapped = nullptr;
+}
+
+/**
+ * Writes the block of this frame into the next copy and binds it
+ * @param _data - the block, size bytes
+*/
+void UniformRing::Write(const void* _data)
+{
+	if (mapped == nullptr)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, size, _data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		return;
+	}
+	current = (current + 1) % fences.size();
+	GLsync& fence = fences[current];
+	if (fence)
+	{
+		//frames in flight ago, it is almost always signaled already
+		GLint status = GL_UNSIGNALED;
+		glGetSynciv(fence, GL_SYNC_STATUS, 1, nullptr, &status);
+		if (status != GL_SIGNALED)
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FenceTimeout);
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+	std::memcpy(mapped + current * stride, _data, size);
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, current * stride, size);
+}
+
+/**
+ * Marks the copy written this frame as read by the commands issued so far
+*/
+void UniformRing::Fence()
+{
+	if (mapped == nullptr)
+		return;
+	glDeleteSync(fences[current]);
+	fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
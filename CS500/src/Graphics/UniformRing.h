@@ -0,0 +1,39 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the Uniform Ring class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <string>
+#include <vector>
+#include "GL/glew.h"
+
+/**
+ * Uniform block rewritten every frame: a uniform buffer that stays mapped
+ * (persistent + coherent) with a copy per frame in flight. Each frame writes
+ * the next copy and binds it, the fence of the frame that used it last makes
+ * sure the GPU is done reading it (it normally is, so that never waits)
+ */
+class UniformRing
+{
+public:
+	bool Initialize(GLuint _binding, size_t _size, unsigned _copies, const std::string& _label);
+	void Shutdown();
+	void Write(const void* _data);
+	void Fence();
+
+private:
+	GLuint buffer{};
+	GLuint binding{};
+	unsigned char* mapped{};
+	size_t size{};
+	//size of a copy, aligned for glBindBufferRange
+	size_t stride{};
+	unsigned current{};
+	std::vector<GLsync> fences;
+};
@@ -0,0 +1,133 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the Upload Ring class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include "GL/glew.h"
+#include "../Utilities/pch.hpp"
+#include "GpuMemory.h"
+#include "UploadRing.h"
+
+namespace
+{
+	static const size_t RegionAlignment = 64;
+}
+
+/**
+ * Creates and persistently maps the staging buffer
+ * @param _size - size of the ring in bytes
+ * @return - true if success, false if persistent mapping is not supported
+*/
+bool UploadRing::Initialize(size_t _size)
+{
+	if (!GLEW_ARB_buffer_storage)
+	{
+		std::cout << "Persistent mapping not supported, textures will be uploaded from client memory" << std::endl;
+		return false;
+	}
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, _size, nullptr, flags);
+	mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, _size, flags));
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (mapped == nullptr)
+	{
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+		return false;
+	}
+	capacity = _size;
+	written = retired = 0;
+	GpuMem.Track(GpuMemory::Kind::BUFFER, buffer, "Upload ring", capacity);
+	return true;
+}
+
+/**
+ * Unmaps and frees the staging buffer. No region may be in use
+*/
+void UploadRing::Shutdown()
+{
+	for (auto& region : inFlight)
+		glDeleteSync(region.fence);
+	inFlight.clear();
+	if (buffer)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		GpuMem.Release(GpuMemory::Kind::BUFFER, buffer);
+		glDeleteBuffers(1, &buffer);
+	}
+	buffer = 0;
+	mapped = nullptr;
+	capacity = 0;
+}
+
+/**
+ * Reserves a region of the ring. Must be called from the GL thread
+ * @param _size - bytes needed
+ * @param _region - the reserved region
+ * @return - false if there is not enough free memory right now
+*/
+bool UploadRing::Allocate(size_t _size, Region& _region)
+{
+	if (!IsValid() || _size == 0 || _size > capacity)
+		return false;
+	Retire();
+
+	size_t size = (_size + RegionAlignment - 1) / RegionAlignment * RegionAlignment;
+	size_t offset = static_cast<size_t>(written % capacity);
+	//regions are contiguous, skip the tail of the buffer if it does not fit
+	size_t padding = offset + size > capacity ? capacity - offset : 0;
+	if (written + padding + size - retired > capacity)
+		return false;
+
+	written += padding;
+	_region.offset = padding ? 0 : offset;
+	_region.size = _size;
+	_region.ptr = mapped + _region.offset;
+	written += size;
+	_region.end = written;
+	inFlight.push_back({ written, nullptr });
+	return true;
+}
+
+/**
+ * Marks a region as read by the commands issued so far. Regions must be
+ * fenced in the same order they were allocated
+ * @param _region - the region whose upload was just issued
+*/
+void UploadRing::Fence(const Region& _region)
+{
+	for (auto& region : inFlight)
+	{
+		if (region.end == _region.end)
+		{
+			region.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			return;
+		}
+	}
+}
+
+/**
+ * Frees the regions whose uploads the GPU already finished. Never blocks
+*/
+void UploadRing::Retire()
+{
+	while (!inFlight.empty() && inFlight.front().fence)
+	{
+		GLenum status = glClientWaitSync(inFlight.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			return;
+		glDeleteSync(inFlight.front().fence);
+		retired = inFlight.front().end;
+		inFlight.pop_front();
+	}
+}
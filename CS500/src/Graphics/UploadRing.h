@@ -0,0 +1,64 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the Upload Ring class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <cstdint>
+#include <deque>
+#include "GL/glew.h"
+#include "../Utilities/Singleton.h"
+
+/**
+ * Staging memory for texture uploads: a pixel unpack buffer that stays mapped
+ * (persistent + coherent) for the whole run, handed out as a ring. Regions are
+ * allocated on the GL thread, filled from any thread and, once the upload that
+ * reads them is issued, fenced so that they are only reused when the GPU is
+ * done with them. Nothing ever waits on a fence, a full ring just fails to
+ * allocate until older regions retire.
+ */
+class UploadRing
+{
+	MAKE_SINGLETON(UploadRing)
+public:
+	struct Region
+	{
+		//offset inside the buffer, to be used as the pixel pointer of the upload
+		size_t offset{};
+		size_t size{};
+		unsigned char* ptr{};
+		uint64_t end{};
+	};
+
+	bool Initialize(size_t _size);
+	void Shutdown();
+	bool IsValid() const { return mapped != nullptr; }
+	size_t GetSize() const { return capacity; }
+	GLuint GetBuffer() const { return buffer; }
+
+	bool Allocate(size_t _size, Region& _region);
+	void Fence(const Region& _region);
+	void Retire();
+
+private:
+	struct InFlight
+	{
+		uint64_t end{};
+		GLsync fence{};
+	};
+
+	GLuint buffer{};
+	unsigned char* mapped{};
+	size_t capacity{};
+	//monotonic byte counters, their difference is the memory in use
+	uint64_t written{};
+	uint64_t retired{};
+	std::deque<InFlight> inFlight;
+};
+
+#define Uploads (UploadRing::Instance())
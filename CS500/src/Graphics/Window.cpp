@@ -9,6 +9,7 @@
 // ----------------------------------------------------------------------------
 
 #include <GL/glew.h>
+#include "../Utilities/Profiler.h"
 #include "Window.h"
 
 /**
@@ -19,6 +20,7 @@
 */
 bool Window::GenerateWindow(std::string name, glm::ivec2 window_size)
 {
+	ProfileScope scope("GenerateWindow");
 	if (SDL_Init(SDL_INIT_VIDEO) < 0)
 	{
 		std::cout << "Could not initialize SDL: " << SDL_GetError() << std::endl;
@@ -50,7 +52,12 @@ bool Window::GenerateWindow(std::string name, glm::ivec2 window_size)
 	}
 
 	glewExperimental = true;
-	if (glewInit() != GLEW_OK)
+	GLenum glewStatus;
+	{
+		ProfileScope glewScope("glewInit");
+		glewStatus = glewInit();
+	}
+	if (glewStatus != GLEW_OK)
 	{
 		std::cout << "GLEW Error: Failed to init" << std::endl;
 		DestroyWindow();
@@ -0,0 +1,1250 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the CPU Tracer class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include "../Utilities/pch.hpp"
+#include "../Utilities/ThreadPool.h"
+#include "CpuTracer.h"
+
+namespace
+{
+	//constants of BlackHole.frag
+	static const float BHTemperature = 10000.0f;
+	static const float STEP_SIZE = 0.1f;
+	static const float PI = 3.14159f;
+	static const int MaxSteps = 300;
+	static const float MarchLength = 300.0f * STEP_SIZE;
+	static const float MinStep = 0.001f;
+	static const float StepDistanceRatio = 0.5f;
+	static const float EscapeRadius = 3.0f;
+	static const float EscapeMargin = 2.0f;
+	static const float BinetMaxAngle = 4.0f * PI;
+
+	/**
+	 * Converts an 8 bit sRGB value to linear, as GL_SRGB8 textures do
+	 * @param _value - the sRGB value
+	 * @return - the linear value
+	*/
+	float SRGBToLinear(unsigned char _value)
+	{
+		static const std::array<float, 256> table = []()
+		{
+			std::array<float, 256> t{};
+			for (int i = 0; i < 256; ++i)
+			{
+				float c = i / 255.0f;
+				t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			return t;
+		}();
+		return table[_value];
+	}
+
+	/**
+	 * Fetches a texel
+	 * @param _level - mip level of an RGB image
+	 * @param _x - column
+	 * @param _y - row
+	 * @param _srgb - whether the image is sRGB encoded
+	 * @return - the texel
+	*/
+	glm::vec3 Fetch(const Image::Level& _level, int _x, int _y, bool _srgb)
+	{
+		const unsigned char* p = _level.data + (static_cast<size_t>(_y) * _level.width + _x) * 3;
+		if (_srgb)
+			return { SRGBToLinear(p[0]), SRGBToLinear(p[1]), SRGBToLinear(p[2]) };
+		return glm::vec3(p[0], p[1], p[2]) / 255.0f;
+	}
+
+	/**
+	 * Samples a mip level with bilinear filtering, like GL_LINEAR
+	 * @param _level - mip level of an RGB image
+	 * @param _uv - texture coordinates
+	 * @param _repeat - GL_REPEAT if true, GL_CLAMP_TO_EDGE otherwise
+	 * @param _srgb - whether the image is sRGB encoded
+	 * @return - the filtered color
+	*/
+	glm::vec3 SampleBilinear(const Image::Level& _level, glm::vec2 _uv, bool _repeat, bool _srgb)
+	{
+		float x = _uv.x * _level.width - 0.5f;
+		float y = _uv.y * _level.height - 0.5f;
+		float fx = std::floor(x), fy = std::floor(y);
+		float ax = x - fx, ay = y - fy;
+		int x0 = static_cast<int>(fx), y0 = static_cast<int>(fy);
+		int x1 = x0 + 1, y1 = y0 + 1;
+		auto wrap = [_repeat](int _i, int _size)
+		{
+			if (_repeat)
+				return ((_i % _size) + _size) % _size;
+			return std::clamp(_i, 0, _size - 1);
+		};
+		x0 = wrap(x0, _level.width);
+		x1 = wrap(x1, _level.width);
+		y0 = wrap(y0, _level.height);
+		y1 = wrap(y1, _level.height);
+		glm::vec3 bottom = glm::mix(Fetch(_level, x0, y0, _srgb), Fetch(_level, x1, y0, _srgb), ax);
+		glm::vec3 top = glm::mix(Fetch(_level, x0, y1, _srgb), Fetch(_level, x1, y1, _srgb), ax);
+		return glm::mix(bottom, top, ay);
+	}
+
+	/**
+	 * Samples level 0 of a 2D texture (they are all sampled with GL_LINEAR)
+	 * @param _image - RGB image
+	 * @param _uv - texture coordinates
+	 * @return - the filtered color
+	*/
+	glm::vec3 Sample(const Image* _image, glm::vec2 _uv)
+	{
+		if (_image == nullptr || _image->levels.empty())
+			return glm::vec3(0.0f);
+		return SampleBilinear(_image->levels[0], _uv, true, false);
+	}
+
+	/**
+	 * Picks the face of a cubemap and the coordinates on it (GL spec table)
+	 * @param _dir - direction to sample
+	 * @param _ma - absolute value of the major axis
+	 * @param _sc - s coordinate, before the division by ma
+	 * @param _tc - t coordinate, before the division by ma
+	 * @return - index of the face
+	*/
+	int GetCubeFace(const glm::vec3& _dir, float& _ma, float& _sc, float& _tc)
+	{
+		glm::vec3 a = glm::abs(_dir);
+		if (a.x >= a.y && a.x >= a.z)
+		{
+			_sc = _dir.x >= 0.0f ? -_dir.z : _dir.z;
+			_tc = -_dir.y;
+			_ma = a.x;
+			return _dir.x >= 0.0f ? 0 : 1;
+		}
+		if (a.y >= a.z)
+		{
+			_sc = _dir.x;
+			_tc = _dir.y >= 0.0f ? _dir.z : -_dir.z;
+			_ma = a.y;
+			return _dir.y >= 0.0f ? 2 : 3;
+		}
+		_sc = _dir.z >= 0.0f ? _dir.x : -_dir.x;
+		_tc = -_dir.y;
+		_ma = a.z;
+		return _dir.z >= 0.0f ? 4 : 5;
+	}
+
+	/**
+	 * Projects a direction on a given face of a cubemap
+	 * @param _dir - the direction
+	 * @param _face - index of the face
+	 * @return - coordinates on the face, in [0, 1] if the direction hits it
+	*/
+	glm::vec2 ProjectOnFace(const glm::vec3& _dir, int _face)
+	{
+		float sc = 0.0f, tc = 0.0f, ma = 0.0f;
+		switch (_face)
+		{
+		case 0: sc = -_dir.z; tc = -_dir.y; ma = _dir.x; break;
+		case 1: sc = _dir.z; tc = -_dir.y; ma = -_dir.x; break;
+		case 2: sc = _dir.x; tc = _dir.z; ma = _dir.y; break;
+		case 3: sc = _dir.x; tc = -_dir.z; ma = -_dir.y; break;
+		case 4: sc = _dir.x; tc = -_dir.y; ma = _dir.z; break;
+		default: sc = -_dir.x; tc = -_dir.y; ma = -_dir.z; break;
+		}
+		if (ma <= 0.0f)
+			return glm::vec2(0.5f);
+		return glm::vec2((sc / ma + 1.0f) / 2.0f, (tc / ma + 1.0f) / 2.0f);
+	}
+
+	//Given a point in cartesian coordinates, converts it to spherical
+	glm::vec3 CartesianToSpherical(const glm::vec3& p)
+	{
+		float rho = std::sqrt((p.x * p.x) + (p.y * p.y) + (p.z * p.z));
+		float theta = std::atan2(p.z, p.x);
+		float phi = std::asin(p.y / rho);
+		return glm::vec3(rho, theta, phi);
+	}
+
+	//Checks whether a ray with origin = pos, direction = dir intersects a plane with point = pt, n = normal
+	float IntersectionRayPlane(const glm::vec3& pos, const glm::vec3& dir, const glm::vec3& pt, const glm::vec3& normal)
+	{
+		float num = glm::dot(pos - pt, normal);
+		float den = glm::dot(dir, normal);
+		if (den == 0.0f)
+			return -1.0f;
+		float t = -num / den;
+		if (t < 0.0f)
+			return -1.0f;
+		return t;
+	}
+
+	//Finds where a step crosses the plane y = _planeY, on the cubic Hermite
+	//curve through both ends of the step, see BlackHole.frag
+	glm::vec3 FindDiskCrossing(float _planeY, float _h, const glm::vec3& _pos0, const glm::vec3& _dir0, const glm::vec3& _pos1, const glm::vec3& _dir1)
+	{
+		auto hermite = [&](float _s)
+		{
+			float s2 = _s * _s, s3 = s2 * _s;
+			return (2.0f * s3 - 3.0f * s2 + 1.0f) * _pos0 + (s3 - 2.0f * s2 + _s) * _h * _dir0
+				+ (3.0f * s2 - 2.0f * s3) * _pos1 + (s3 - s2) * _h * _dir1;
+		};
+		float y0 = _pos0.y - _planeY;
+		float lo = 0.0f, hi = 1.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			float mid = (lo + hi) * 0.5f;
+			if ((hermite(mid).y - _planeY) * y0 > 0.0f)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		return hermite((lo + hi) * 0.5f);
+	}
+
+	//Applies the Schwarzschild Geodesic as the "magic potential"
+	void SchwarzschildGeodesic(float h2, const glm::vec3& BHPos, const glm::vec3& pos, const glm::vec3& dir, glm::vec3& dx, glm::vec3& dv)
+	{
+		glm::vec3 rayToBH = pos - BHPos;
+		float r2 = glm::dot(rayToBH, rayToBH);
+		float r5 = std::pow(r2, 2.5f);
+		dx = dir;
+		dv = -1.5f * h2 * pos / r5;
+	}
+
+	//Deflection a ray still gets on its way to infinity, in the weak field
+	//limit, see GetRemainingDeflection in BlackHole.frag
+	glm::vec3 GetRemainingDeflection(float _h2, const glm::vec3& _rayToBH, const glm::vec3& _dir)
+	{
+		float r2 = glm::dot(_rayToBH, _rayToBH);
+		float v = glm::length(_dir);
+		glm::vec3 u = _dir / v;
+		glm::vec3 perp = _rayToBH - glm::dot(_rayToBH, u) * u;
+		float q = std::min(glm::dot(perp, perp) / r2, 1.0f);
+		float f = (3.0f + q) / (2.0f + std::sqrt(1.0f - q) * (2.0f + q));
+		return (-0.5f * _h2 / (v * r2 * r2)) * (std::sqrt(r2) * u + f * perp);
+	}
+
+	//Bends a ray that reached the end of the march heading away from the black
+	//hole the rest of the way, see FinishEscape in BlackHole.frag
+	void FinishEscape(float _h2, const glm::vec3& _BHPos, const glm::vec3& _pos, glm::vec3& _dir)
+	{
+		glm::vec3 rayToBH = _pos - _BHPos;
+		if (glm::dot(rayToBH, _dir) > 0.0f)
+			_dir += GetRemainingDeflection(_h2, rayToBH, _dir);
+	}
+
+	//Fewest adaptive steps that could cover the rest of the march, see BlackHole.frag
+	int GetAdaptiveStepsLeft(float _remaining, float _r, int _iterationsLeft)
+	{
+		int steps = 0;
+		float reach = _r;
+		while (reach - _r < _remaining && steps < _iterationsLeft)
+		{
+			reach *= 1.0f + StepDistanceRatio;
+			steps++;
+		}
+		return steps;
+	}
+}
+
+const float CpuTracer::MinWithinTolerance = 0.99f;
+
+/**
+ * Loads the textures of the black hole and the faces of a skybox (with their
+ * mip chain) in the workers
+ * @param _skyDir - directory of the skybox faces
+ * @param _maxSkySize - largest face size, 0 for full resolution
+ * @return - true if every image was loaded
+*/
+bool TracerImages::Load(const std::string& _skyDir, int _maxSkySize)
+{
+	//same order as the cubemap faces
+	static const char* names[6] = { "right", "left", "top", "bottom", "front", "back" };
+	std::array<std::future<Image>, 6> faces;
+	for (unsigned i = 0; i < faces.size(); ++i)
+	{
+		std::string path = _skyDir + "/" + names[i] + ".png";
+		faces[i] = Workers.Submit([path, _maxSkySize]()
+		{
+			Image image;
+			if (image.Load(path, 3))
+			{
+				image.GenerateMips();
+				image.ClampSize(_maxSkySize);
+			}
+			return image;
+		});
+	}
+	bool loaded = disk.Load("Resources/Textures/starless_disk.jpg", 3);
+	loaded = noise.Load("Resources/Textures/noise.png", 3) && loaded;
+	for (unsigned i = 0; i < faces.size(); ++i)
+	{
+		sky[i] = faces[i].get();
+		loaded = sky[i].data != nullptr && loaded;
+	}
+	return loaded;
+}
+
+/**
+ * Points the textures of a scene to these images, bound like the renderer does
+ * @param _scene - the scene
+*/
+void TracerImages::Bind(TracerScene& _scene) const
+{
+	_scene.diskTexture = &disk;
+	_scene.bbTexture = &noise;
+	_scene.noiseTexture = &noise;
+	for (unsigned i = 0; i < sky.size(); ++i)
+		_scene.sky[i] = &sky[i];
+}
+
+/**
+ * Makes room for a number of rays
+ * @param _count - number of rays
+*/
+void RayBatch::Resize(size_t _count)
+{
+	for (int c = 0; c < 3; ++c)
+	{
+		pos[c].resize(_count);
+		dir[c].resize(_count);
+		crossings[c].resize(_count * PacketKernel::MaxCrossings);
+	}
+	escaped.resize(_count);
+	steps.resize(_count);
+	savedSteps.resize(_count);
+	crossingCount.resize(_count);
+}
+
+/**
+ * Points the arrays of the packet kernel to this storage
+ * @return - the rays
+*/
+PacketKernel::Rays RayBatch::GetRays()
+{
+	PacketKernel::Rays rays;
+	rays.count = escaped.size();
+	for (int c = 0; c < 3; ++c)
+	{
+		rays.pos[c] = pos[c].data();
+		rays.dir[c] = dir[c].data();
+		rays.crossings[c] = crossings[c].data();
+	}
+	rays.escaped = escaped.data();
+	rays.steps = steps.data();
+	rays.savedSteps = savedSteps.data();
+	rays.crossingCount = crossingCount.data();
+	return rays;
+}
+
+/**
+ * Computes the camera vectors of Camera::Update
+ * @param _theta - azimuth
+ * @param _phi - elevation
+ * @param _radius - distance to the origin
+ * @return - the camera
+*/
+TracerCamera TracerCamera::Orbit(float _theta, float _phi, float _radius)
+{
+	TracerCamera camera;
+	camera.position.x = std::sin(_theta) * std::cos(_phi) * _radius;
+	camera.position.y = std::sin(_phi) * _radius;
+	camera.position.z = std::cos(_theta) * std::cos(_phi) * _radius;
+	camera.view = glm::normalize(-camera.position);
+	camera.right = glm::normalize(glm::cross(camera.view, { 0, 1, 0 }));
+	camera.up = -glm::normalize(glm::cross(camera.right, camera.view));
+	return camera;
+}
+
+/**
+ * Traces the ray of a pixel, like the main function of BlackHole.frag. The
+ * skybox is sampled from its largest level
+ * @param _fragX - x of gl_FragCoord (pixel centers are at .5)
+ * @param _fragY - y of gl_FragCoord, from the bottom of the image
+ * @return - the HDR color (before bloom and tone mapping)
+*/
+glm::vec3 CpuTracer::TracePixel(float _fragX, float _fragY) const
+{
+	glm::vec3 color, dir;
+	if (TraceRay(_fragX, _fragY, color, dir))
+		color += SampleSky(dir, glm::vec3(0.0f), glm::vec3(0.0f));
+	return color;
+}
+
+/**
+ * Traces the four rays of a 2x2 quad, picking the skybox mip level from the
+ * differences between their directions, like the GPU derivatives do
+ * @param _x - column of the bottom left pixel (even)
+ * @param _y - row of the bottom left pixel (even)
+ * @param _colors - HDR colors: bottom left, bottom right, top left, top right
+*/
+void CpuTracer::TraceQuad(int _x, int _y, glm::vec3 _colors[4]) const
+{
+	glm::vec3 dirs[4];
+	bool escaped[4];
+	for (int i = 0; i < 4; ++i)
+		escaped[i] = TraceRay(_x + (i & 1) + 0.5f, _y + (i >> 1) + 0.5f, _colors[i], dirs[i]);
+
+	//derivatives are taken once per quad (coarse), from the bottom left pixel
+	glm::vec3 ddx = dirs[1] - dirs[0];
+	glm::vec3 ddy = dirs[2] - dirs[0];
+	for (int i = 0; i < 4; ++i)
+		if (escaped[i])
+			_colors[i] += SampleSky(dirs[i], ddx, ddy);
+}
+
+/**
+ * Renders the whole image in tiles, using every worker
+ * @param _hdr - the HDR colors, row by row from the bottom (like glReadPixels)
+ * @return - the load balance of the threads
+*/
+TileScheduler::Stats CpuTracer::Render(std::vector<glm::vec3>& _hdr) const
+{
+	_hdr.resize(static_cast<size_t>(scene.width) * scene.height);
+	if (scene.coarseStep > 1)
+		return RenderCoarseToFine(_hdr);
+	//tiles have an even size, so quads never straddle two of them
+	return TileScheduler::Run(scene.width, scene.height, [&](const Tile& _tile)
+	{
+		MarchTile(_tile, _hdr);
+	});
+}
+
+/**
+ * Computes the origin and direction of the ray of a pixel, like GenerateRay in BlackHole.frag
+ * @param _fragX - x of gl_FragCoord (pixel centers are at .5)
+ * @param _fragY - y of gl_FragCoord, from the bottom of the image
+ * @param _pos - origin of the ray
+ * @param _dir - direction of the ray
+*/
+void CpuTracer::GenerateRay(float _fragX, float _fragY, glm::vec3& _pos, glm::vec3& _dir) const
+{
+	float halfWidth = scene.width / 2.0f;
+	float halfHeight = scene.height / 2.0f;
+	float aspectRatio = static_cast<float>(scene.width) / scene.height;
+	glm::vec2 NDC;
+	NDC.x = (_fragX - halfWidth) / halfWidth;
+	NDC.y = -(_fragY - halfHeight) / halfHeight;
+	glm::vec3 pixelWorld = scene.camera.position + scene.focalLength * scene.camera.view;
+	pixelWorld += NDC.x * scene.camera.right / 2.0f + NDC.y * scene.camera.up / (2.0f * aspectRatio);
+	_pos = scene.camera.position;
+	_dir = -glm::normalize(scene.camera.position - pixelWorld);
+}
+
+/**
+ * Returns the black hole, as the packet kernel takes it
+ * @return - the parameters of the march
+*/
+PacketKernel::Params CpuTracer::GetPacketParams() const
+{
+	PacketKernel::Params params;
+	for (int c = 0; c < 3; ++c)
+		params.BHPos[c] = scene.BHPos[c];
+	params.EHRad = scene.EHRad;
+	params.innerDiskRad = scene.innerDiskRad;
+	params.outerDiskRad = scene.outerDiskRad;
+	params.stepSize = STEP_SIZE;
+	params.maxSteps = MaxSteps;
+	params.applyLensing = scene.applyLensing;
+	params.renderDisk = scene.renderDisk;
+	params.adaptive = scene.adaptiveStep;
+	params.tolerance = scene.stepTolerance;
+	params.marchLength = MarchLength;
+	params.minStep = MinStep;
+	params.stepDistanceRatio = StepDistanceRatio;
+	params.analyticEscape = scene.analyticEscape;
+	params.escapeRadius = EscapeRadius * scene.EHRad;
+	if (scene.renderDisk)
+		params.escapeRadius = std::max(params.escapeRadius, scene.outerDiskRad);
+	//the error is about the square of the bending, which must stay below a pixel
+	params.escapeBend2 = 1.0f / (scene.width * scene.focalLength) / EscapeMargin;
+	return params;
+}
+
+/**
+ * Returns the steps of the rays marched so far
+ * @return - the totals
+*/
+CpuTracer::MarchStats CpuTracer::GetMarchStats() const
+{
+	MarchStats stats;
+	stats.rays = marchedRays.load();
+	stats.steps = marchedSteps.load();
+	stats.savedSteps = savedSteps.load();
+	stats.analyticEscapes = analyticEscapes.load();
+	return stats;
+}
+
+/**
+ * Adds to the steps of the rays marched so far
+ * @param _stats - steps of some rays
+*/
+void CpuTracer::CountSteps(const MarchStats& _stats) const
+{
+	marchedRays.fetch_add(_stats.rays, std::memory_order_relaxed);
+	marchedSteps.fetch_add(_stats.steps, std::memory_order_relaxed);
+	savedSteps.fetch_add(_stats.savedSteps, std::memory_order_relaxed);
+	analyticEscapes.fetch_add(_stats.analyticEscapes, std::memory_order_relaxed);
+}
+
+/**
+ * Renders a tile, in packets unless the scene marches the rays one by one
+ * @param _tile - the pixels to render
+ * @param _hdr - the HDR colors of the image
+*/
+void CpuTracer::MarchTile(const Tile& _tile, std::vector<glm::vec3>& _hdr) const
+{
+	if (UsesPackets())
+		RenderTilePackets(_tile, _hdr);
+	else
+		RenderTile(_tile, _hdr);
+}
+
+/**
+ * Checks whether the rays are marched with the packet kernel, which has no
+ * Binet orbits nor deflection table
+ * @return - whether they are
+*/
+bool CpuTracer::UsesPackets() const
+{
+	return scene.usePackets && !scene.deflectionTable && !scene.binetOrbit;
+}
+
+/**
+ * Renders a tile one quad at a time
+ * @param _tile - the pixels to render
+ * @param _hdr - the HDR colors of the image
+*/
+void CpuTracer::RenderTile(const Tile& _tile, std::vector<glm::vec3>& _hdr) const
+{
+	glm::vec3 colors[4];
+	for (int y = _tile.y0; y < _tile.y1; y += 2)
+	{
+		for (int x = _tile.x0; x < _tile.x1; x += 2)
+		{
+			TraceQuad(x, y, colors);
+			//quads on the right and top borders have pixels outside of the image
+			for (int i = 0; i < 4; ++i)
+			{
+				int px = x + (i & 1), py = y + (i >> 1);
+				if (px < scene.width && py < scene.height)
+					_hdr[static_cast<size_t>(py) * scene.width + px] = colors[i];
+			}
+		}
+	}
+}
+
+/**
+ * Renders a tile marching all of its rays with the packet kernel, then
+ * shading them quad by quad. Rays are stored quad after quad, so a packet
+ * holds neighbouring pixels and its lanes mostly take the same branches
+ * @param _tile - the pixels to render
+ * @param _hdr - the HDR colors of the image
+*/
+void CpuTracer::RenderTilePackets(const Tile& _tile, std::vector<glm::vec3>& _hdr) const
+{
+	thread_local RayBatch batch;
+	int quadsX = (_tile.x1 - _tile.x0 + 1) / 2;
+	int quadsY = (_tile.y1 - _tile.y0 + 1) / 2;
+	size_t count = static_cast<size_t>(quadsX) * quadsY * 4;
+	batch.Resize(count);
+	for (size_t ray = 0; ray < count; ++ray)
+	{
+		size_t quad = ray / 4;
+		int i = static_cast<int>(ray % 4);
+		int x = _tile.x0 + static_cast<int>(quad % quadsX) * 2 + (i & 1);
+		int y = _tile.y0 + static_cast<int>(quad / quadsX) * 2 + (i >> 1);
+		glm::vec3 pos, dir;
+		GenerateRay(x + 0.5f, y + 0.5f, pos, dir);
+		for (int c = 0; c < 3; ++c)
+		{
+			batch.pos[c][ray] = pos[c];
+			batch.dir[c][ray] = dir[c];
+		}
+	}
+	PacketKernel::March(GetPacketParams(), batch.GetRays(), 0, count, scene.isa);
+
+	MarchStats stats;
+	for (size_t ray = 0; ray < count; ++ray)
+	{
+		//the last quads of the tile may have pixels outside of the image
+		int x = _tile.x0 + static_cast<int>(ray / 4 % quadsX) * 2 + static_cast<int>(ray & 1);
+		int y = _tile.y0 + static_cast<int>(ray / 4 / quadsX) * 2 + static_cast<int>(ray % 4 >> 1);
+		if (x >= scene.width || y >= scene.height)
+			continue;
+		stats.rays++;
+		stats.steps += batch.steps[ray];
+		stats.savedSteps += batch.savedSteps[ray];
+		stats.analyticEscapes += batch.savedSteps[ray] ? 1 : 0;
+	}
+	CountSteps(stats);
+
+	for (size_t quad = 0; quad < count / 4; ++quad)
+	{
+		glm::vec3 dirs[4];
+		for (int i = 0; i < 4; ++i)
+			dirs[i] = glm::vec3(batch.dir[0][quad * 4 + i], batch.dir[1][quad * 4 + i], batch.dir[2][quad * 4 + i]);
+		//derivatives are taken once per quad (coarse), from the bottom left pixel
+		glm::vec3 ddx = dirs[1] - dirs[0];
+		glm::vec3 ddy = dirs[2] - dirs[0];
+		for (int i = 0; i < 4; ++i)
+		{
+			int px = _tile.x0 + static_cast<int>(quad % quadsX) * 2 + (i & 1);
+			int py = _tile.y0 + static_cast<int>(quad / quadsX) * 2 + (i >> 1);
+			if (px >= scene.width || py >= scene.height)
+				continue;
+
+			//crossings are in the order the ray went through them, like in RayMarch
+			size_t ray = quad * 4 + i;
+			glm::vec3 color(0.0f);
+			for (int n = 0; n < batch.crossingCount[ray]; ++n)
+			{
+				size_t index = ray * PacketKernel::MaxCrossings + n;
+				color += GetAccretionDiskColor({ batch.crossings[0][index], batch.crossings[1][index], batch.crossings[2][index] });
+			}
+			if (batch.escaped[ray])
+				color += SampleSky(dirs[i], ddx, ddy);
+			_hdr[static_cast<size_t>(py) * scene.width + px] = color;
+		}
+	}
+}
+
+/**
+ * Renders the image coarse to fine, like the COARSE_NODES and COARSE_REFINE
+ * passes of BlackHole.frag: the corners of the coarseStep tiles are traced
+ * first, then each tile is interpolated from them or marched
+ * @param _hdr - the HDR colors of the image (already sized)
+ * @return - the load balance of the threads, over both passes
+*/
+TileScheduler::Stats CpuTracer::RenderCoarseToFine(std::vector<glm::vec3>& _hdr) const
+{
+	int tilesX = (scene.width + scene.coarseStep - 1) / scene.coarseStep;
+	int tilesY = (scene.height + scene.coarseStep - 1) / scene.coarseStep;
+	std::vector<CoarseNode> grid(static_cast<size_t>(tilesX + 1) * (tilesY + 1));
+	TileScheduler::Stats stats = TileScheduler::Run(tilesX + 1, tilesY + 1, [&](const Tile& _nodes)
+	{
+		TraceCoarseNodes(_nodes, tilesX + 1, grid);
+	});
+	//a coarse tile already holds coarseStep^2 pixels, split them in few of them
+	TileScheduler::Stats refine = TileScheduler::Run(tilesX, tilesY, [&](const Tile& _tiles)
+	{
+		for (int y = _tiles.y0; y < _tiles.y1; ++y)
+			for (int x = _tiles.x0; x < _tiles.x1; ++x)
+				RefineCoarseTile(x, y, tilesX + 1, grid, _hdr);
+	}, TileScheduler::MinSplitSize);
+
+	stats.wallMs += refine.wallMs;
+	for (size_t i = 0; i < stats.threads.size() && i < refine.threads.size(); ++i)
+	{
+		stats.threads[i].busyMs += refine.threads[i].busyMs;
+		stats.threads[i].idleMs += refine.threads[i].idleMs;
+		stats.threads[i].tiles += refine.threads[i].tiles;
+		stats.threads[i].steals += refine.threads[i].steals;
+		stats.threads[i].splits += refine.threads[i].splits;
+	}
+	return stats;
+}
+
+/**
+ * Marches the rays of some corners of the coarse grid, with the packet kernel
+ * if the scene allows it
+ * @param _nodes - the corners to trace, in grid coordinates
+ * @param _nodesX - corners per row of the grid
+ * @param _grid - the corners, row by row
+*/
+void CpuTracer::TraceCoarseNodes(const Tile& _nodes, int _nodesX, std::vector<CoarseNode>& _grid) const
+{
+	int width = _nodes.x1 - _nodes.x0;
+	size_t count = static_cast<size_t>(width) * (_nodes.y1 - _nodes.y0);
+	if (!UsesPackets())
+	{
+		//one by one, recording the disk hits like the scalar marchers of BlackHole.frag
+		for (size_t ray = 0; ray < count; ++ray)
+		{
+			CoarseNode& node = _grid[static_cast<size_t>(_nodes.y0 + ray / width) * _nodesX + _nodes.x0 + ray % width];
+			glm::ivec2 pixel = GetCoarseNode(_nodes.x0 + static_cast<int>(ray % width), _nodes.y0 + static_cast<int>(ray / width));
+			glm::vec3 pos, color;
+			GenerateRay(pixel.x + 0.5f, pixel.y + 0.5f, pos, node.ray);
+			node.dir = node.ray;
+			node.hitCount = 0;
+			node.escaped = RayMarch(pos, node.dir, color, &node);
+			node.dir = glm::normalize(node.dir);
+		}
+		return;
+	}
+
+	thread_local RayBatch batch;
+	batch.Resize(count);
+	for (size_t ray = 0; ray < count; ++ray)
+	{
+		CoarseNode& node = _grid[static_cast<size_t>(_nodes.y0 + ray / width) * _nodesX + _nodes.x0 + ray % width];
+		glm::ivec2 pixel = GetCoarseNode(_nodes.x0 + static_cast<int>(ray % width), _nodes.y0 + static_cast<int>(ray / width));
+		glm::vec3 pos;
+		GenerateRay(pixel.x + 0.5f, pixel.y + 0.5f, pos, node.ray);
+		for (int c = 0; c < 3; ++c)
+		{
+			batch.pos[c][ray] = pos[c];
+			batch.dir[c][ray] = node.ray[c];
+		}
+	}
+	PacketKernel::March(GetPacketParams(), batch.GetRays(), 0, count, scene.isa);
+
+	MarchStats stats;
+	for (size_t ray = 0; ray < count; ++ray)
+	{
+		stats.rays++;
+		stats.steps += batch.steps[ray];
+		stats.savedSteps += batch.savedSteps[ray];
+		stats.analyticEscapes += batch.savedSteps[ray] ? 1 : 0;
+
+		CoarseNode& node = _grid[static_cast<size_t>(_nodes.y0 + ray / width) * _nodesX + _nodes.x0 + ray % width];
+		node.dir = glm::normalize(glm::vec3(batch.dir[0][ray], batch.dir[1][ray], batch.dir[2][ray]));
+		node.escaped = batch.escaped[ray] != 0;
+		node.hitCount = batch.crossingCount[ray];
+		for (int n = 0; n < node.hitCount; ++n)
+		{
+			size_t index = ray * PacketKernel::MaxCrossings + n;
+			node.hits[n] = glm::vec3(batch.crossings[0][index], batch.crossings[1][index], batch.crossings[2][index]) - scene.BHPos;
+		}
+	}
+	CountSteps(stats);
+}
+
+/**
+ * Renders a tile of the coarse grid. If its corners end the same way and are
+ * close (see AreNodesClose), the rays are interpolated from them and shaded
+ * quad by quad, otherwise the tile is marched
+ * @param _tileX - column of the tile
+ * @param _tileY - row of the tile
+ * @param _nodesX - corners per row of the grid
+ * @param _grid - the corners, row by row
+ * @param _hdr - the HDR colors of the image
+*/
+void CpuTracer::RefineCoarseTile(int _tileX, int _tileY, int _nodesX, const std::vector<CoarseNode>& _grid, std::vector<glm::vec3>& _hdr) const
+{
+	Tile tile{ _tileX * scene.coarseStep, _tileY * scene.coarseStep,
+		std::min((_tileX + 1) * scene.coarseStep, scene.width), std::min((_tileY + 1) * scene.coarseStep, scene.height) };
+	const CoarseNode* corners[4];
+	glm::ivec2 pixels[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		corners[i] = &_grid[static_cast<size_t>(_tileY + (i >> 1)) * _nodesX + _tileX + (i & 1)];
+		pixels[i] = GetCoarseNode(_tileX + (i & 1), _tileY + (i >> 1));
+		if (corners[i]->escaped != corners[0]->escaped || corners[i]->hitCount != corners[0]->hitCount)
+			return MarchTile(tile, _hdr);
+	}
+	if (!AreNodesClose(*corners[0], *corners[1]) || !AreNodesClose(*corners[2], *corners[3]) ||
+		!AreNodesClose(*corners[0], *corners[2]) || !AreNodesClose(*corners[1], *corners[3]))
+		return MarchTile(tile, _hdr);
+
+	glm::vec2 span = glm::max(pixels[3] - pixels[0], glm::ivec2(1));
+	int hitCount = corners[0]->hitCount;
+	for (int y = tile.y0; y < tile.y1; y += 2)
+	{
+		for (int x = tile.x0; x < tile.x1; x += 2)
+		{
+			glm::vec3 dirs[4], colors[4];
+			for (int i = 0; i < 4; ++i)
+			{
+				glm::ivec2 pixel(x + (i & 1), y + (i >> 1));
+				glm::vec2 t = glm::vec2(pixel - pixels[0]) / span;
+				colors[i] = glm::vec3(0.0f);
+				dirs[i] = glm::mix(glm::mix(corners[0]->dir, corners[1]->dir, t.x), glm::mix(corners[2]->dir, corners[3]->dir, t.x), t.y);
+				for (int n = 0; n < hitCount; ++n)
+				{
+					glm::vec3 hit = glm::mix(glm::mix(corners[0]->hits[n], corners[1]->hits[n], t.x),
+						glm::mix(corners[2]->hits[n], corners[3]->hits[n], t.x), t.y);
+					colors[i] += GetAccretionDiskColor(scene.BHPos + hit);
+				}
+			}
+			//derivatives are taken once per quad (coarse), from the bottom left pixel
+			glm::vec3 ddx = dirs[1] - dirs[0];
+			glm::vec3 ddy = dirs[2] - dirs[0];
+			for (int i = 0; i < 4; ++i)
+			{
+				int px = x + (i & 1), py = y + (i >> 1);
+				if (px >= tile.x1 || py >= tile.y1)
+					continue;
+				if (corners[0]->escaped)
+					colors[i] += SampleSky(dirs[i], ddx, ddy);
+				_hdr[static_cast<size_t>(py) * scene.width + px] = colors[i];
+			}
+		}
+	}
+}
+
+/**
+ * Checks whether two corners of the coarse grid can be interpolated between:
+ * the lensing must not stretch the distance between their escape directions,
+ * or between their disk hits as seen from the camera, more than
+ * coarseMagnification times the distance between their pixels
+ * @param _a - corner
+ * @param _b - neighbouring corner, with as many disk hits
+ * @return - whether they are close enough
+*/
+bool CpuTracer::AreNodesClose(const CoarseNode& _a, const CoarseNode& _b) const
+{
+	float limit = scene.coarseMagnification * glm::length(_b.ray - _a.ray);
+	if (_a.escaped && glm::length(_b.dir - _a.dir) > limit)
+		return false;
+	for (int n = 0; n < _a.hitCount; ++n)
+	{
+		if (glm::length(_b.hits[n] - _a.hits[n]) > limit * glm::length(scene.BHPos + _a.hits[n] - scene.camera.position))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Pixel of a corner of the coarse grid, the last ones are clamped to the image
+ * @param _nodeX - column of the corner
+ * @param _nodeY - row of the corner
+ * @return - the pixel
+*/
+glm::ivec2 CpuTracer::GetCoarseNode(int _nodeX, int _nodeY) const
+{
+	return glm::min(glm::ivec2(_nodeX, _nodeY) * scene.coarseStep, glm::ivec2(scene.width, scene.height) - 1);
+}
+
+/**
+ * Generates the ray of a pixel and marches it
+ * @param _fragX - x of gl_FragCoord
+ * @param _fragY - y of gl_FragCoord
+ * @param _color - color gathered from the disk
+ * @param _dir - final direction of the ray
+ * @return - whether the ray escaped
+*/
+bool CpuTracer::TraceRay(float _fragX, float _fragY, glm::vec3& _color, glm::vec3& _dir) const
+{
+	glm::vec3 pos;
+	GenerateRay(_fragX, _fragY, pos, _dir);
+	return RayMarch(pos, _dir, _color);
+}
+
+/**
+ * Applies the tone mapping and gamma correction of BloomSecondPass.frag
+ * @param _hdr - HDR color
+ * @return - display color, in [0, 1]
+*/
+glm::vec3 CpuTracer::ToneMap(const glm::vec3& _hdr)
+{
+	const float a = 2.51f, b = 0.03f, c = 2.43f, d = 0.59f, e = 0.14f;
+	glm::vec3 x = glm::max(_hdr, glm::vec3(0.0f));
+	glm::vec3 mapped = glm::clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0.0f, 1.0f);
+	return glm::pow(mapped, glm::vec3(1.0f / 2.2f));
+}
+
+/**
+ * Compares two frames after tone mapping
+ * @param _a - HDR frame
+ * @param _b - HDR frame of the same size
+ * @return - the differences
+*/
+CpuTracer::Comparison CpuTracer::CompareFrames(const std::vector<glm::vec3>& _a, const std::vector<glm::vec3>& _b)
+{
+	Comparison result;
+	size_t count = std::min(_a.size(), _b.size()), within = 0;
+	double sum = 0.0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		glm::vec3 diff = glm::abs(ToneMap(_a[i]) - ToneMap(_b[i])) * 255.0f;
+		float error = std::max(diff.x, std::max(diff.y, diff.z));
+		result.maxError = std::max(result.maxError, error);
+		sum += diff.x + diff.y + diff.z;
+		within += error <= Tolerance ? 1 : 0;
+	}
+	if (count)
+	{
+		result.meanError = static_cast<float>(sum / (3.0 * count));
+		result.withinTolerance = static_cast<float>(within) / count;
+	}
+	return result;
+}
+
+//The bulk of the algorithm. Performs ray marching and checks for intersections
+//while the light gets bent. Returns whether the ray escaped (dir then holds the
+//direction in which the skybox must be sampled)
+bool CpuTracer::RayMarch(glm::vec3 _pos, glm::vec3& _dir, glm::vec3& _color, CoarseNode* _node) const
+{
+	if (scene.deflectionTable && scene.applyLensing && glm::dot(_pos - scene.BHPos, _dir) < 0.0f
+		&& scene.deflectionTable->IsBuiltFor(glm::length(_pos - scene.BHPos), scene.EHRad))
+		return TraceDeflectionTable(_pos, _dir, _color, _node);
+	if (scene.binetOrbit)
+		return RayMarchBinet(_pos, _dir, _color, _node);
+	if (scene.adaptiveStep)
+		return RayMarchAdaptive(_pos, _dir, _color, _node);
+
+	_color = glm::vec3(0.0f);
+	glm::vec3 h = glm::cross(_pos, _dir);
+	float h2 = glm::dot(h, h);
+	float escapeH2 = scene.applyLensing ? h2 : 0.0f;
+
+	for (int i = 0; i < MaxSteps; i++)
+	{
+		glm::vec3 intersectionPoint;
+		if (scene.renderDisk && IntersectionRayAccretionDisk(_pos, _dir, intersectionPoint) >= 0.0f)
+			AddDiskHit(intersectionPoint, _color, _node);
+
+		glm::vec3 rayToBH = _pos - scene.BHPos;
+		if (glm::dot(rayToBH, rayToBH) <= scene.EHRad * scene.EHRad)
+		{
+			CountSteps({ 1, static_cast<unsigned long long>(i), 0, 0 });
+			return false;
+		}
+
+		if (scene.analyticEscape && EscapeAnalytically(escapeH2, _pos, _dir))
+		{
+			CountSteps({ 1, static_cast<unsigned long long>(i), static_cast<unsigned long long>(MaxSteps - i), 1 });
+			return true;
+		}
+
+		IntegrateRungeKutta4(h2, _pos, _dir);
+	}
+	if (scene.analyticEscape)
+		FinishEscape(escapeH2, scene.BHPos, _pos, _dir);
+	CountSteps({ 1, MaxSteps, 0, 0 });
+	return true;
+}
+
+//Finishes the march of a ray analytically if it is heading away from the black
+//hole, see EscapeAnalytically in BlackHole.frag
+bool CpuTracer::EscapeAnalytically(float _h2, const glm::vec3& _pos, glm::vec3& _dir) const
+{
+	glm::vec3 rayToBH = _pos - scene.BHPos;
+	float r2 = glm::dot(rayToBH, rayToBH);
+	float escapeRad = EscapeRadius * scene.EHRad;
+	if (scene.renderDisk)
+		escapeRad = std::max(escapeRad, scene.outerDiskRad);
+	if (r2 < escapeRad * escapeRad || glm::dot(rayToBH, _dir) <= 0.0f)
+		return false;
+
+	glm::vec3 deflection = GetRemainingDeflection(_h2, rayToBH, _dir);
+	float v2 = glm::dot(_dir, _dir);
+	glm::vec3 bend = deflection - glm::dot(deflection, _dir) / v2 * _dir;
+	float pixelAngle = 1.0f / (scene.width * scene.focalLength);
+	if (EscapeMargin * glm::dot(bend, bend) > pixelAngle * v2)
+		return false;
+	_dir += deflection;
+	return true;
+}
+
+//Rebuilds the march of an inbound ray from the deflection table, see
+//TraceDeflectionTable in BlackHole.frag
+bool CpuTracer::TraceDeflectionTable(const glm::vec3& _pos, glm::vec3& _dir, glm::vec3& _color, CoarseNode* _node) const
+{
+	const DeflectionTable& table = *scene.deflectionTable;
+	_color = glm::vec3(0.0f);
+	glm::vec3 e1 = glm::normalize(_pos - scene.BHPos);
+	glm::vec3 v = glm::normalize(_dir);
+	glm::vec3 tangent = v - glm::dot(v, e1) * e1;
+	float s = glm::length(tangent);
+	float endAngle;
+	bool captured = table.GetEnd(s, endAngle);
+	CountSteps({ 1, 0, 0, 0 });
+	if (s == 0.0f)
+		return false;
+	glm::vec3 e2 = tangent / s;
+
+	if (scene.renderDisk && (e1.y != 0.0f || e2.y != 0.0f))
+	{
+		float node = std::atan2(-e1.y, e2.y);
+		if (node <= 0.0f)
+			node += PI;
+		for (int k = 0; k < PacketKernel::MaxCrossings; k++)
+		{
+			float phi = node + k * PI;
+			if (phi >= endAngle)
+				break;
+			float r = 1.0f / table.GetInverseRadius(s, phi);
+			if (r >= scene.innerDiskRad && r <= scene.outerDiskRad)
+				AddDiskHit(scene.BHPos + r * (std::cos(phi) * e1 + std::sin(phi) * e2), _color, _node);
+		}
+	}
+
+	if (captured)
+		return false;
+	_dir = std::cos(endAngle) * e1 + std::sin(endAngle) * e2;
+	return true;
+}
+
+//Marches a ray in the plane of its orbit with the Binet equation, see
+//RayMarchBinet in BlackHole.frag
+bool CpuTracer::RayMarchBinet(const glm::vec3& _pos, glm::vec3& _dir, glm::vec3& _color, CoarseNode* _node) const
+{
+	_color = glm::vec3(0.0f);
+	glm::vec3 rayToBH = _pos - scene.BHPos;
+	float r = glm::length(rayToBH);
+	glm::vec3 e1 = rayToBH / r;
+	glm::vec3 v = glm::normalize(_dir);
+	glm::vec3 tangent = v - glm::dot(v, e1) * e1;
+	float s = glm::length(tangent);
+	if (s == 0.0f)
+	{
+		CountSteps({ 1, 0, 0, 0 });
+		return glm::dot(v, e1) > 0.0f;
+	}
+	glm::vec3 e2 = tangent / s;
+
+	float u = 1.0f / r;
+	float du = -u * glm::dot(v, e1) / s;
+	float node = 1e30f;
+	if (scene.renderDisk && (e1.y != 0.0f || e2.y != 0.0f))
+	{
+		node = std::atan2(-e1.y, e2.y);
+		if (node <= 0.0f)
+			node += PI;
+	}
+	//u'' = 1.5 u^2 - u, a straight line without lensing
+	auto acceleration = [this](float _u) { return (scene.applyLensing ? 1.5f * _u * _u : 0.0f) - _u; };
+
+	float h = scene.binetStep;
+	float phi = 0.0f;
+	int i = 0;
+	for (; phi < BinetMaxAngle; i++)
+	{
+		if (u * scene.EHRad >= 1.0f)
+		{
+			CountSteps({ 1, static_cast<unsigned long long>(i), 0, 0 });
+			return false;
+		}
+
+		float k1u = du, k1v = acceleration(u);
+		float k2u = du + 0.5f * h * k1v, k2v = acceleration(u + 0.5f * h * k1u);
+		float k3u = du + 0.5f * h * k2v, k3v = acceleration(u + 0.5f * h * k2u);
+		float k4u = du + h * k3v, k4v = acceleration(u + h * k3u);
+		float newU = u + h / 6.0f * (k1u + 2.0f * k2u + 2.0f * k3u + k4u);
+		float newDu = du + h / 6.0f * (k1v + 2.0f * k2v + 2.0f * k3v + k4v);
+		bool escaped = newU <= 0.0f;
+		float end = escaped ? phi + h * u / (u - newU) : phi + h;
+
+		for (; node <= end; node += PI)
+		{
+			float t = (node - phi) / h;
+			float t2 = t * t, t3 = t2 * t;
+			float uNode = (2.0f * t3 - 3.0f * t2 + 1.0f) * u + (t3 - 2.0f * t2 + t) * h * du
+				+ (3.0f * t2 - 2.0f * t3) * newU + (t3 - t2) * h * newDu;
+			float rNode = 1.0f / uNode;
+			if (uNode > 0.0f && rNode >= scene.innerDiskRad && rNode <= scene.outerDiskRad)
+				AddDiskHit(scene.BHPos + rNode * (std::cos(node) * e1 + std::sin(node) * e2), _color, _node);
+		}
+
+		if (escaped)
+		{
+			_dir = std::cos(end) * e1 + std::sin(end) * e2;
+			CountSteps({ 1, static_cast<unsigned long long>(i + 1), 0, 0 });
+			return true;
+		}
+		u = newU;
+		du = newDu;
+		phi += h;
+	}
+	CountSteps({ 1, static_cast<unsigned long long>(i), 0, 0 });
+	return false;
+}
+
+//Ray marching with adaptive steps, see RayMarchAdaptive in BlackHole.frag
+bool CpuTracer::RayMarchAdaptive(glm::vec3 _pos, glm::vec3& _dir, glm::vec3& _color, CoarseNode* _node) const
+{
+	_color = glm::vec3(0.0f);
+	glm::vec3 h = glm::cross(_pos, _dir);
+	float h2 = scene.applyLensing ? glm::dot(h, h) : 0.0f;
+
+	glm::vec3 dx, du;
+	SchwarzschildGeodesic(h2, scene.BHPos, _pos, _dir, dx, du);
+	float travelled = 0.0f;
+	float stepSize = std::min(StepDistanceRatio * glm::length(_pos - scene.BHPos), MarchLength);
+	for (int i = 0; i < MaxSteps; i++)
+	{
+		glm::vec3 rayToBH = _pos - scene.BHPos;
+		float r2 = glm::dot(rayToBH, rayToBH);
+		if (r2 <= scene.EHRad * scene.EHRad)
+		{
+			CountSteps({ 1, static_cast<unsigned long long>(i), 0, 0 });
+			return false;
+		}
+		if (travelled >= MarchLength)
+		{
+			if (scene.analyticEscape)
+				FinishEscape(h2, scene.BHPos, _pos, _dir);
+			CountSteps({ 1, static_cast<unsigned long long>(i), 0, 0 });
+			return true;
+		}
+		if (scene.analyticEscape && EscapeAnalytically(h2, _pos, _dir))
+		{
+			int saved = GetAdaptiveStepsLeft(MarchLength - travelled, std::sqrt(r2), MaxSteps - i);
+			CountSteps({ 1, static_cast<unsigned long long>(i), static_cast<unsigned long long>(saved), 1 });
+			return true;
+		}
+
+		stepSize = std::min(stepSize, std::min(MarchLength - travelled, StepDistanceRatio * std::sqrt(r2)));
+		glm::vec3 newPos, newDir, newDu = du;
+		float error = IntegrateDormandPrince(h2, stepSize, _pos, _dir, newDu, newPos, newDir);
+		if (error <= scene.stepTolerance || stepSize <= MinStep)
+		{
+			//the step went through the plane of the disk (not counting where it started)
+			float y0 = _pos.y - scene.BHPos.y;
+			if (scene.renderDisk && y0 * (newPos.y - scene.BHPos.y) <= 0.0f && y0 != 0.0f)
+			{
+				glm::vec3 intersectionPoint = FindDiskCrossing(scene.BHPos.y, stepSize, _pos, _dir, newPos, newDir);
+				glm::vec3 vec = intersectionPoint - scene.BHPos;
+				float distSq = glm::dot(vec, vec);
+				if (distSq >= scene.innerDiskRad * scene.innerDiskRad && distSq <= scene.outerDiskRad * scene.outerDiskRad)
+					AddDiskHit(intersectionPoint, _color, _node);
+			}
+			_pos = newPos;
+			_dir = newDir;
+			du = newDu;
+			travelled += stepSize;
+		}
+		float factor = std::clamp(0.9f * std::sqrt(std::sqrt(scene.stepTolerance / std::max(error, 1e-20f))), 0.2f, 5.0f);
+		stepSize = std::max(stepSize * factor, MinStep);
+	}
+	if (scene.analyticEscape)
+		FinishEscape(h2, scene.BHPos, _pos, _dir);
+	CountSteps({ 1, MaxSteps, 0, 0 });
+	return true;
+}
+
+//Adds the color of a disk crossing to a ray, like AddDiskHit in BlackHole.frag.
+//The coarse corners also keep where it was (as many as the packet kernel keeps)
+void CpuTracer::AddDiskHit(const glm::vec3& _point, glm::vec3& _color, CoarseNode* _node) const
+{
+	_color += GetAccretionDiskColor(_point);
+	if (_node && _node->hitCount < PacketKernel::MaxCrossings)
+		_node->hits[_node->hitCount++] = _point - scene.BHPos;
+}
+
+// Performs Runge-Kutta 4th Order integration
+void CpuTracer::IntegrateRungeKutta4(float _h2, glm::vec3& _pos, glm::vec3& _dir) const
+{
+	glm::vec3 dx1, du1, dx2, du2, dx3, du3, dx4, du4;
+	SchwarzschildGeodesic(_h2, scene.BHPos, _pos, _dir, dx1, du1);
+	SchwarzschildGeodesic(_h2, scene.BHPos, _pos + dx1 * (STEP_SIZE / 2.0f), _dir + du1 * (STEP_SIZE / 2.0f), dx2, du2);
+	SchwarzschildGeodesic(_h2, scene.BHPos, _pos + dx2 * (STEP_SIZE / 2.0f), _dir + du2 * (STEP_SIZE / 2.0f), dx3, du3);
+	SchwarzschildGeodesic(_h2, scene.BHPos, _pos + dx3 * STEP_SIZE, _dir + du3 * STEP_SIZE, dx4, du4);
+
+	_pos += (STEP_SIZE / 6.0f) * (dx1 + 2.0f * dx2 + 2.0f * dx3 + dx4);
+	//light is only bent if lensing is applied
+	if (scene.applyLensing)
+		_dir += (STEP_SIZE / 6.0f) * (du1 + 2.0f * du2 + 2.0f * du3 + du4);
+}
+
+// Performs a Dormand-Prince 5(4) step, see BlackHole.frag
+float CpuTracer::IntegrateDormandPrince(float _h2, float _h, const glm::vec3& _pos, const glm::vec3& _dir, glm::vec3& _du1, glm::vec3& _newPos, glm::vec3& _newDir) const
+{
+	const glm::vec3& BH = scene.BHPos;
+	glm::vec3 dx1 = _dir, du1 = _du1;
+	glm::vec3 dx2, du2, dx3, du3, dx4, du4, dx5, du5, dx6, du6, dx7, du7;
+
+	SchwarzschildGeodesic(_h2, BH, _pos + _h * (dx1 * (1.0f / 5.0f)),
+		_dir + _h * (du1 * (1.0f / 5.0f)), dx2, du2);
+	SchwarzschildGeodesic(_h2, BH, _pos + _h * (dx1 * (3.0f / 40.0f) + dx2 * (9.0f / 40.0f)),
+		_dir + _h * (du1 * (3.0f / 40.0f) + du2 * (9.0f / 40.0f)), dx3, du3);
+	SchwarzschildGeodesic(_h2, BH, _pos + _h * (dx1 * (44.0f / 45.0f) + dx2 * (-56.0f / 15.0f) + dx3 * (32.0f / 9.0f)),
+		_dir + _h * (du1 * (44.0f / 45.0f) + du2 * (-56.0f / 15.0f) + du3 * (32.0f / 9.0f)), dx4, du4);
+	SchwarzschildGeodesic(_h2, BH, _pos + _h * (dx1 * (19372.0f / 6561.0f) + dx2 * (-25360.0f / 2187.0f) + dx3 * (64448.0f / 6561.0f) + dx4 * (-212.0f / 729.0f)),
+		_dir + _h * (du1 * (19372.0f / 6561.0f) + du2 * (-25360.0f / 2187.0f) + du3 * (64448.0f / 6561.0f) + du4 * (-212.0f / 729.0f)), dx5, du5);
+	SchwarzschildGeodesic(_h2, BH, _pos + _h * (dx1 * (9017.0f / 3168.0f) + dx2 * (-355.0f / 33.0f) + dx3 * (46732.0f / 5247.0f) + dx4 * (49.0f / 176.0f) + dx5 * (-5103.0f / 18656.0f)),
+		_dir + _h * (du1 * (9017.0f / 3168.0f) + du2 * (-355.0f / 33.0f) + du3 * (46732.0f / 5247.0f) + du4 * (49.0f / 176.0f) + du5 * (-5103.0f / 18656.0f)), dx6, du6);
+	//5th order solution
+	_newPos = _pos + _h * (dx1 * (35.0f / 384.0f) + dx3 * (500.0f / 1113.0f) + dx4 * (125.0f / 192.0f) + dx5 * (-2187.0f / 6784.0f) + dx6 * (11.0f / 84.0f));
+	_newDir = _dir + _h * (du1 * (35.0f / 384.0f) + du3 * (500.0f / 1113.0f) + du4 * (125.0f / 192.0f) + du5 * (-2187.0f / 6784.0f) + du6 * (11.0f / 84.0f));
+	SchwarzschildGeodesic(_h2, BH, _newPos, _newDir, dx7, du7);
+
+	//difference with the embedded 4th order solution
+	glm::vec3 ex = _h * (dx1 * (71.0f / 57600.0f) + dx3 * (-71.0f / 16695.0f) + dx4 * (71.0f / 1920.0f) + dx5 * (-17253.0f / 339200.0f) + dx6 * (22.0f / 525.0f) + dx7 * (-1.0f / 40.0f));
+	glm::vec3 eu = _h * (du1 * (71.0f / 57600.0f) + du3 * (-71.0f / 16695.0f) + du4 * (71.0f / 1920.0f) + du5 * (-17253.0f / 339200.0f) + du6 * (22.0f / 525.0f) + du7 * (-1.0f / 40.0f));
+	_du1 = du7;
+	glm::vec3 error = glm::max(glm::abs(ex) / (1.0f + glm::abs(_newPos)), glm::abs(eu) / (1.0f + glm::abs(_newDir)));
+	return std::max(error.x, std::max(error.y, error.z));
+}
+
+//Checks whether the given ray intersects the accretion disk
+float CpuTracer::IntersectionRayAccretionDisk(const glm::vec3& _pos, const glm::vec3& _dir, glm::vec3& _intersectionPoint) const
+{
+	float t = IntersectionRayPlane(_pos, _dir, scene.BHPos, glm::vec3(0, 1, 0));
+	if (t >= 0.0f && t <= STEP_SIZE)
+	{
+		float innerRadSq = scene.innerDiskRad * scene.innerDiskRad;
+		float outerRadSq = scene.outerDiskRad * scene.outerDiskRad;
+		_intersectionPoint = _pos + t * glm::normalize(_dir);
+		glm::vec3 vec = _intersectionPoint - scene.BHPos;
+		float distSq = glm::dot(vec, vec);
+		if (distSq >= innerRadSq && distSq <= outerRadSq)
+			return t;
+	}
+	return -1.0f;
+}
+
+//Gets the accretion disk color (upon intersecting with it), see BlackHole.frag
+glm::vec3 CpuTracer::GetAccretionDiskColor(const glm::vec3& _intersectionPoint) const
+{
+	float dist = glm::length(_intersectionPoint - scene.BHPos);
+	float angle = std::atan2(_intersectionPoint.z, _intersectionPoint.x);
+	glm::vec2 uv;
+	uv.x = (angle + scene.timeElapsed) / (2 * PI);
+	uv.y = (dist - scene.innerDiskRad) / (scene.outerDiskRad - scene.innerDiskRad);
+	glm::vec3 orange = glm::vec3(1.3f, 0.65f, 0.3f);
+	glm::vec3 diskTextColor = Sample(scene.diskTexture, uv) * orange;
+
+	glm::vec3 spherical = CartesianToSpherical(_intersectionPoint);
+	spherical.y += scene.timeElapsed;
+	glm::vec3 noiseColor = Sample(scene.noiseTexture, uv) + glm::vec3(2);
+	float r = spherical.x;
+
+	float falloff = std::max(1.0f - uv.y, 0.0f);
+	noiseColor *= falloff;
+
+	float rFactor = std::pow((3.0f * scene.EHRad / r), 0.75f);
+	float T = BHTemperature * rFactor;
+
+	float v = std::sqrt(scene.EHRad / (2.0f * r));
+	float gamma = 1.0f / std::sqrt(1.0f - (v * v));
+	float incidence = spherical.z * r / glm::length(spherical * glm::vec3(1.0f, r, r));
+	float shift = gamma * (1.0f + v * incidence);
+	glm::vec3 beamColor = noiseColor * std::pow(std::abs(shift), scene.beamExponent);
+	shift *= std::sqrt(1 - (scene.EHRad / r));
+
+	uv.x = (shift - 0.5f) / 2.0f;
+	uv.y = uv.x;
+	glm::vec3 bbColor = Sample(scene.bbTexture, uv);
+
+	glm::vec3 outColor = glm::vec3(beamColor.x) * bbColor;
+	outColor *= std::pow(std::abs(T / BHTemperature), 4.0f);
+	return outColor * diskTextColor;
+}
+
+/**
+ * Samples the skybox like a GL cubemap with trilinear filtering
+ * @param _dir - direction to sample
+ * @param _ddx - horizontal derivative of the direction
+ * @param _ddy - vertical derivative of the direction
+ * @return - the linear color
+*/
+glm::vec3 CpuTracer::SampleSky(const glm::vec3& _dir, const glm::vec3& _ddx, const glm::vec3& _ddy) const
+{
+	float ma, sc, tc;
+	int face = GetCubeFace(_dir, ma, sc, tc);
+	const Image* image = scene.sky[face];
+	if (image == nullptr || image->levels.empty() || ma == 0.0f)
+		return glm::vec3(0.0f);
+	glm::vec2 uv((sc / ma + 1.0f) / 2.0f, (tc / ma + 1.0f) / 2.0f);
+
+	//level of detail from the footprint of the pixel on the face
+	glm::vec2 dx = (ProjectOnFace(_dir + _ddx, face) - uv) * static_cast<float>(image->width);
+	glm::vec2 dy = (ProjectOnFace(_dir + _ddy, face) - uv) * static_cast<float>(image->height);
+	float rho = std::sqrt(std::max(glm::dot(dx, dx), glm::dot(dy, dy)));
+	float lod = rho > 1.0f ? std::log2(rho) : 0.0f;
+	lod = std::min(lod, static_cast<float>(image->levels.size() - 1));
+	int level = static_cast<int>(lod);
+	glm::vec3 color = SampleBilinear(image->levels[level], uv, false, true);
+	if (level + 1 < static_cast<int>(image->levels.size()))
+		color = glm::mix(color, SampleBilinear(image->levels[level + 1], uv, false, true), lod - level);
+	return color;
+}
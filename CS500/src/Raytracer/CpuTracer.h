@@ -0,0 +1,215 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the CPU Tracer class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "../Graphics/Image.h"
+#include "DeflectionTable.h"
+#include "PacketKernel.h"
+#include "TileScheduler.h"
+
+/**
+ * Camera vectors, the same ones uploaded to BlackHole.frag
+ */
+struct TracerCamera
+{
+	static TracerCamera Orbit(float _theta, float _phi, float _radius);
+
+	glm::vec3 position{ 0.0f, 0.0f, 20.0f };
+	glm::vec3 view{ 0.0f, 0.0f, -1.0f };
+	glm::vec3 right{ 1.0f, 0.0f, 0.0f };
+	glm::vec3 up{ 0.0f, 1.0f, 0.0f };
+};
+
+/**
+ * Everything BlackHole.frag reads: uniforms and textures. Images are RGB, the
+ * 2D ones are sampled as linear data and the skybox faces as sRGB (in the
+ * GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order)
+ */
+struct TracerScene
+{
+	TracerCamera camera{};
+	int width = 1280;
+	int height = 720;
+	float focalLength = 1.0f;
+
+	glm::vec3 BHPos{ 0.0f };
+	float EHRad = 1.0f;
+	float innerDiskRad = 2.0f;
+	float outerDiskRad = 8.0f;
+	float beamExponent = 2.0f;
+	//the value of the timeElapsed uniform
+	float timeElapsed = 0.0f;
+	bool applyLensing = true;
+	bool renderDisk = true;
+	//Dormand-Prince steps instead of the fixed RK4 ones, see BlackHole.frag
+	bool adaptiveStep = true;
+	float stepTolerance = 1e-5f;
+	//integrate the inverse radius over the orbital angle instead (binetStep
+	//radians per step), see RayMarchBinet in BlackHole.frag. Traced one ray at a time
+	bool binetOrbit = false;
+	float binetStep = 0.05f;
+	//finish the rays heading away from the black hole analytically, see EscapeAnalytically in BlackHole.frag
+	bool analyticEscape = true;
+	//rebuild the inbound rays from this table instead of marching them (if
+	//built for this camera distance), rays are then traced one by one
+	const DeflectionTable* deflectionTable{};
+	//march the rays in SIMD packets (TracePixel is always scalar)
+	bool usePackets = true;
+	PacketKernel::Isa isa = PacketKernel::Isa::AUTO;
+	//coarse to fine, like COARSE_NODES in BlackHole.frag: trace one pixel every
+	//coarseStep (even, 0 traces them all) and interpolate the tiles whose
+	//corners agree. Corners and tiles are marched like the other frames
+	int coarseStep = 0;
+	float coarseMagnification = 4.0f;
+
+	const Image* diskTexture{};
+	const Image* bbTexture{};
+	const Image* noiseTexture{};
+	std::array<const Image*, 6> sky{};
+};
+
+/**
+ * The images the renderer uploads, loaded for the CPU tracer
+ */
+struct TracerImages
+{
+	bool Load(const std::string& _skyDir, int _maxSkySize = 0);
+	void Bind(TracerScene& _scene) const;
+
+	Image disk{};
+	Image noise{};
+	std::array<Image, 6> sky{};
+};
+
+/**
+ * Storage of the rays given to the packet kernel, one array per component
+ */
+struct RayBatch
+{
+	void Resize(size_t _count);
+	PacketKernel::Rays GetRays();
+
+	std::array<std::vector<float>, 3> pos{};
+	std::array<std::vector<float>, 3> dir{};
+	std::vector<unsigned char> escaped{};
+	std::vector<unsigned short> steps{};
+	std::vector<unsigned short> savedSteps{};
+	std::vector<unsigned char> crossingCount{};
+	std::array<std::vector<float>, 3> crossings{};
+};
+
+/**
+ * CPU port of BlackHole.frag, used to render without a GPU and as a
+ * correctness oracle for the shader. It follows the shader operation by
+ * operation in single precision, so the differences come from:
+ *  - transcendental functions (the GPU ones are less precise),
+ *  - texture filtering: the sampling matches GL (2D textures are bilinear on
+ *    level 0, the skybox is trilinear with the LOD from the coarse derivatives
+ *    of each 2x2 quad), but the GPU filters with 8 bit weights, decodes sRGB
+ *    with tables and may approximate the LOD of the cube faces. TracePixel
+ *    has no quad and samples the skybox from level 0,
+ *  - rays grazing the photon sphere or the disk edges, whose fate flips with
+ *    the last bit of a float.
+ * Compared after tone mapping (8 bit, bloom off), at least 99% of the pixels
+ * are expected within 8/255 of the GPU frame, see CompareFrames.
+ *
+ * Render marches the rays of each tile in packets (see PacketKernel), which
+ * computes r^5 as r2 * r2 * sqrt(r2) instead of pow(r2, 2.5), so its frames
+ * differ from the scalar path in the last bits of some rays.
+ */
+class CpuTracer
+{
+public:
+	struct Comparison
+	{
+		//largest and mean difference per channel, in 8 bit steps
+		float maxError{};
+		float meanError{};
+		//fraction of the pixels within the tolerance
+		float withinTolerance{};
+	};
+
+	/**
+	 * Steps of the rays marched so far, like the MarchStats buffer of BlackHole.frag
+	 */
+	struct MarchStats
+	{
+		unsigned long long rays{};
+		unsigned long long steps{};
+		//steps the analytic escape skipped (a lower bound with adaptive steps)
+		unsigned long long savedSteps{};
+		unsigned long long analyticEscapes{};
+	};
+
+	static const int Tolerance = 8;
+	static const float MinWithinTolerance;
+
+	CpuTracer(const TracerScene& _scene) : scene(_scene) {}
+
+	glm::vec3 TracePixel(float _fragX, float _fragY) const;
+	void TraceQuad(int _x, int _y, glm::vec3 _colors[4]) const;
+	bool TraceRay(float _fragX, float _fragY, glm::vec3& _color, glm::vec3& _dir) const;
+	TileScheduler::Stats Render(std::vector<glm::vec3>& _hdr) const;
+	void GenerateRay(float _fragX, float _fragY, glm::vec3& _pos, glm::vec3& _dir) const;
+	PacketKernel::Params GetPacketParams() const;
+	MarchStats GetMarchStats() const;
+
+	static glm::vec3 ToneMap(const glm::vec3& _hdr);
+	static Comparison CompareFrames(const std::vector<glm::vec3>& _a, const std::vector<glm::vec3>& _b);
+
+private:
+	/**
+	 * Ray traced at a corner of the coarse grid
+	 */
+	struct CoarseNode
+	{
+		glm::vec3 ray{};
+		//final direction, normalized
+		glm::vec3 dir{};
+		bool escaped{};
+		int hitCount{};
+		//disk hits relative to the black hole
+		std::array<glm::vec3, PacketKernel::MaxCrossings> hits{};
+	};
+
+	TileScheduler::Stats RenderCoarseToFine(std::vector<glm::vec3>& _hdr) const;
+	void TraceCoarseNodes(const Tile& _nodes, int _nodesX, std::vector<CoarseNode>& _grid) const;
+	void RefineCoarseTile(int _tileX, int _tileY, int _nodesX, const std::vector<CoarseNode>& _grid, std::vector<glm::vec3>& _hdr) const;
+	bool AreNodesClose(const CoarseNode& _a, const CoarseNode& _b) const;
+	glm::ivec2 GetCoarseNode(int _nodeX, int _nodeY) const;
+	void RenderTile(const Tile& _tile, std::vector<glm::vec3>& _hdr) const;
+	void RenderTilePackets(const Tile& _tile, std::vector<glm::vec3>& _hdr) const;
+	void MarchTile(const Tile& _tile, std::vector<glm::vec3>& _hdr) const;
+	bool UsesPackets() const;
+	bool RayMarch(glm::vec3 _pos, glm::vec3& _dir, glm::vec3& _color, CoarseNode* _node = nullptr) const;
+	bool RayMarchAdaptive(glm::vec3 _pos, glm::vec3& _dir, glm::vec3& _color, CoarseNode* _node) const;
+	bool RayMarchBinet(const glm::vec3& _pos, glm::vec3& _dir, glm::vec3& _color, CoarseNode* _node) const;
+	bool TraceDeflectionTable(const glm::vec3& _pos, glm::vec3& _dir, glm::vec3& _color, CoarseNode* _node) const;
+	void AddDiskHit(const glm::vec3& _point, glm::vec3& _color, CoarseNode* _node) const;
+	bool EscapeAnalytically(float _h2, const glm::vec3& _pos, glm::vec3& _dir) const;
+	void CountSteps(const MarchStats& _stats) const;
+	void IntegrateRungeKutta4(float _h2, glm::vec3& _pos, glm::vec3& _dir) const;
+	float IntegrateDormandPrince(float _h2, float _h, const glm::vec3& _pos, const glm::vec3& _dir, glm::vec3& _du1, glm::vec3& _newPos, glm::vec3& _newDir) const;
+	float IntersectionRayAccretionDisk(const glm::vec3& _pos, const glm::vec3& _dir, glm::vec3& _intersectionPoint) const;
+	glm::vec3 GetAccretionDiskColor(const glm::vec3& _intersectionPoint) const;
+	glm::vec3 SampleSky(const glm::vec3& _dir, const glm::vec3& _ddx, const glm::vec3& _ddy) const;
+
+	TracerScene scene;
+	//added to by every worker
+	mutable std::atomic<unsigned long long> marchedRays{};
+	mutable std::atomic<unsigned long long> marchedSteps{};
+	mutable std::atomic<unsigned long long> savedSteps{};
+	mutable std::atomic<unsigned long long> analyticEscapes{};
+};
@@ -0,0 +1,158 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the Deflection Table class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "DeflectionTable.h"
+
+namespace
+{
+	//RK4 steps per column of the table
+	static const int Substeps = 8;
+	//relative change of the camera distance the table still works for
+	static const float RadiusTolerance = 1e-4f;
+
+	/**
+	 * Binet equation of the geodesic (u = 1 / r): u'' = 1.5 u^2 - u. It is the
+	 * acceleration of SchwarzschildGeodesic in BlackHole.frag in polar coordinates
+	 * @param _u - inverse radius
+	 * @return - second derivative of u with respect to the orbital angle
+	*/
+	double GetAcceleration(double _u)
+	{
+		return 1.5 * _u * _u - _u;
+	}
+}
+
+const float DeflectionTable::MaxAngle = 4.0f * 3.14159265f;
+
+/**
+ * Integrates the orbit of every impact parameter, for a camera at a distance
+ * of the black hole. Orbits that go around it for longer than MaxAngle are
+ * treated as captured
+ * @param _camRadius - distance from the camera to the black hole
+ * @param _EHRad - event horizon radius
+*/
+void DeflectionTable::Build(float _camRadius, float _EHRad)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	inverseRadius.assign(static_cast<size_t>(ImpactSamples) * AngleSamples, 0.0f);
+	ends.assign(static_cast<size_t>(ImpactSamples) * 2, 0.0f);
+	const double step = MaxAngle / (AngleSamples - 1) / Substeps;
+	const double uCapture = 1.0 / _EHRad;
+	const double u0 = 1.0 / _camRadius;
+
+	for (int row = 0; row < ImpactSamples; ++row)
+	{
+		float* orbit = &inverseRadius[static_cast<size_t>(row) * AngleSamples];
+		double s = static_cast<double>(row) / (ImpactSamples - 1);
+		//radial rays fall straight in
+		if (row == 0 || u0 >= uCapture)
+		{
+			std::fill(orbit, orbit + AngleSamples, static_cast<float>(uCapture));
+			ends[row * 2 + 1] = 1.0f;
+			continue;
+		}
+
+		//du/dphi = -u * (radial part of the direction) / (tangential part), rays start inbound
+		double u = u0, du = u0 * std::sqrt(1.0 - s * s) / s;
+		double endAngle = MaxAngle;
+		bool captured = true, done = false;
+		orbit[0] = static_cast<float>(u);
+		int column = 1;
+		for (; column < AngleSamples && !done; ++column)
+		{
+			for (int i = 0; i < Substeps; ++i)
+			{
+				double k1u = du, k1v = GetAcceleration(u);
+				double k2u = du + 0.5 * step * k1v, k2v = GetAcceleration(u + 0.5 * step * k1u);
+				double k3u = du + 0.5 * step * k2v, k3v = GetAcceleration(u + 0.5 * step * k2u);
+				double k4u = du + step * k3v, k4v = GetAcceleration(u + step * k3u);
+				double newU = u + step / 6.0 * (k1u + 2.0 * k2u + 2.0 * k3u + k4u);
+				double newDu = du + step / 6.0 * (k1v + 2.0 * k2v + 2.0 * k3v + k4v);
+
+				//reached infinity or the event horizon within this step
+				double angle = ((column - 1) * Substeps + i) * step;
+				if (newU <= 0.0 || newU >= uCapture)
+				{
+					captured = newU > 0.0;
+					double target = captured ? uCapture : 0.0;
+					endAngle = angle + step * (target - u) / (newU - u);
+					done = true;
+					break;
+				}
+				u = newU;
+				du = newDu;
+			}
+			orbit[column] = static_cast<float>(done ? (captured ? uCapture : 0.0) : u);
+		}
+		for (; column < AngleSamples; ++column)
+			orbit[column] = static_cast<float>(captured ? uCapture : 0.0);
+		ends[row * 2] = static_cast<float>(endAngle);
+		ends[row * 2 + 1] = captured ? 1.0f : 0.0f;
+	}
+
+	camRadius = _camRadius;
+	EHRad = _EHRad;
+	buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+/**
+ * Checks whether the table can be used for a camera and black hole
+ * @param _camRadius - distance from the camera to the black hole
+ * @param _EHRad - event horizon radius
+ * @return - true if it was built for them
+*/
+bool DeflectionTable::IsBuiltFor(float _camRadius, float _EHRad) const
+{
+	return camRadius > 0.0f && EHRad == _EHRad && std::abs(camRadius - _camRadius) <= RadiusTolerance * _camRadius;
+}
+
+/**
+ * Samples the orbits with bilinear filtering, like GL_LINEAR does
+ * @param _s - impact parameter over the camera distance
+ * @param _angle - orbital angle
+ * @return - 1 / r
+*/
+float DeflectionTable::GetInverseRadius(float _s, float _angle) const
+{
+	float x = std::clamp(_angle / MaxAngle * (AngleSamples - 1), 0.0f, static_cast<float>(AngleSamples - 1));
+	float y = std::clamp(_s * (ImpactSamples - 1), 0.0f, static_cast<float>(ImpactSamples - 1));
+	int x0 = static_cast<int>(x), y0 = static_cast<int>(y);
+	int x1 = std::min(x0 + 1, AngleSamples - 1), y1 = std::min(y0 + 1, ImpactSamples - 1);
+	float ax = x - x0, ay = y - y0;
+	auto at = [this](int _x, int _y) { return inverseRadius[static_cast<size_t>(_y) * AngleSamples + _x]; };
+	float bottom = at(x0, y0) + (at(x1, y0) - at(x0, y0)) * ax;
+	float top = at(x0, y1) + (at(x1, y1) - at(x0, y1)) * ax;
+	return bottom + (top - bottom) * ay;
+}
+
+/**
+ * Finds where the orbit of an impact parameter ends, interpolating between
+ * the rows around it if they end the same way (see TraceDeflectionTable in BlackHole.frag)
+ * @param _s - impact parameter over the camera distance
+ * @param _angle - orbital angle where the ray escapes or is captured
+ * @return - true if captured
+*/
+bool DeflectionTable::GetEnd(float _s, float& _angle) const
+{
+	float y = std::clamp(_s * (ImpactSamples - 1), 0.0f, static_cast<float>(ImpactSamples - 1));
+	int y0 = static_cast<int>(y), y1 = std::min(y0 + 1, ImpactSamples - 1);
+	float t = y - y0;
+	if (ends[y0 * 2 + 1] == ends[y1 * 2 + 1])
+	{
+		_angle = ends[y0 * 2] + (ends[y1 * 2] - ends[y0 * 2]) * t;
+		return ends[y0 * 2 + 1] > 0.5f;
+	}
+	int row = t < 0.5f ? y0 : y1;
+	_angle = ends[row * 2];
+	return ends[row * 2 + 1] > 0.5f;
+}
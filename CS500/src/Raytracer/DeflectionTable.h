@@ -0,0 +1,48 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the Deflection Table class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <vector>
+
+/**
+ * Orbits of every ray leaving a camera at a given distance from the black
+ * hole. Geodesics are planar: in the plane of the camera, the black hole and
+ * the ray, the orbit r(phi) only depends on the impact parameter, so one row
+ * per impact parameter holds all of them. The shader rebuilds the ray from
+ * its orbital plane: the final direction is the radial direction at the
+ * angle where r reaches infinity, and the disk is crossed wherever the orbit
+ * goes through the line where its plane meets the disk plane.
+ *
+ * Rows are indexed by s = b / camRadius, the sine of the angle between the
+ * ray and the direction to the black hole (s in [0, 1], inbound rays only).
+ * Columns are orbital angles from 0 (the camera) to MaxAngle. The orbit is
+ * stored as 1 / r, which is 0 at infinity. The black hole is at the origin.
+ */
+class DeflectionTable
+{
+public:
+	static const int ImpactSamples = 2048;
+	static const int AngleSamples = 1024;
+	static const float MaxAngle;
+
+	void Build(float _camRadius, float _EHRad);
+	bool IsBuiltFor(float _camRadius, float _EHRad) const;
+	float GetInverseRadius(float _s, float _angle) const;
+	bool GetEnd(float _s, float& _angle) const;
+
+	//parameters the table was built for (0 if it was not)
+	float camRadius = 0.0f;
+	float EHRad = 0.0f;
+	//AngleSamples values of 1 / r per row
+	std::vector<float> inverseRadius{};
+	//two values per row: orbital angle where the ray escapes (or is captured), and 1 if captured
+	std::vector<float> ends{};
+	double buildMs = 0.0;
+};
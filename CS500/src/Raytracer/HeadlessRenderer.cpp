@@ -0,0 +1,384 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the headless renderer
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "../Utilities/pch.hpp"
+#include "../Utilities/ThreadPool.h"
+#include "CpuTracer.h"
+#include "HeadlessRenderer.h"
+
+namespace
+{
+	//the application advances the timeElapsed uniform this much every frame
+	static const float FrameTime = 0.008f;
+
+	/**
+	 * Prints the options of the headless mode
+	*/
+	void PrintUsage()
+	{
+		std::cout << "usage: --render <out.ppm|out.pfm> [options]" << std::endl
+			<< "  --size <width>x<height>        image size (default 1280x720)" << std::endl
+			<< "  --camera <theta>,<phi>,<radius> orbit of the camera (default 0,0.2,20)" << std::endl
+			<< "  --time <t>                     value of the timeElapsed uniform (default 0)" << std::endl
+			<< "  --frames <n>                   renders n frames, out_0000.ppm, out_0001.ppm..." << std::endl
+			<< "  --sky <dir>                    skybox faces (default Resources/Cubemaps/Nebula)" << std::endl
+			<< "  --max-sky <size>               largest skybox face size" << std::endl
+			<< "  --no-lensing, --no-disk" << std::endl
+			<< "  --fixed-step                   fixed RK4 steps instead of the adaptive ones" << std::endl
+			<< "  --tolerance <e>                error allowed per adaptive step (default 1e-5)" << std::endl
+			<< "  --binet                        integrates the inverse radius over the angle of the orbit instead" << std::endl
+			<< "  --binet-step <radians>         orbital angle of each Binet step (default 0.05)" << std::endl
+			<< "  --deflection-table             rebuilds the rays from a precomputed table of orbits instead of marching them" << std::endl
+			<< "  --no-escape                    marches every ray to the end instead of finishing the outbound ones analytically" << std::endl
+			<< "  --isa <auto|scalar|avx2|avx512> instruction set of the packet kernel" << std::endl
+			<< "  --no-packets                   marches the rays one by one (the scalar reference)" << std::endl
+			<< "  --coarse <step>                traces one pixel every step (even) and only refines the tiles lensing distorts" << std::endl
+			<< "  --magnification <m>            stretch between the corners of a coarse tile that still interpolates (default 4)" << std::endl
+			<< "  --threads <n>                  worker threads (default one per hardware thread)" << std::endl
+			<< "  --stats                        prints the busy and idle time of every thread" << std::endl
+			<< "usage: --benchmark [--size, --camera, --no-lensing, --no-disk, --fixed-step, --tolerance, --no-escape, --binet-step]" << std::endl
+			<< "  marches the rays of a frame in one thread with every supported instruction set, then with every integrator" << std::endl
+			<< "ppm files are tone mapped like the application (without bloom), pfm files hold the HDR colors" << std::endl;
+	}
+
+	/**
+	 * Inserts a frame number before the extension of a path
+	 * @param _path - the path
+	 * @param _frame - the frame number
+	 * @return - i.e. out_0003.ppm
+	*/
+	std::string GetFramePath(const std::string& _path, int _frame)
+	{
+		char number[16];
+		std::snprintf(number, sizeof(number), "_%04d", _frame);
+		size_t dot = _path.find_last_of('.');
+		if (dot == std::string::npos)
+			return _path + number;
+		return _path.substr(0, dot) + number + _path.substr(dot);
+	}
+
+	/**
+	 * Marches every ray of a frame with each instruction set the CPU supports,
+	 * in the calling thread, and checks that they match the scalar kernel
+	 * @param _scene - the frame (textures are not needed)
+	 * @return - exit code, 1 if an instruction set gave different results
+	*/
+	int Benchmark(const TracerScene& _scene)
+	{
+		CpuTracer tracer(_scene);
+		size_t count = static_cast<size_t>(_scene.width) * _scene.height;
+		RayBatch batch, reference;
+		batch.Resize(count);
+		std::array<std::vector<float>, 3> dirs;
+		for (auto& dir : dirs)
+			dir.resize(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			glm::vec3 pos, dir;
+			tracer.GenerateRay((i % _scene.width) + 0.5f, (i / _scene.width) + 0.5f, pos, dir);
+			for (int c = 0; c < 3; ++c)
+			{
+				batch.pos[c][i] = pos[c];
+				dirs[c][i] = dir[c];
+			}
+		}
+
+		int result = 0;
+		const PacketKernel::Isa isas[] = { PacketKernel::Isa::SCALAR, PacketKernel::Isa::AVX2, PacketKernel::Isa::AVX512 };
+		for (auto isa : isas)
+		{
+			if (!PacketKernel::IsSupported(isa))
+			{
+				std::cout << PacketKernel::GetName(isa) << ": not supported" << std::endl;
+				continue;
+			}
+			batch.dir = dirs;
+			auto start = std::chrono::high_resolution_clock::now();
+			PacketKernel::March(tracer.GetPacketParams(), batch.GetRays(), 0, count, isa);
+			double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+			double steps = 0.0, saved = 0.0;
+			for (auto step : batch.steps)
+				steps += step;
+			for (auto step : batch.savedSteps)
+				saved += step;
+			bool identical = true;
+			if (isa == PacketKernel::Isa::SCALAR)
+				reference = batch;
+			else
+			{
+				identical = batch.dir == reference.dir && batch.escaped == reference.escaped && batch.steps == reference.steps
+					&& batch.savedSteps == reference.savedSteps && batch.crossingCount == reference.crossingCount && batch.crossings == reference.crossings;
+			}
+			std::cout << PacketKernel::GetName(isa) << " (" << PacketKernel::GetWidth(isa) << " wide): " << seconds * 1000.0 << " ms, "
+				<< count / seconds / 1e6 << " Mrays/s, " << steps / seconds / 1e6 << " Msteps/s, " << saved / count << " steps saved per ray"
+				<< (identical ? "" : ", DIFFERENT from scalar") << std::endl;
+			result |= identical ? 0 : 1;
+		}
+		return result;
+	}
+
+	/**
+	 * Traces every ray of a frame one by one in the calling thread with each
+	 * integrator, and compares where they end up with the Binet orbit at a
+	 * sixteenth of its step (the reference)
+	 * @param _scene - the frame (textures are not needed)
+	*/
+	void CompareIntegrators(const TracerScene& _scene)
+	{
+		struct Integrator
+		{
+			const char* name;
+			bool adaptiveStep;
+			bool binetOrbit;
+		};
+		const Integrator integrators[] = { { "reference", false, true }, { "rk4", false, false }, { "dormand-prince", true, false }, { "binet", false, true } };
+		size_t count = static_cast<size_t>(_scene.width) * _scene.height;
+		std::vector<glm::vec3> referenceDirs(count);
+		std::vector<unsigned char> referenceEscaped(count);
+		float pixelAngle = 1.0f / (_scene.width * _scene.focalLength);
+		for (const Integrator& integrator : integrators)
+		{
+			TracerScene scene = _scene;
+			scene.adaptiveStep = integrator.adaptiveStep;
+			scene.binetOrbit = integrator.binetOrbit;
+			bool reference = &integrator == integrators;
+			if (reference)
+				scene.binetStep /= 16.0f;
+			CpuTracer tracer(scene);
+
+			size_t sameFate = 0, escaped = 0;
+			double error = 0.0, maxError = 0.0;
+			auto start = std::chrono::high_resolution_clock::now();
+			for (size_t i = 0; i < count; ++i)
+			{
+				glm::vec3 color, dir;
+				bool escapes = tracer.TraceRay((i % scene.width) + 0.5f, (i / scene.width) + 0.5f, color, dir);
+				if (reference)
+				{
+					referenceDirs[i] = glm::normalize(dir);
+					referenceEscaped[i] = escapes;
+					continue;
+				}
+				sameFate += escapes == (referenceEscaped[i] != 0) ? 1 : 0;
+				if (escapes && referenceEscaped[i])
+				{
+					//in pixels at the center of the screen
+					double angle = glm::length(glm::normalize(dir) - referenceDirs[i]) / pixelAngle;
+					error += angle;
+					maxError = std::max(maxError, angle);
+					escaped++;
+				}
+			}
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			CpuTracer::MarchStats march = tracer.GetMarchStats();
+			if (reference)
+				continue;
+			std::cout << integrator.name << ": " << ms << " ms, " << static_cast<double>(march.steps) / march.rays << " steps per ray, "
+				<< 100.0 * sameFate / count << "% of the rays end like the reference, escape direction off by "
+				<< (escaped ? error / escaped : 0.0) << " pixels (" << maxError << " at most)" << std::endl;
+		}
+	}
+
+	/**
+	 * Parses the name of an instruction set
+	 * @param _name - i.e. avx2
+	 * @param _isa - the instruction set
+	 * @return - false if unknown
+	*/
+	bool ParseIsa(const std::string& _name, PacketKernel::Isa& _isa)
+	{
+		const PacketKernel::Isa isas[] = { PacketKernel::Isa::AUTO, PacketKernel::Isa::SCALAR, PacketKernel::Isa::AVX2, PacketKernel::Isa::AVX512 };
+		for (auto isa : isas)
+		{
+			if (_name == PacketKernel::GetName(isa))
+			{
+				_isa = isa;
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+/**
+ * Parses the command line and renders the frames
+ * @param _argc - number of arguments
+ * @param _args - arguments, the options are looked for after the first one
+ * @return - exit code
+*/
+int HeadlessRenderer::Run(int _argc, char* _args[])
+{
+	TracerScene scene;
+	std::string out, skyDir = "Resources/Cubemaps/Nebula";
+	float theta = 0.0f, phi = 0.2f, radius = 20.0f;
+	int frames = 1, maxSkySize = 0;
+	int threads = 0;
+	bool benchmark = false, printStats = false, useTable = false;
+	for (int i = 1; i < _argc; ++i)
+	{
+		std::string arg = _args[i];
+		bool hasValue = i + 1 < _argc;
+		if (arg == "--render" && hasValue)
+			out = _args[++i];
+		else if (arg == "--size" && hasValue)
+			std::sscanf(_args[++i], "%dx%d", &scene.width, &scene.height);
+		else if (arg == "--camera" && hasValue)
+			std::sscanf(_args[++i], "%f,%f,%f", &theta, &phi, &radius);
+		else if (arg == "--time" && hasValue)
+			scene.timeElapsed = static_cast<float>(std::atof(_args[++i]));
+		else if (arg == "--frames" && hasValue)
+			frames = std::atoi(_args[++i]);
+		else if (arg == "--sky" && hasValue)
+			skyDir = _args[++i];
+		else if (arg == "--max-sky" && hasValue)
+			maxSkySize = std::atoi(_args[++i]);
+		else if (arg == "--no-lensing")
+			scene.applyLensing = false;
+		else if (arg == "--no-disk")
+			scene.renderDisk = false;
+		else if (arg == "--fixed-step")
+			scene.adaptiveStep = false;
+		else if (arg == "--binet")
+			scene.binetOrbit = true;
+		else if (arg == "--binet-step" && hasValue)
+			scene.binetStep = static_cast<float>(std::atof(_args[++i]));
+		else if (arg == "--tolerance" && hasValue)
+			scene.stepTolerance = static_cast<float>(std::atof(_args[++i]));
+		else if (arg == "--deflection-table")
+			useTable = true;
+		else if (arg == "--no-escape")
+			scene.analyticEscape = false;
+		else if (arg == "--isa" && hasValue && ParseIsa(_args[i + 1], scene.isa))
+			++i;
+		else if (arg == "--no-packets")
+			scene.usePackets = false;
+		else if (arg == "--coarse" && hasValue)
+			scene.coarseStep = std::atoi(_args[++i]);
+		else if (arg == "--magnification" && hasValue)
+			scene.coarseMagnification = static_cast<float>(std::atof(_args[++i]));
+		else if (arg == "--benchmark")
+			benchmark = true;
+		else if (arg == "--threads" && hasValue)
+			threads = std::atoi(_args[++i]);
+		else if (arg == "--stats")
+			printStats = true;
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+	if (benchmark && scene.width > 0 && scene.height > 0)
+	{
+		scene.camera = TracerCamera::Orbit(theta, phi, radius);
+		int result = Benchmark(scene);
+		CompareIntegrators(scene);
+		return result;
+	}
+	if (out.empty() || scene.width <= 0 || scene.height <= 0 || frames <= 0 || scene.coarseStep < 0 || scene.coarseStep % 2)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	if (threads > 0)
+	{
+		Workers.Shutdown();
+		Workers.Initialize(static_cast<unsigned>(threads));
+	}
+
+	TracerImages images;
+	if (!images.Load(skyDir, maxSkySize))
+		std::cout << "Some textures failed to load, they will be black" << std::endl;
+	images.Bind(scene);
+	scene.camera = TracerCamera::Orbit(theta, phi, radius);
+	DeflectionTable table;
+	if (useTable)
+	{
+		table.Build(glm::length(scene.camera.position - scene.BHPos), scene.EHRad);
+		std::cout << "Deflection table built in " << table.buildMs << " ms" << std::endl;
+		scene.deflectionTable = &table;
+	}
+
+	std::vector<glm::vec3> hdr;
+	double savedSteps = 0.0;
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		CpuTracer tracer(scene);
+		TileScheduler::Stats stats = tracer.Render(hdr);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		std::string path = frames > 1 ? GetFramePath(out, frame) : out;
+		if (!WriteImage(path, scene.width, scene.height, hdr))
+		{
+			std::cout << "Could not write " << path << std::endl;
+			return 1;
+		}
+		const char* isa = PacketKernel::GetName(scene.isa == PacketKernel::Isa::AUTO ? PacketKernel::GetSupportedIsa() : scene.isa);
+		std::cout << "Rendered " << path << " (" << scene.width << "x" << scene.height << ") in " << ms << " ms ("
+			<< (scene.coarseStep > 1 ? "coarse to fine, " : "")
+			<< (scene.deflectionTable ? "deflection table" : scene.binetOrbit ? "Binet orbit" : scene.usePackets ? isa : "no packets") << ")" << std::endl;
+		CpuTracer::MarchStats march = tracer.GetMarchStats();
+		if (scene.coarseStep > 1)
+			std::cout << "Rays traced: " << 100.0 * march.rays / (static_cast<double>(scene.width) * scene.height) << "% of the pixels" << std::endl;
+		std::cout << "Steps: " << march.steps << " (" << static_cast<double>(march.steps) / march.rays << " per ray), "
+			<< march.savedSteps << " saved (" << static_cast<double>(march.savedSteps) / march.rays << " per ray), "
+			<< 100.0 * march.analyticEscapes / march.rays << "% of the rays escaped analytically" << std::endl;
+		savedSteps += static_cast<double>(march.savedSteps);
+		if (printStats)
+			stats.Log();
+		scene.timeElapsed += FrameTime;
+	}
+	if (frames > 1)
+		std::cout << "Average steps saved per frame: " << savedSteps / frames << std::endl;
+	return 0;
+}
+
+/**
+ * Writes a frame, tone mapped to a binary PPM or as the raw HDR colors to a PFM
+ * @param _path - file to write, the extension picks the format
+ * @param _width - width of the frame
+ * @param _height - height of the frame
+ * @param _hdr - HDR colors, row by row from the bottom
+ * @return - true if success, false otherwise
+*/
+bool HeadlessRenderer::WriteImage(const std::string& _path, int _width, int _height, const std::vector<glm::vec3>& _hdr)
+{
+	std::ofstream file(_path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	if (_path.size() >= 4 && _path.compare(_path.size() - 4, 4, ".pfm") == 0)
+	{
+		//PFM rows go from the bottom as well, a negative scale means little endian
+		file << "PF\n" << _width << " " << _height << "\n-1.0\n";
+		file.write(reinterpret_cast<const char*>(_hdr.data()), static_cast<std::streamsize>(_hdr.size() * sizeof(glm::vec3)));
+		return static_cast<bool>(file);
+	}
+
+	file << "P6\n" << _width << " " << _height << "\n255\n";
+	std::vector<unsigned char> row(static_cast<size_t>(_width) * 3);
+	for (int y = _height - 1; y >= 0; --y)
+	{
+		for (int x = 0; x < _width; ++x)
+		{
+			glm::vec3 color = CpuTracer::ToneMap(_hdr[static_cast<size_t>(y) * _width + x]);
+			for (int c = 0; c < 3; ++c)
+				row[x * 3 + c] = static_cast<unsigned char>(color[c] * 255.0f + 0.5f);
+		}
+		file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+	}
+	return static_cast<bool>(file);
+}
@@ -0,0 +1,24 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the headless renderer
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * Renders frames with the CPU tracer and writes them to disk, without any
+ * window or GPU. Used by "cs500_j.zapata --render" and by the render tool
+ */
+namespace HeadlessRenderer
+{
+	int Run(int _argc, char* _args[]);
+	bool WriteImage(const std::string& _path, int _width, int _height, const std::vector<glm::vec3>& _hdr);
+}
@@ -0,0 +1,170 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the scalar packet kernel and the runtime
+//					dispatch to the instruction set the CPU supports
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include <cmath>
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+#include "PacketKernelImpl.h"
+
+namespace
+{
+	//one lane packets, the fallback of every CPU
+	struct ScalarFloat
+	{
+		static const int Width = 1;
+
+		struct Mask
+		{
+			bool m;
+			static Mask And(Mask _a, Mask _b) { return { _a.m && _b.m }; }
+			static Mask Or(Mask _a, Mask _b) { return { _a.m || _b.m }; }
+			static Mask AndNot(Mask _a, Mask _b) { return { _a.m && !_b.m }; }
+			static Mask FromBits(unsigned _bits) { return { (_bits & 1u) != 0 }; }
+			unsigned Bits() const { return m ? 1u : 0u; }
+		};
+
+		float v;
+		static ScalarFloat Set(float _x) { return { _x }; }
+		static ScalarFloat Load(const float* _p) { return { *_p }; }
+		void Store(float* _p) const { *_p = v; }
+		static ScalarFloat Sqrt(ScalarFloat _a) { return { std::sqrt(_a.v) }; }
+		//same operand order as minps/maxps: the second one if either is NaN
+		static ScalarFloat Min(ScalarFloat _a, ScalarFloat _b) { return { _a.v < _b.v ? _a.v : _b.v }; }
+		static ScalarFloat Max(ScalarFloat _a, ScalarFloat _b) { return { _a.v > _b.v ? _a.v : _b.v }; }
+		static ScalarFloat Abs(ScalarFloat _a) { return { std::fabs(_a.v) }; }
+		static ScalarFloat Select(Mask _m, ScalarFloat _a, ScalarFloat _b) { return _m.m ? _a : _b; }
+		static Mask LessEqual(ScalarFloat _a, ScalarFloat _b) { return { _a.v <= _b.v }; }
+		static Mask GreaterEqual(ScalarFloat _a, ScalarFloat _b) { return { _a.v >= _b.v }; }
+		static Mask NotEqual(ScalarFloat _a, ScalarFloat _b) { return { _a.v != _b.v }; }
+		ScalarFloat operator+(ScalarFloat _b) const { return { v + _b.v }; }
+		ScalarFloat operator-(ScalarFloat _b) const { return { v - _b.v }; }
+		ScalarFloat operator*(ScalarFloat _b) const { return { v * _b.v }; }
+		ScalarFloat operator/(ScalarFloat _b) const { return { v / _b.v }; }
+	};
+
+	/**
+	 * Asks the CPU (and the OS, which has to save the wider registers) for the widest instruction set
+	 * @return - the widest instruction set that can run
+	*/
+	PacketKernel::Isa DetectIsa()
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		int info[4]{};
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return PacketKernel::Isa::SCALAR;
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		if (!osxsave)
+			return PacketKernel::Isa::SCALAR;
+		const unsigned long long xcr0 = _xgetbv(0);
+		__cpuidex(info, 7, 0);
+		//the OS saves the upper halves of ymm (and zmm and the mask registers)
+		if ((xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16)))
+			return PacketKernel::Isa::AVX512;
+		if ((xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)))
+			return PacketKernel::Isa::AVX2;
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f"))
+			return PacketKernel::Isa::AVX512;
+		if (__builtin_cpu_supports("avx2"))
+			return PacketKernel::Isa::AVX2;
+#endif
+		return PacketKernel::Isa::SCALAR;
+	}
+}
+
+/**
+ * Returns the widest instruction set of this CPU, detected only once
+ * @return - the instruction set used by AUTO
+*/
+PacketKernel::Isa PacketKernel::GetSupportedIsa()
+{
+	static const Isa isa = DetectIsa();
+	return isa;
+}
+
+/**
+ * Checks whether an instruction set can run on this CPU
+ * @param _isa - instruction set
+ * @return - true if it can be used
+*/
+bool PacketKernel::IsSupported(Isa _isa)
+{
+	return _isa == Isa::AUTO || static_cast<int>(_isa) <= static_cast<int>(GetSupportedIsa());
+}
+
+/**
+ * Returns the name of an instruction set
+ * @param _isa - instruction set
+ * @return - the name, as given to --isa
+*/
+const char* PacketKernel::GetName(Isa _isa)
+{
+	switch (_isa)
+	{
+	case Isa::SCALAR: return "scalar";
+	case Isa::AVX2: return "avx2";
+	case Isa::AVX512: return "avx512";
+	default: return "auto";
+	}
+}
+
+/**
+ * Returns the number of rays marched at once
+ * @param _isa - instruction set
+ * @return - lanes per packet
+*/
+int PacketKernel::GetWidth(Isa _isa)
+{
+	switch (_isa == Isa::AUTO ? GetSupportedIsa() : _isa)
+	{
+	case Isa::AVX2: return 8;
+	case Isa::AVX512: return 16;
+	default: return 1;
+	}
+}
+
+/**
+ * Marches a range of rays with the given instruction set, or with the widest
+ * supported one. Instruction sets the CPU does not support fall back to it
+ * @param _params - the black hole
+ * @param _rays - the rays
+ * @param _begin - first ray
+ * @param _end - one past the last ray
+ * @param _isa - instruction set
+*/
+void PacketKernel::March(const Params& _params, const Rays& _rays, size_t _begin, size_t _end, Isa _isa)
+{
+	if (!IsSupported(_isa) || _isa == Isa::AUTO)
+		_isa = GetSupportedIsa();
+	switch (_isa)
+	{
+	case Isa::AVX512: MarchAvx512(_params, _rays, _begin, _end); break;
+	case Isa::AVX2: MarchAvx2(_params, _rays, _begin, _end); break;
+	default: MarchScalar(_params, _rays, _begin, _end); break;
+	}
+}
+
+/**
+ * Marches the rays one at a time
+ * @param _params - the black hole
+ * @param _rays - the rays
+ * @param _begin - first ray
+ * @param _end - one past the last ray
+*/
+void PacketKernel::MarchScalar(const Params& _params, const Rays& _rays, size_t _begin, size_t _end)
+{
+	MarchPackets<ScalarFloat>(_params, _rays, _begin, _end);
+}
@@ -0,0 +1,82 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the packet kernel
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <cstddef>
+
+/**
+ * RK4 (or adaptive Dormand-Prince) geodesic integration of many rays at once: 8 (AVX2) or 16 (AVX-512)
+ * lanes per packet, in structure of arrays layout. Capture by the event
+ * horizon, disk crossings, analytic escapes and the end of the march are
+ * tracked with lane masks. Every instruction set runs the same operations in the same order
+ * (no fused multiply-add), so their results are bit for bit equal to the
+ * scalar fallback.
+ *
+ * The kernel only moves the rays: it records where they cross the disk and
+ * where they escape to, the shading is done afterwards by the caller.
+ */
+namespace PacketKernel
+{
+	enum class Isa { AUTO, SCALAR, AVX2, AVX512 };
+
+	//disk crossings recorded per ray, the rest are ignored
+	static const int MaxCrossings = 8;
+
+	struct Params
+	{
+		float BHPos[3]{};
+		float EHRad = 1.0f;
+		float innerDiskRad = 2.0f;
+		float outerDiskRad = 8.0f;
+		float stepSize = 0.1f;
+		int maxSteps = 300;
+		bool applyLensing = true;
+		bool renderDisk = true;
+		//Dormand-Prince steps (maxSteps counts the rejected ones as well)
+		bool adaptive = false;
+		float tolerance = 1e-5f;
+		float marchLength = 30.0f;
+		float minStep = 0.001f;
+		float stepDistanceRatio = 0.5f;
+		//rays heading away from the black hole past escapeRadius leave the march
+		//once the square of the bending left (in radians) is below escapeBend2
+		bool analyticEscape = false;
+		float escapeRadius = 8.0f;
+		float escapeBend2 = 0.0f;
+	};
+
+	/**
+	 * Rays to march, as separate arrays of count elements (crossings have
+	 * count * MaxCrossings). The directions are overwritten with the final ones
+	 */
+	struct Rays
+	{
+		size_t count{};
+		const float* pos[3]{};
+		float* dir[3]{};
+		unsigned char* escaped{};
+		unsigned short* steps{};
+		//steps skipped by the analytic escape, 0 if the ray did not take it
+		unsigned short* savedSteps{};
+		unsigned char* crossingCount{};
+		float* crossings[3]{};
+	};
+
+	Isa GetSupportedIsa();
+	bool IsSupported(Isa _isa);
+	const char* GetName(Isa _isa);
+	int GetWidth(Isa _isa);
+	void March(const Params& _params, const Rays& _rays, size_t _begin, size_t _end, Isa _isa = Isa::AUTO);
+
+	//one per instruction set, see PacketKernelImpl.h
+	void MarchScalar(const Params& _params, const Rays& _rays, size_t _begin, size_t _end);
+	void MarchAvx2(const Params& _params, const Rays& _rays, size_t _begin, size_t _end);
+	void MarchAvx512(const Params& _params, const Rays& _rays, size_t _begin, size_t _end);
+}
@@ -0,0 +1,75 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the AVX2 packet kernel (8 lanes). It is
+//					the only file compiled for AVX2, it is only called when the
+//					CPU supports it
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#include "PacketKernelImpl.h"
+
+namespace
+{
+	struct Avx2Float
+	{
+		static const int Width = 8;
+
+		struct Mask
+		{
+			__m256 m;
+			static Mask And(Mask _a, Mask _b) { return { _mm256_and_ps(_a.m, _b.m) }; }
+			static Mask Or(Mask _a, Mask _b) { return { _mm256_or_ps(_a.m, _b.m) }; }
+			static Mask AndNot(Mask _a, Mask _b) { return { _mm256_andnot_ps(_b.m, _a.m) }; }
+			static Mask FromBits(unsigned _bits)
+			{
+				const __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+				__m256i bits = _mm256_and_si256(_mm256_set1_epi32(static_cast<int>(_bits)), lanes);
+				return { _mm256_castsi256_ps(_mm256_cmpeq_epi32(bits, lanes)) };
+			}
+			unsigned Bits() const { return static_cast<unsigned>(_mm256_movemask_ps(m)); }
+		};
+
+		__m256 v;
+		static Avx2Float Set(float _x) { return { _mm256_set1_ps(_x) }; }
+		static Avx2Float Load(const float* _p) { return { _mm256_load_ps(_p) }; }
+		void Store(float* _p) const { _mm256_store_ps(_p, v); }
+		static Avx2Float Sqrt(Avx2Float _a) { return { _mm256_sqrt_ps(_a.v) }; }
+		static Avx2Float Min(Avx2Float _a, Avx2Float _b) { return { _mm256_min_ps(_a.v, _b.v) }; }
+		static Avx2Float Max(Avx2Float _a, Avx2Float _b) { return { _mm256_max_ps(_a.v, _b.v) }; }
+		static Avx2Float Abs(Avx2Float _a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _a.v) }; }
+		static Avx2Float Select(Mask _m, Avx2Float _a, Avx2Float _b) { return { _mm256_blendv_ps(_b.v, _a.v, _m.m) }; }
+		static Mask LessEqual(Avx2Float _a, Avx2Float _b) { return { _mm256_cmp_ps(_a.v, _b.v, _CMP_LE_OQ) }; }
+		static Mask GreaterEqual(Avx2Float _a, Avx2Float _b) { return { _mm256_cmp_ps(_a.v, _b.v, _CMP_GE_OQ) }; }
+		static Mask NotEqual(Avx2Float _a, Avx2Float _b) { return { _mm256_cmp_ps(_a.v, _b.v, _CMP_NEQ_OQ) }; }
+		Avx2Float operator+(Avx2Float _b) const { return { _mm256_add_ps(v, _b.v) }; }
+		Avx2Float operator-(Avx2Float _b) const { return { _mm256_sub_ps(v, _b.v) }; }
+		Avx2Float operator*(Avx2Float _b) const { return { _mm256_mul_ps(v, _b.v) }; }
+		Avx2Float operator/(Avx2Float _b) const { return { _mm256_div_ps(v, _b.v) }; }
+	};
+}
+
+/**
+ * Marches the rays 8 at a time
+ * @param _params - the black hole
+ * @param _rays - the rays
+ * @param _begin - first ray
+ * @param _end - one past the last ray
+*/
+void PacketKernel::MarchAvx2(const Params& _params, const Rays& _rays, size_t _begin, size_t _end)
+{
+	MarchPackets<Avx2Float>(_params, _rays, _begin, _end);
+}
+#else
+#include "PacketKernel.h"
+
+void PacketKernel::MarchAvx2(const Params& _params, const Rays& _rays, size_t _begin, size_t _end)
+{
+	MarchScalar(_params, _rays, _begin, _end);
+}
+#endif
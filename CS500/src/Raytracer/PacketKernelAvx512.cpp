@@ -0,0 +1,70 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the AVX-512 packet kernel (16 lanes). It
+//					is the only file compiled for AVX-512, it is only called
+//					when the CPU supports it
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#include "PacketKernelImpl.h"
+
+namespace
+{
+	struct Avx512Float
+	{
+		static const int Width = 16;
+
+		struct Mask
+		{
+			__mmask16 m;
+			static Mask And(Mask _a, Mask _b) { return { static_cast<__mmask16>(_a.m & _b.m) }; }
+			static Mask Or(Mask _a, Mask _b) { return { static_cast<__mmask16>(_a.m | _b.m) }; }
+			static Mask AndNot(Mask _a, Mask _b) { return { static_cast<__mmask16>(_a.m & ~_b.m) }; }
+			static Mask FromBits(unsigned _bits) { return { static_cast<__mmask16>(_bits) }; }
+			unsigned Bits() const { return m; }
+		};
+
+		__m512 v;
+		static Avx512Float Set(float _x) { return { _mm512_set1_ps(_x) }; }
+		static Avx512Float Load(const float* _p) { return { _mm512_load_ps(_p) }; }
+		void Store(float* _p) const { _mm512_store_ps(_p, v); }
+		static Avx512Float Sqrt(Avx512Float _a) { return { _mm512_sqrt_ps(_a.v) }; }
+		static Avx512Float Min(Avx512Float _a, Avx512Float _b) { return { _mm512_min_ps(_a.v, _b.v) }; }
+		static Avx512Float Max(Avx512Float _a, Avx512Float _b) { return { _mm512_max_ps(_a.v, _b.v) }; }
+		static Avx512Float Abs(Avx512Float _a) { return { _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(_a.v), _mm512_set1_epi32(0x7fffffff))) }; }
+		static Avx512Float Select(Mask _m, Avx512Float _a, Avx512Float _b) { return { _mm512_mask_blend_ps(_m.m, _b.v, _a.v) }; }
+		static Mask LessEqual(Avx512Float _a, Avx512Float _b) { return { _mm512_cmp_ps_mask(_a.v, _b.v, _CMP_LE_OQ) }; }
+		static Mask GreaterEqual(Avx512Float _a, Avx512Float _b) { return { _mm512_cmp_ps_mask(_a.v, _b.v, _CMP_GE_OQ) }; }
+		static Mask NotEqual(Avx512Float _a, Avx512Float _b) { return { _mm512_cmp_ps_mask(_a.v, _b.v, _CMP_NEQ_OQ) }; }
+		Avx512Float operator+(Avx512Float _b) const { return { _mm512_add_ps(v, _b.v) }; }
+		Avx512Float operator-(Avx512Float _b) const { return { _mm512_sub_ps(v, _b.v) }; }
+		Avx512Float operator*(Avx512Float _b) const { return { _mm512_mul_ps(v, _b.v) }; }
+		Avx512Float operator/(Avx512Float _b) const { return { _mm512_div_ps(v, _b.v) }; }
+	};
+}
+
+/**
+ * Marches the rays 16 at a time
+ * @param _params - the black hole
+ * @param _rays - the rays
+ * @param _begin - first ray
+ * @param _end - one past the last ray
+*/
+void PacketKernel::MarchAvx512(const Params& _params, const Rays& _rays, size_t _begin, size_t _end)
+{
+	MarchPackets<Avx512Float>(_params, _rays, _begin, _end);
+}
+#else
+#include "PacketKernel.h"
+
+void PacketKernel::MarchAvx512(const Params& _params, const Rays& _rays, size_t _begin, size_t _end)
+{
+	MarchScalar(_params, _rays, _begin, _end);
+}
+#endif
@@ -0,0 +1,492 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the packet kernel, written once for
+//					every instruction set
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include "PacketKernel.h"
+
+/*
+ * The kernel is a template on V, which wraps a SIMD register of floats and provides:
+ *  - Load, Store, Set, the arithmetic operators, Sqrt, Min, Max and Abs,
+ *  - V::Mask, with LessEqual, GreaterEqual, NotEqual, And, Or, AndNot (a & ~b),
+ *    Select (mask ? a : b), Bits (one bit per lane) and FromBits.
+ * Only included by the translation units of each instruction set, which are
+ * compiled for it, so it must not include any standard header.
+ */
+
+/**
+ * Rays of a packet, one lane each
+ */
+template <typename V>
+struct PacketState
+{
+	V px, py, pz;
+	V dx, dy, dz;
+	//rays still marching, and rays that got through the whole march
+	typename V::Mask active;
+	typename V::Mask escaped;
+	V steps;
+	//steps skipped by the analytic escape
+	V savedSteps;
+};
+
+/**
+ * Stores the disk crossings of the lanes of a mask, in the order they happen
+ * @param _rays - the rays
+ * @param _base - index of the first lane
+ * @param _bits - lanes that crossed the disk
+ * @param _x - x of the crossings
+ * @param _y - y of the crossings
+ * @param _z - z of the crossings
+*/
+template <typename V>
+void RecordCrossings(const PacketKernel::Rays& _rays, size_t _base, unsigned _bits, V _x, V _y, V _z)
+{
+	alignas(64) float points[3][V::Width];
+	_x.Store(points[0]);
+	_y.Store(points[1]);
+	_z.Store(points[2]);
+	for (int l = 0; l < V::Width; ++l)
+	{
+		if (!(_bits & (1u << l)))
+			continue;
+		size_t ray = _base + l;
+		unsigned char& n = _rays.crossingCount[ray];
+		if (n < PacketKernel::MaxCrossings)
+		{
+			for (int c = 0; c < 3; ++c)
+				_rays.crossings[c][ray * PacketKernel::MaxCrossings + n] = points[c][l];
+			n++;
+		}
+	}
+}
+
+/**
+ * Acceleration of the geodesic, see SchwarzschildGeodesic in BlackHole.frag
+*/
+template <typename V>
+void GeodesicAcceleration(V _k, V _bhx, V _bhy, V _bhz, V _x, V _y, V _z, V& _ax, V& _ay, V& _az)
+{
+	V rx = _x - _bhx, ry = _y - _bhy, rz = _z - _bhz;
+	V r2 = rx * rx + ry * ry + rz * rz;
+	V r5 = r2 * r2 * V::Sqrt(r2);
+	_ax = _k * _x / r5;
+	_ay = _k * _y / r5;
+	_az = _k * _z / r5;
+}
+
+/**
+ * Deflection the rays still get on their way to infinity, see GetRemainingDeflection in BlackHole.frag
+ * @param _h2 - square of the angular momentum (0 if light is not bent)
+ * @param _rx - x of the position relative to the black hole
+ * @param _ry - y of the position relative to the black hole
+ * @param _rz - z of the position relative to the black hole
+ * @param _r2 - squared distance to the black hole
+ * @param _state - the packet
+ * @param _fx - x of the deflection
+ * @param _fy - y of the deflection
+ * @param _fz - z of the deflection
+*/
+template <typename V>
+void GetRemainingDeflection(V _h2, V _rx, V _ry, V _rz, V _r2, const PacketState<V>& _state, V& _fx, V& _fy, V& _fz)
+{
+	const V one = V::Set(1.0f), two = V::Set(2.0f), three = V::Set(3.0f);
+	const V& dx = _state.dx; const V& dy = _state.dy; const V& dz = _state.dz;
+	V v = V::Sqrt(dx * dx + dy * dy + dz * dz);
+	V ux = dx / v, uy = dy / v, uz = dz / v;
+	V along = _rx * ux + _ry * uy + _rz * uz;
+	V qx = _rx - along * ux, qy = _ry - along * uy, qz = _rz - along * uz;
+	V q = V::Min((qx * qx + qy * qy + qz * qz) / _r2, one);
+	V f = (three + q) / (two + V::Sqrt(one - q) * (two + q));
+	V scale = V::Set(-0.5f) * _h2 / (v * _r2 * _r2);
+	V r = V::Sqrt(_r2);
+	_fx = scale * (r * ux + f * qx);
+	_fy = scale * (r * uy + f * qy);
+	_fz = scale * (r * uz + f * qz);
+}
+
+/**
+ * Finishes the march of the lanes heading away from the black hole whose
+ * bending left is small enough, see EscapeAnalytically in BlackHole.frag
+ * @param _params - the black hole
+ * @param _h2 - square of the angular momentum (0 if light is not bent)
+ * @param _rx - x of the position relative to the black hole
+ * @param _ry - y of the position relative to the black hole
+ * @param _rz - z of the position relative to the black hole
+ * @param _r2 - squared distance to the black hole
+ * @param _state - the packet, the lanes that escape get their direction at infinity
+ * @return - the lanes that escaped
+*/
+template <typename V>
+typename V::Mask EscapeAnalytically(const PacketKernel::Params& _params, V _h2, V _rx, V _ry, V _rz, V _r2, PacketState<V>& _state)
+{
+	using Mask = typename V::Mask;
+	V& dx = _state.dx; V& dy = _state.dy; V& dz = _state.dz;
+	Mask leaving = Mask::And(_state.active, V::GreaterEqual(_r2, V::Set(_params.escapeRadius * _params.escapeRadius)));
+	leaving = Mask::AndNot(leaving, V::LessEqual(_rx * dx + _ry * dy + _rz * dz, V::Set(0.0f)));
+	if (!leaving.Bits())
+		return leaving;
+
+	//only the bending perpendicular to the ray changes where it ends up
+	V fx, fy, fz;
+	GetRemainingDeflection(_h2, _rx, _ry, _rz, _r2, _state, fx, fy, fz);
+	V v2 = dx * dx + dy * dy + dz * dz;
+	V radial = (fx * dx + fy * dy + fz * dz) / v2;
+	V bx = fx - radial * dx, by = fy - radial * dy, bz = fz - radial * dz;
+	leaving = Mask::And(leaving, V::LessEqual(bx * bx + by * by + bz * bz, V::Set(_params.escapeBend2) * v2));
+	dx = V::Select(leaving, dx + fx, dx);
+	dy = V::Select(leaving, dy + fy, dy);
+	dz = V::Select(leaving, dz + fz, dz);
+	return leaving;
+}
+
+/**
+ * Bends the lanes that reached the end of the march heading away from the
+ * black hole the rest of the way, see FinishEscape in BlackHole.frag
+ * @param _params - the black hole
+ * @param _h2 - square of the angular momentum (0 if light is not bent)
+ * @param _lanes - lanes that reached the end of the march
+ * @param _state - the packet
+*/
+template <typename V>
+void FinishEscape(const PacketKernel::Params& _params, V _h2, typename V::Mask _lanes, PacketState<V>& _state)
+{
+	using Mask = typename V::Mask;
+	V& dx = _state.dx; V& dy = _state.dy; V& dz = _state.dz;
+	V rx = _state.px - V::Set(_params.BHPos[0]), ry = _state.py - V::Set(_params.BHPos[1]), rz = _state.pz - V::Set(_params.BHPos[2]);
+	Mask outbound = Mask::AndNot(_lanes, V::LessEqual(rx * dx + ry * dy + rz * dz, V::Set(0.0f)));
+	if (!outbound.Bits())
+		return;
+	V fx, fy, fz;
+	GetRemainingDeflection(_h2, rx, ry, rz, rx * rx + ry * ry + rz * rz, _state, fx, fy, fz);
+	dx = V::Select(outbound, dx + fx, dx);
+	dy = V::Select(outbound, dy + fy, dy);
+	dz = V::Select(outbound, dz + fz, dz);
+}
+
+/**
+ * Marches a packet with fixed RK4 steps, see RayMarch in BlackHole.frag
+ * @param _params - the black hole
+ * @param _rays - the rays
+ * @param _base - index of the first lane
+ * @param _state - the packet
+*/
+template <typename V>
+void MarchFixed(const PacketKernel::Params& _params, const PacketKernel::Rays& _rays, size_t _base, PacketState<V>& _state)
+{
+	using Mask = typename V::Mask;
+	const V zero = V::Set(0.0f), one = V::Set(1.0f), two = V::Set(2.0f);
+	const V bhx = V::Set(_params.BHPos[0]), bhy = V::Set(_params.BHPos[1]), bhz = V::Set(_params.BHPos[2]);
+	const V ehRad2 = V::Set(_params.EHRad * _params.EHRad);
+	const V innerRad2 = V::Set(_params.innerDiskRad * _params.innerDiskRad);
+	const V outerRad2 = V::Set(_params.outerDiskRad * _params.outerDiskRad);
+	const V step = V::Set(_params.stepSize);
+	const V halfStep = V::Set(_params.stepSize / 2.0f);
+	const V sixthStep = V::Set(_params.stepSize / 6.0f);
+	V& px = _state.px; V& py = _state.py; V& pz = _state.pz;
+	V& dx = _state.dx; V& dy = _state.dy; V& dz = _state.dz;
+	Mask& active = _state.active;
+
+	//angular momentum, h = cross(pos, dir)
+	V hx = py * dz - dy * pz, hy = pz * dx - dz * px, hz = px * dy - dx * py;
+	const V h2 = hx * hx + hy * hy + hz * hz;
+	const V k = V::Set(-1.5f) * h2;
+	//the direction is not bent without lensing, so there is nothing left to add
+	const V escapeH2 = _params.applyLensing ? h2 : zero;
+	Mask escaped = Mask::FromBits(0);
+
+	for (int i = 0; i < _params.maxSteps; ++i)
+	{
+		//disk crossing within this step (the plane is y = BHPos.y)
+		if (_params.renderDisk)
+		{
+			V t = zero - (py - bhy) / dy;
+			Mask hit = Mask::And(active, Mask::And(V::NotEqual(dy, zero), Mask::And(V::GreaterEqual(t, zero), V::LessEqual(t, step))));
+			if (hit.Bits())
+			{
+				V invLength = one / V::Sqrt(dx * dx + dy * dy + dz * dz);
+				V ix = px + t * (dx * invLength), iy = py + t * (dy * invLength), iz = pz + t * (dz * invLength);
+				V vx = ix - bhx, vy = iy - bhy, vz = iz - bhz;
+				V dist2 = vx * vx + vy * vy + vz * vz;
+				hit = Mask::And(hit, Mask::And(V::GreaterEqual(dist2, innerRad2), V::LessEqual(dist2, outerRad2)));
+				if (unsigned bits = hit.Bits())
+					RecordCrossings(_rays, _base, bits, ix, iy, iz);
+			}
+		}
+
+		//captured by the event horizon
+		V rx = px - bhx, ry = py - bhy, rz = pz - bhz;
+		V r2 = rx * rx + ry * ry + rz * rz;
+		active = Mask::AndNot(active, V::LessEqual(r2, ehRad2));
+
+		//heading away for good, the rest of the bending is analytic
+		if (_params.analyticEscape)
+		{
+			Mask leaving = EscapeAnalytically(_params, escapeH2, rx, ry, rz, r2, _state);
+			_state.savedSteps = V::Select(leaving, V::Set(static_cast<float>(_params.maxSteps - i)), _state.savedSteps);
+			escaped = Mask::Or(escaped, leaving);
+			active = Mask::AndNot(active, leaving);
+		}
+		if (!active.Bits())
+			break;
+
+		//RK4, see IntegrateRungeKutta4 in BlackHole.frag
+		V ax1, ay1, az1, ax2, ay2, az2, ax3, ay3, az3, ax4, ay4, az4;
+		GeodesicAcceleration(k, bhx, bhy, bhz, px, py, pz, ax1, ay1, az1);
+		V dx2 = dx + ax1 * halfStep, dy2 = dy + ay1 * halfStep, dz2 = dz + az1 * halfStep;
+		GeodesicAcceleration(k, bhx, bhy, bhz, px + dx * halfStep, py + dy * halfStep, pz + dz * halfStep, ax2, ay2, az2);
+		V dx3 = dx + ax2 * halfStep, dy3 = dy + ay2 * halfStep, dz3 = dz + az2 * halfStep;
+		GeodesicAcceleration(k, bhx, bhy, bhz, px + dx2 * halfStep, py + dy2 * halfStep, pz + dz2 * halfStep, ax3, ay3, az3);
+		V dx4 = dx + ax3 * step, dy4 = dy + ay3 * step, dz4 = dz + az3 * step;
+		GeodesicAcceleration(k, bhx, bhy, bhz, px + dx3 * step, py + dy3 * step, pz + dz3 * step, ax4, ay4, az4);
+
+		px = V::Select(active, px + sixthStep * (dx + two * dx2 + two * dx3 + dx4), px);
+		py = V::Select(active, py + sixthStep * (dy + two * dy2 + two * dy3 + dy4), py);
+		pz = V::Select(active, pz + sixthStep * (dz + two * dz2 + two * dz3 + dz4), pz);
+		if (_params.applyLensing)
+		{
+			dx = V::Select(active, dx + sixthStep * (ax1 + two * ax2 + two * ax3 + ax4), dx);
+			dy = V::Select(active, dy + sixthStep * (ay1 + two * ay2 + two * ay3 + ay4), dy);
+			dz = V::Select(active, dz + sixthStep * (az1 + two * az2 + two * az3 + az4), dz);
+		}
+		_state.steps = _state.steps + V::Select(active, one, zero);
+	}
+	//rays still active went through every step, so they escaped
+	if (_params.analyticEscape)
+		FinishEscape(_params, escapeH2, active, _state);
+	_state.escaped = Mask::Or(escaped, active);
+}
+
+/**
+ * Marches a packet with Dormand-Prince steps, see RayMarchAdaptive in
+ * BlackHole.frag. Every lane has its own step size, lanes whose step is
+ * rejected keep their state and retry with a shorter one
+ * @param _params - the black hole
+ * @param _rays - the rays
+ * @param _base - index of the first lane
+ * @param _state - the packet
+*/
+template <typename V>
+void MarchAdaptive(const PacketKernel::Params& _params, const PacketKernel::Rays& _rays, size_t _base, PacketState<V>& _state)
+{
+	using Mask = typename V::Mask;
+	const V zero = V::Set(0.0f), one = V::Set(1.0f), half = V::Set(0.5f);
+	const V two = V::Set(2.0f), three = V::Set(3.0f);
+	const V bhx = V::Set(_params.BHPos[0]), bhy = V::Set(_params.BHPos[1]), bhz = V::Set(_params.BHPos[2]);
+	const V ehRad2 = V::Set(_params.EHRad * _params.EHRad);
+	const V innerRad2 = V::Set(_params.innerDiskRad * _params.innerDiskRad);
+	const V outerRad2 = V::Set(_params.outerDiskRad * _params.outerDiskRad);
+	const V tolerance = V::Set(_params.tolerance);
+	const V marchLength = V::Set(_params.marchLength);
+	const V minStep = V::Set(_params.minStep);
+	const V distanceRatio = V::Set(_params.stepDistanceRatio);
+	V& px = _state.px; V& py = _state.py; V& pz = _state.pz;
+	V& dx = _state.dx; V& dy = _state.dy; V& dz = _state.dz;
+	Mask& active = _state.active;
+
+	V hx = py * dz - dy * pz, hy = pz * dx - dz * px, hz = px * dy - dx * py;
+	const V h2 = _params.applyLensing ? hx * hx + hy * hy + hz * hz : zero;
+	const V k = V::Set(-1.5f) * h2;
+	auto acceleration = [&](V _x, V _y, V _z, V& _ax, V& _ay, V& _az) { GeodesicAcceleration(k, bhx, bhy, bhz, _x, _y, _z, _ax, _ay, _az); };
+	//error of a component, relative to its magnitude
+	auto relative = [&](V _error, V _value) { return V::Abs(_error) / (one + V::Abs(_value)); };
+
+	V ux, uy, uz;
+	acceleration(px, py, pz, ux, uy, uz);
+	V travelled = zero;
+	V rx = px - bhx, ry = py - bhy, rz = pz - bhz;
+	V h = V::Min(distanceRatio * V::Sqrt(rx * rx + ry * ry + rz * rz), marchLength);
+	Mask escaped = Mask::FromBits(0);
+	for (int i = 0; i < _params.maxSteps; ++i)
+	{
+		rx = px - bhx; ry = py - bhy; rz = pz - bhz;
+		V r2 = rx * rx + ry * ry + rz * rz;
+		active = Mask::AndNot(active, V::LessEqual(r2, ehRad2));
+		Mask done = Mask::And(active, V::GreaterEqual(travelled, marchLength));
+		if (_params.analyticEscape && done.Bits())
+			FinishEscape(_params, h2, done, _state);
+		escaped = Mask::Or(escaped, done);
+		active = Mask::AndNot(active, done);
+		if (_params.analyticEscape)
+		{
+			Mask leaving = EscapeAnalytically(_params, h2, rx, ry, rz, r2, _state);
+			if (leaving.Bits())
+			{
+				//fewest steps that could cover the rest of the march, see GetAdaptiveStepsLeft
+				V r = V::Sqrt(r2), reach = r, left = zero;
+				const V growth = one + distanceRatio;
+				Mask more = leaving;
+				for (int j = i; j < _params.maxSteps; ++j)
+				{
+					more = Mask::AndNot(more, V::GreaterEqual(reach - r, marchLength - travelled));
+					if (!more.Bits())
+						break;
+					left = left + V::Select(more, one, zero);
+					reach = reach * growth;
+				}
+				_state.savedSteps = V::Select(leaving, left, _state.savedSteps);
+				escaped = Mask::Or(escaped, leaving);
+				active = Mask::AndNot(active, leaving);
+			}
+		}
+		if (!active.Bits())
+			break;
+
+		h = V::Min(h, V::Min(marchLength - travelled, distanceRatio * V::Sqrt(r2)));
+		//stages, with the coefficients of IntegrateDormandPrince in BlackHole.frag
+		const V a21 = V::Set(1.0f / 5.0f);
+		const V a31 = V::Set(3.0f / 40.0f), a32 = V::Set(9.0f / 40.0f);
+		const V a41 = V::Set(44.0f / 45.0f), a42 = V::Set(-56.0f / 15.0f), a43 = V::Set(32.0f / 9.0f);
+		const V a51 = V::Set(19372.0f / 6561.0f), a52 = V::Set(-25360.0f / 2187.0f), a53 = V::Set(64448.0f / 6561.0f), a54 = V::Set(-212.0f / 729.0f);
+		const V a61 = V::Set(9017.0f / 3168.0f), a62 = V::Set(-355.0f / 33.0f), a63 = V::Set(46732.0f / 5247.0f), a64 = V::Set(49.0f / 176.0f), a65 = V::Set(-5103.0f / 18656.0f);
+		const V b1 = V::Set(35.0f / 384.0f), b3 = V::Set(500.0f / 1113.0f), b4 = V::Set(125.0f / 192.0f), b5 = V::Set(-2187.0f / 6784.0f), b6 = V::Set(11.0f / 84.0f);
+		const V e1 = V::Set(71.0f / 57600.0f), e3 = V::Set(-71.0f / 16695.0f), e4 = V::Set(71.0f / 1920.0f), e5 = V::Set(-17253.0f / 339200.0f), e6 = V::Set(22.0f / 525.0f), e7 = V::Set(-1.0f / 40.0f);
+
+		//the derivative of the position is the direction of that stage
+		V x2 = dx + h * (ux * a21), y2 = dy + h * (uy * a21), z2 = dz + h * (uz * a21);
+		V ux2, uy2, uz2;
+		acceleration(px + h * (dx * a21), py + h * (dy * a21), pz + h * (dz * a21), ux2, uy2, uz2);
+		V x3 = dx + h * (ux * a31 + ux2 * a32), y3 = dy + h * (uy * a31 + uy2 * a32), z3 = dz + h * (uz * a31 + uz2 * a32);
+		V ux3, uy3, uz3;
+		acceleration(px + h * (dx * a31 + x2 * a32), py + h * (dy * a31 + y2 * a32), pz + h * (dz * a31 + z2 * a32), ux3, uy3, uz3);
+		V x4 = dx + h * (ux * a41 + ux2 * a42 + ux3 * a43), y4 = dy + h * (uy * a41 + uy2 * a42 + uy3 * a43), z4 = dz + h * (uz * a41 + uz2 * a42 + uz3 * a43);
+		V ux4, uy4, uz4;
+		acceleration(px + h * (dx * a41 + x2 * a42 + x3 * a43), py + h * (dy * a41 + y2 * a42 + y3 * a43), pz + h * (dz * a41 + z2 * a42 + z3 * a43), ux4, uy4, uz4);
+		V x5 = dx + h * (ux * a51 + ux2 * a52 + ux3 * a53 + ux4 * a54), y5 = dy + h * (uy * a51 + uy2 * a52 + uy3 * a53 + uy4 * a54), z5 = dz + h * (uz * a51 + uz2 * a52 + uz3 * a53 + uz4 * a54);
+		V ux5, uy5, uz5;
+		acceleration(px + h * (dx * a51 + x2 * a52 + x3 * a53 + x4 * a54), py + h * (dy * a51 + y2 * a52 + y3 * a53 + y4 * a54), pz + h * (dz * a51 + z2 * a52 + z3 * a53 + z4 * a54), ux5, uy5, uz5);
+		V x6 = dx + h * (ux * a61 + ux2 * a62 + ux3 * a63 + ux4 * a64 + ux5 * a65), y6 = dy + h * (uy * a61 + uy2 * a62 + uy3 * a63 + uy4 * a64 + uy5 * a65), z6 = dz + h * (uz * a61 + uz2 * a62 + uz3 * a63 + uz4 * a64 + uz5 * a65);
+		V ux6, uy6, uz6;
+		acceleration(px + h * (dx * a61 + x2 * a62 + x3 * a63 + x4 * a64 + x5 * a65), py + h * (dy * a61 + y2 * a62 + y3 * a63 + y4 * a64 + y5 * a65), pz + h * (dz * a61 + z2 * a62 + z3 * a63 + z4 * a64 + z5 * a65), ux6, uy6, uz6);
+
+		//5th order solution, its acceleration is the first one of the next step
+		V npx = px + h * (dx * b1 + x3 * b3 + x4 * b4 + x5 * b5 + x6 * b6);
+		V npy = py + h * (dy * b1 + y3 * b3 + y4 * b4 + y5 * b5 + y6 * b6);
+		V npz = pz + h * (dz * b1 + z3 * b3 + z4 * b4 + z5 * b5 + z6 * b6);
+		V ndx = dx + h * (ux * b1 + ux3 * b3 + ux4 * b4 + ux5 * b5 + ux6 * b6);
+		V ndy = dy + h * (uy * b1 + uy3 * b3 + uy4 * b4 + uy5 * b5 + uy6 * b6);
+		V ndz = dz + h * (uz * b1 + uz3 * b3 + uz4 * b4 + uz5 * b5 + uz6 * b6);
+		V ux7, uy7, uz7;
+		acceleration(npx, npy, npz, ux7, uy7, uz7);
+
+		//difference with the embedded 4th order solution
+		V error = relative(h * (dx * e1 + x3 * e3 + x4 * e4 + x5 * e5 + x6 * e6 + ndx * e7), npx);
+		error = V::Max(error, relative(h * (dy * e1 + y3 * e3 + y4 * e4 + y5 * e5 + y6 * e6 + ndy * e7), npy));
+		error = V::Max(error, relative(h * (dz * e1 + z3 * e3 + z4 * e4 + z5 * e5 + z6 * e6 + ndz * e7), npz));
+		error = V::Max(error, relative(h * (ux * e1 + ux3 * e3 + ux4 * e4 + ux5 * e5 + ux6 * e6 + ux7 * e7), ndx));
+		error = V::Max(error, relative(h * (uy * e1 + uy3 * e3 + uy4 * e4 + uy5 * e5 + uy6 * e6 + uy7 * e7), ndy));
+		error = V::Max(error, relative(h * (uz * e1 + uz3 * e3 + uz4 * e4 + uz5 * e5 + uz6 * e6 + uz7 * e7), ndz));
+		Mask accept = Mask::And(active, Mask::Or(V::LessEqual(error, tolerance), V::LessEqual(h, minStep)));
+
+		//the step went through the plane of the disk (not counting where it started)
+		if (_params.renderDisk)
+		{
+			V y0 = py - bhy;
+			Mask cross = Mask::And(accept, Mask::And(V::LessEqual(y0 * (npy - bhy), zero), V::NotEqual(y0, zero)));
+			if (cross.Bits())
+			{
+				//bisection on the cubic Hermite curve of the step, see FindDiskCrossing
+				auto hermite = [&](V _s, V _p0, V _d0, V _p1, V _d1)
+				{
+					V s2 = _s * _s, s3 = s2 * _s;
+					return (two * s3 - three * s2 + one) * _p0 + (s3 - two * s2 + _s) * h * _d0
+						+ (three * s2 - two * s3) * _p1 + (s3 - s2) * h * _d1;
+				};
+				V lo = zero, hi = one;
+				for (int j = 0; j < 16; ++j)
+				{
+					V mid = (lo + hi) * half;
+					Mask before = V::LessEqual((hermite(mid, py, dy, npy, ndy) - bhy) * y0, zero);
+					lo = V::Select(before, lo, mid);
+					hi = V::Select(before, mid, hi);
+				}
+				V s = (lo + hi) * half;
+				V ix = hermite(s, px, dx, npx, ndx), iy = hermite(s, py, dy, npy, ndy), iz = hermite(s, pz, dz, npz, ndz);
+				V vx = ix - bhx, vy = iy - bhy, vz = iz - bhz;
+				V dist2 = vx * vx + vy * vy + vz * vz;
+				cross = Mask::And(cross, Mask::And(V::GreaterEqual(dist2, innerRad2), V::LessEqual(dist2, outerRad2)));
+				if (unsigned bits = cross.Bits())
+					RecordCrossings(_rays, _base, bits, ix, iy, iz);
+			}
+		}
+
+		px = V::Select(accept, npx, px); py = V::Select(accept, npy, py); pz = V::Select(accept, npz, pz);
+		dx = V::Select(accept, ndx, dx); dy = V::Select(accept, ndy, dy); dz = V::Select(accept, ndz, dz);
+		ux = V::Select(accept, ux7, ux); uy = V::Select(accept, uy7, uy); uz = V::Select(accept, uz7, uz);
+		travelled = travelled + V::Select(accept, h, zero);
+		_state.steps = _state.steps + V::Select(active, one, zero);
+
+		V factor = V::Set(0.9f) * V::Sqrt(V::Sqrt(tolerance / V::Max(error, V::Set(1e-20f))));
+		factor = V::Min(V::Max(factor, V::Set(0.2f)), V::Set(5.0f));
+		h = V::Max(h * factor, minStep);
+	}
+	//rays that ran out of iterations count as escaped, like the fixed march
+	if (_params.analyticEscape)
+		FinishEscape(_params, h2, active, _state);
+	_state.escaped = Mask::Or(escaped, active);
+}
+
+/**
+ * Marches the rays in packets of V::Width lanes
+ * @param _params - the black hole
+ * @param _rays - the rays
+ * @param _begin - first ray
+ * @param _end - one past the last ray
+*/
+template <typename V>
+void MarchPackets(const PacketKernel::Params& _params, const PacketKernel::Rays& _rays, size_t _begin, size_t _end)
+{
+	const int W = V::Width;
+	for (size_t base = _begin; base < _end; base += W)
+	{
+		//the last packet repeats its first ray in the missing lanes
+		int count = _end - base < static_cast<size_t>(W) ? static_cast<int>(_end - base) : W;
+		alignas(64) float lanes[6][W];
+		for (int c = 0; c < 3; ++c)
+		{
+			for (int l = 0; l < W; ++l)
+			{
+				size_t i = base + (l < count ? l : 0);
+				lanes[c][l] = _rays.pos[c][i];
+				lanes[c + 3][l] = _rays.dir[c][i];
+			}
+		}
+		for (int l = 0; l < count; ++l)
+			_rays.crossingCount[base + l] = 0;
+
+		PacketState<V> state;
+		state.px = V::Load(lanes[0]); state.py = V::Load(lanes[1]); state.pz = V::Load(lanes[2]);
+		state.dx = V::Load(lanes[3]); state.dy = V::Load(lanes[4]); state.dz = V::Load(lanes[5]);
+		state.active = V::Mask::FromBits((1u << count) - 1u);
+		state.escaped = V::Mask::FromBits(0);
+		state.steps = V::Set(0.0f);
+		state.savedSteps = V::Set(0.0f);
+		if (_params.adaptive)
+			MarchAdaptive(_params, _rays, base, state);
+		else
+			MarchFixed(_params, _rays, base, state);
+
+		alignas(64) float results[5][W];
+		state.dx.Store(results[0]);
+		state.dy.Store(results[1]);
+		state.dz.Store(results[2]);
+		state.steps.Store(results[3]);
+		state.savedSteps.Store(results[4]);
+		unsigned escaped = state.escaped.Bits();
+		for (int l = 0; l < count; ++l)
+		{
+			for (int c = 0; c < 3; ++c)
+				_rays.dir[c][base + l] = results[c][l];
+			_rays.steps[base + l] = static_cast<unsigned short>(results[3][l]);
+			_rays.savedSteps[base + l] = static_cast<unsigned short>(results[4][l]);
+			_rays.escaped[base + l] = (escaped >> l) & 1u;
+		}
+	}
+}
@@ -0,0 +1,221 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the tile scheduler
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include "../Utilities/pch.hpp"
+#include "../Utilities/ThreadPool.h"
+#include "TileScheduler.h"
+
+namespace
+{
+	//failed searches before a thread without work starts sleeping
+	static const int SpinCount = 64;
+
+	//deque of a thread, padded so that two locks never share a cache line
+	struct alignas(64) Queue
+	{
+		std::mutex mutex;
+		std::deque<Tile> tiles;
+	};
+
+	/**
+	 * Splits a tile in two halves across its longest side
+	 * @param _tile - the tile, becomes the first half
+	 * @param _other - the second half
+	 * @return - false if the tile is too small to be split
+	*/
+	bool Split(Tile& _tile, Tile& _other)
+	{
+		int width = _tile.x1 - _tile.x0, height = _tile.y1 - _tile.y0;
+		if (std::max(width, height) <= TileScheduler::MinSplitSize)
+			return false;
+		_other = _tile;
+		if (width >= height)
+			_tile.x1 = _other.x0 = _tile.x0 + ((width / 2 + 1) & ~1);
+		else
+			_tile.y1 = _other.y0 = _tile.y0 + ((height / 2 + 1) & ~1);
+		return true;
+	}
+}
+
+/**
+ * Splits an image in tiles and runs a job on each of them, on every worker
+ * and the calling thread. Each thread starts with a contiguous block of
+ * tiles and steals from the others when it runs out. The job is given
+ * slices of MinSplitSize rows of the tiles. Blocks until every tile is done.
+ * Must not be called from a worker
+ * @param _width - width of the image
+ * @param _height - height of the image
+ * @param _job - work to do on a tile, called concurrently
+ * @param _tileSize - width and height of the tiles (even)
+ * @return - what each thread did
+*/
+TileScheduler::Stats TileScheduler::Run(int _width, int _height, const std::function<void(const Tile&)>& _job, int _tileSize)
+{
+	using Clock = std::chrono::high_resolution_clock;
+	const auto start = Clock::now();
+	const int tilesX = (_width + _tileSize - 1) / _tileSize;
+	const int tilesY = (_height + _tileSize - 1) / _tileSize;
+	const int tileCount = tilesX * tilesY;
+	const unsigned threadCount = Workers.GetWorkerCount() + 1;
+
+	std::vector<Queue> queues(threadCount);
+	for (int i = 0; i < tileCount; ++i)
+	{
+		Tile tile;
+		tile.x0 = (i % tilesX) * _tileSize;
+		tile.y0 = (i / tilesX) * _tileSize;
+		tile.x1 = std::min(tile.x0 + _tileSize, _width);
+		tile.y1 = std::min(tile.y0 + _tileSize, _height);
+		queues[static_cast<size_t>(i) * threadCount / tileCount].tiles.push_back(tile);
+	}
+
+	//pixels not rendered yet, splitting does not change it
+	std::atomic<long long> remaining{ static_cast<long long>(_width) * _height };
+	//threads looking for work
+	std::atomic<int> searching{ 0 };
+	Stats stats;
+	stats.threads.resize(threadCount);
+
+	auto worker = [&](unsigned _index)
+	{
+		ThreadStats& thread = stats.threads[_index];
+		Queue& own = queues[_index];
+		bool isSearching = false;
+		int failures = 0;
+		while (remaining.load() > 0)
+		{
+			Tile tile;
+			bool found = false;
+			{
+				std::lock_guard<std::mutex> lock(own.mutex);
+				if (!own.tiles.empty())
+				{
+					tile = own.tiles.back();
+					own.tiles.pop_back();
+					found = true;
+				}
+			}
+			//thieves take the oldest half of the tiles of the first thread that has any
+			std::vector<Tile> stolen;
+			for (unsigned i = 1; i < threadCount && !found; ++i)
+			{
+				Queue& victim = queues[(_index + i) % threadCount];
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if (victim.tiles.empty())
+					continue;
+				tile = victim.tiles.front();
+				victim.tiles.pop_front();
+				auto end = victim.tiles.begin() + victim.tiles.size() / 2;
+				stolen.assign(victim.tiles.begin(), end);
+				victim.tiles.erase(victim.tiles.begin(), end);
+				found = true;
+				thread.steals++;
+			}
+			//never lock two deques at once
+			if (!stolen.empty())
+			{
+				std::lock_guard<std::mutex> lock(own.mutex);
+				own.tiles.insert(own.tiles.end(), stolen.begin(), stolen.end());
+			}
+			if (!found)
+			{
+				//spin for a while, then stop taking the CPU from the threads that have work
+				if (!isSearching)
+				{
+					searching++;
+					isSearching = true;
+					failures = 0;
+				}
+				if (++failures < SpinCount)
+					std::this_thread::yield();
+				else
+					std::this_thread::sleep_for(std::chrono::microseconds(50));
+				continue;
+			}
+			if (isSearching)
+			{
+				searching--;
+				isSearching = false;
+			}
+
+			//the tile is run a few rows at a time. While someone is starving
+			//and there is nothing left to steal from this thread, half of
+			//what is left of the tile is given away
+			thread.tiles++;
+			while (tile.y0 < tile.y1)
+			{
+				if (searching.load() > 0)
+				{
+					std::lock_guard<std::mutex> lock(own.mutex);
+					Tile half;
+					if (own.tiles.empty() && Split(tile, half))
+					{
+						own.tiles.push_back(half);
+						thread.splits++;
+						continue;
+					}
+				}
+				Tile slice = tile;
+				slice.y1 = std::min(tile.y0 + MinSplitSize, tile.y1);
+				auto sliceStart = Clock::now();
+				_job(slice);
+				thread.busyMs += std::chrono::duration<double, std::milli>(Clock::now() - sliceStart).count();
+				remaining -= static_cast<long long>(slice.x1 - slice.x0) * (slice.y1 - slice.y0);
+				tile.y0 = slice.y1;
+			}
+		}
+		if (isSearching)
+			searching--;
+	};
+
+	std::vector<std::future<void>> workers;
+	for (unsigned i = 1; i < threadCount; ++i)
+		workers.push_back(Workers.Submit([&worker, i]() { worker(i); }));
+	worker(0);
+	for (auto& w : workers)
+		w.wait();
+
+	stats.wallMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	for (auto& thread : stats.threads)
+		thread.idleMs = std::max(0.0, stats.wallMs - thread.busyMs);
+	return stats;
+}
+
+/**
+ * Computes how much of the time the threads were busy
+ * @return - busy time over wall time of every thread, 1 for a perfect balance
+*/
+float TileScheduler::Stats::GetEfficiency() const
+{
+	if (threads.empty() || wallMs <= 0.0)
+		return 0.0f;
+	double busy = 0.0;
+	for (const auto& thread : threads)
+		busy += thread.busyMs;
+	return static_cast<float>(busy / (wallMs * threads.size()));
+}
+
+/**
+ * Prints the busy and idle time of every thread
+*/
+void TileScheduler::Stats::Log() const
+{
+	for (unsigned i = 0; i < threads.size(); ++i)
+	{
+		const ThreadStats& thread = threads[i];
+		std::cout << "Thread " << i << ": busy " << thread.busyMs << " ms, idle " << thread.idleMs << " ms, " << thread.tiles
+			<< " tiles, " << thread.steals << " steals, " << thread.splits << " splits" << std::endl;
+	}
+	std::cout << "Tiles: " << wallMs << " ms on " << threads.size() << " threads, " << GetEfficiency() * 100.0f << "% busy" << std::endl;
+}
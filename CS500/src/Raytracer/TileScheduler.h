@@ -0,0 +1,62 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the tile scheduler
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <functional>
+#include <vector>
+
+/**
+ * Rectangle of pixels, [x0, x1) x [y0, y1)
+ */
+struct Tile
+{
+	int x0{};
+	int y0{};
+	int x1{};
+	int y1{};
+};
+
+/**
+ * Work stealing scheduler of the CPU tracer. Every thread owns a deque of
+ * tiles, works from its back and, once empty, steals from the front of the
+ * others. Tiles are run a few rows at a time and, while some thread is
+ * looking for work, what is left of them is split in halves, so the
+ * expensive regions (the photon ring runs every step of the march) end up
+ * spread over every thread.
+ */
+namespace TileScheduler
+{
+	static const int DefaultTileSize = 16;
+	//rows run at once, tiles are not split below this size either. Halves
+	//keep even corners so quads stay whole
+	static const int MinSplitSize = 4;
+
+	struct ThreadStats
+	{
+		//time running tiles and time without any (searching, or done before the others)
+		double busyMs{};
+		double idleMs{};
+		unsigned tiles{};
+		unsigned steals{};
+		unsigned splits{};
+	};
+
+	struct Stats
+	{
+		float GetEfficiency() const;
+		void Log() const;
+
+		double wallMs{};
+		//the calling thread first, then the workers
+		std::vector<ThreadStats> threads{};
+	};
+
+	Stats Run(int _width, int _height, const std::function<void(const Tile&)>& _job, int _tileSize = DefaultTileSize);
+}
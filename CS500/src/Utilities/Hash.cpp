@@ -0,0 +1,70 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the hashing functions
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include "pch.hpp"
+#include "MappedFile.h"
+#include "Hash.h"
+
+/**
+ * Hashes a block of memory
+ * @param _data - the bytes to hash
+ * @param _size - amount of bytes
+ * @param _seed - previous hash, to chain several blocks
+ * @return - the hash
+*/
+uint64_t HashBytes(const void* _data, size_t _size, uint64_t _seed)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(_data);
+	uint64_t hash = _seed;
+	for (size_t i = 0; i < _size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+/**
+ * Hashes a string
+ * @param _str - the string to hash
+ * @param _seed - previous hash, to chain several strings
+ * @return - the hash
+*/
+uint64_t HashString(const std::string& _str, uint64_t _seed)
+{
+	return HashBytes(_str.data(), _str.size(), _seed);
+}
+
+/**
+ * Hashes the contents of a file
+ * @param _path - the file to hash
+ * @param _hash - the resulting hash
+ * @return - true if success, false otherwise
+*/
+bool HashFile(const std::string& _path, uint64_t& _hash)
+{
+	MappedFile file;
+	if (!file.Open(_path))
+		return false;
+	_hash = HashBytes(file.GetData(), file.GetSize());
+	return true;
+}
+
+/**
+ * Converts a hash to a fixed width hexadecimal string
+ * @param _hash - the hash to convert
+ * @return - 16 hexadecimal characters
+*/
+std::string HashToString(uint64_t _hash)
+{
+	std::stringstream ss;
+	ss << std::hex << std::setw(16) << std::setfill('0') << _hash;
+	return ss.str();
+}
@@ -0,0 +1,21 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the hashing functions
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <cstdint>
+#include <string>
+
+//64 bit FNV-1a. Not cryptographic, only used to detect content changes
+static const uint64_t HashSeed = 0xcbf29ce484222325ull;
+
+uint64_t HashBytes(const void* _data, size_t _size, uint64_t _seed = HashSeed);
+uint64_t HashString(const std::string& _str, uint64_t _seed = HashSeed);
+bool HashFile(const std::string& _path, uint64_t& _hash);
+std::string HashToString(uint64_t _hash);
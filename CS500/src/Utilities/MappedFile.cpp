@@ -0,0 +1,123 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the Mapped File class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "pch.hpp"
+#include "MappedFile.h"
+
+/**
+ * Maps the whole file into memory
+ * @param _path - the file to map
+ * @return - true if success, false otherwise
+*/
+bool MappedFile::Open(const std::string& _path)
+{
+	Close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize{};
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	fileHandle = file;
+	mappingHandle = mapping;
+	data = static_cast<const unsigned char*>(view);
+	size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int fd = open(_path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat info {};
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+	void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	//the mapping keeps the file alive, the descriptor is no longer needed
+	close(fd);
+	if (view == MAP_FAILED)
+		return false;
+	data = static_cast<const unsigned char*>(view);
+	size = static_cast<size_t>(info.st_size);
+#endif
+	return true;
+}
+
+/**
+ * Unmaps the file, if any
+*/
+void MappedFile::Close()
+{
+	if (data == nullptr)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle(mappingHandle);
+	CloseHandle(fileHandle);
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+#else
+	munmap(const_cast<unsigned char*>(data), size);
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+MappedFile::MappedFile(MappedFile&& _other) noexcept
+{
+	*this = std::move(_other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& _other) noexcept
+{
+	if (this != &_other)
+	{
+		Close();
+		std::swap(data, _other.data);
+		std::swap(size, _other.size);
+#ifdef _WIN32
+		std::swap(fileHandle, _other.fileHandle);
+		std::swap(mappingHandle, _other.mappingHandle);
+#endif
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
@@ -0,0 +1,41 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the Mapped File class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <string>
+
+/**
+ * Read only memory mapping of a whole file. The pages are loaded by the OS
+ * on demand, so opening a mapping does not read the file.
+ */
+class MappedFile
+{
+public:
+	bool Open(const std::string& _path);
+	void Close();
+	bool IsOpen() const { return data != nullptr; }
+	const unsigned char* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+
+	MappedFile() = default;
+	MappedFile(MappedFile&& _other) noexcept;
+	MappedFile& operator=(MappedFile&& _other) noexcept;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+private:
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
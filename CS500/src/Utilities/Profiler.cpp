@@ -0,0 +1,129 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the Profiler class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include "pch.hpp"
+#include "Profiler.h"
+
+namespace
+{
+	/**
+	 * Small sequential id of the calling thread, used as the trace track
+	 * @return - the id
+	*/
+	unsigned GetThreadIndex()
+	{
+		static std::atomic<unsigned> next{ 0 };
+		thread_local unsigned index = next++;
+		return index;
+	}
+
+	/**
+	 * Writes a string as a JSON string literal
+	 * @param _os - output stream
+	 * @param _str - the string
+	*/
+	void WriteString(std::ostream& _os, const std::string& _str)
+	{
+		_os << '"';
+		for (char c : _str)
+		{
+			if (c == '"' || c == '\\')
+				_os << '\\';
+			_os << c;
+		}
+		_os << '"';
+	}
+}
+
+/**
+ * Starts recording events
+ * @param _path - file the trace is written to when the session ends
+*/
+void Profiler::BeginSession(const std::string& _path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	events.clear();
+	path = _path;
+	epoch = std::chrono::steady_clock::now();
+	active = true;
+}
+
+/**
+ * Stops recording and writes the trace file
+*/
+void Profiler::EndSession()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!active)
+		return;
+	active = false;
+
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+	{
+		std::cout << "Could not write trace file: " << path << std::endl;
+		return;
+	}
+
+	file << "{\"otherData\":{\"build\":\"" << __DATE__ << " " << __TIME__ << "\"},\n\"traceEvents\":[";
+	for (size_t i = 0; i < events.size(); ++i)
+	{
+		const Event& e = events[i];
+		file << (i ? ",\n" : "\n") << "{\"name\":";
+		WriteString(file, e.name);
+		file << ",\"cat\":\"" << e.category << "\",\"ph\":\"X\",\"ts\":" << e.start << ",\"dur\":" << e.duration
+			<< ",\"pid\":0,\"tid\":" << e.thread << ",\"args\":{";
+		for (size_t a = 0; a < e.args.size(); ++a)
+		{
+			file << (a ? "," : "");
+			WriteString(file, e.args[a].first);
+			file << ":" << e.args[a].second;
+		}
+		file << "}}";
+	}
+	file << "\n]}\n";
+	std::cout << "Trace written to " << path << " (" << events.size() << " events)" << std::endl;
+	events.clear();
+}
+
+/**
+ * Time since the start of the session
+ * @return - microseconds
+*/
+int64_t Profiler::GetTimestamp() const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+/**
+ * Records a complete event on the track of the calling thread
+ * @param _name - name of the event
+ * @param _category - category of the event
+ * @param _start - start timestamp
+ * @param _end - end timestamp
+ * @param _args - values shown along the event
+*/
+void Profiler::AddEvent(const std::string& _name, const char* _category, int64_t _start, int64_t _end, const Args& _args)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active)
+		events.push_back({ _name, _category, _start, _end - _start, GetThreadIndex(), _args });
+}
+
+ProfileScope::ProfileScope(std::string _name, const char* _category)
+	: name(std::move(_name)), category(_category), start(Profile.GetTimestamp())
+{
+}
+
+ProfileScope::~ProfileScope()
+{
+	if (Profile.IsActive())
+		Profile.AddEvent(name, category, start, Profile.GetTimestamp(), args);
+}
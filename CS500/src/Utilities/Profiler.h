@@ -0,0 +1,76 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the Profiler class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Singleton.h"
+
+/**
+ * Records timed events during a session and writes them as a Chrome trace
+ * (chrome://tracing, Perfetto), one track per thread. Events can be added from
+ * any thread, and outside of a session they are ignored.
+ */
+class Profiler
+{
+	MAKE_SINGLETON(Profiler)
+public:
+	using Args = std::vector<std::pair<std::string, double>>;
+
+	void BeginSession(const std::string& _path);
+	void EndSession();
+	bool IsActive() const { return active; }
+	int64_t GetTimestamp() const;
+	void AddEvent(const std::string& _name, const char* _category, int64_t _start, int64_t _end, const Args& _args = {});
+
+private:
+	struct Event
+	{
+		std::string name{};
+		const char* category{};
+		int64_t start{};
+		int64_t duration{};
+		unsigned thread{};
+		Args args{};
+	};
+
+	std::mutex mutex;
+	std::vector<Event> events;
+	std::chrono::steady_clock::time_point epoch{};
+	std::string path{};
+	std::atomic<bool> active{ false };
+};
+
+#define Profile (Profiler::Instance())
+
+/**
+ * Times the scope it lives in, adding the event to the profiler when destroyed
+ */
+class ProfileScope
+{
+public:
+	ProfileScope(std::string _name, const char* _category = "startup");
+	~ProfileScope();
+	void AddArg(const std::string& _name, double _value) { args.emplace_back(_name, _value); }
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	std::string name;
+	const char* category;
+	int64_t start;
+	Profiler::Args args;
+};
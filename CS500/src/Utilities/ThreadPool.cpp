@@ -0,0 +1,73 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the implementation of the Thread Pool class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include "pch.hpp"
+#include "ThreadPool.h"
+
+/**
+ * Spawns the worker threads
+ * @param _workerCount - amount of workers, 0 means one per hardware thread
+*/
+void ThreadPool::Initialize(unsigned _workerCount)
+{
+	if (!workers.empty())
+		return;
+
+	if (_workerCount == 0)
+		_workerCount = std::max(1u, std::thread::hardware_concurrency());
+
+	stopping = false;
+	for (unsigned i = 0; i < _workerCount; ++i)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+/**
+ * Finishes the queued jobs and joins all the workers
+*/
+void ThreadPool::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+	for (auto& w : workers)
+		w.join();
+	workers.clear();
+}
+
+/**
+ * Joins the workers, if any
+*/
+ThreadPool::~ThreadPool()
+{
+	Shutdown();
+}
+
+/**
+ * Pops jobs until the pool is shut down and the queue is empty
+*/
+void ThreadPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeUp.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (jobs.empty())
+				return;
+			job = std::move(jobs.front());
+			jobs.pop();
+		}
+		job();
+	}
+}
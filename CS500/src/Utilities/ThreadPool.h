@@ -0,0 +1,76 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		This file contains the declaration of the Thread Pool class
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "Singleton.h"
+
+/**
+ * Fixed set of worker threads consuming a FIFO job queue. Used to run
+ * CPU heavy work (mainly image decoding) off the main (GL) thread.
+ */
+class ThreadPool
+{
+	MAKE_SINGLETON(ThreadPool)
+public:
+	void Initialize(unsigned _workerCount = 0);
+	void Shutdown();
+	unsigned GetWorkerCount() const { return static_cast<unsigned>(workers.size()); }
+
+	template <typename F>
+	auto Submit(F&& _job) -> std::future<decltype(_job())>;
+
+	~ThreadPool();
+
+private:
+	void WorkerLoop();
+
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	bool stopping = false;
+};
+
+/**
+ * Queues a job to be run by any worker
+ * @param _job - callable with no arguments
+ * @return - future holding the result of the job
+*/
+template <typename F>
+auto ThreadPool::Submit(F&& _job) -> std::future<decltype(_job())>
+{
+	using Result = decltype(_job());
+	//packaged tasks are move only, std::function needs something copyable
+	auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(_job));
+	std::future<Result> result = task->get_future();
+
+	//without workers the job is simply run on the calling thread
+	if (workers.empty())
+	{
+		(*task)();
+		return result;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.emplace([task]() { (*task)(); });
+	}
+	wakeUp.notify_one();
+	return result;
+}
+
+#define Workers (ThreadPool::Instance())
@@ -7,17 +7,41 @@
 //	Project:		cs300_j.zapata_0
 //	Author:			Jon Zapata (j.zapata@digipen.edu)
 // ----------------------------------------------------------------------------
+#include <cstdlib> //std::atoi
 #include <iostream> //std::cout
 #include <SDL2/SDL.h> //SDL_Event, init, etc
 #include "Graphics/RenderManager.h"
+#include "Graphics/TextureCache.h" //offline texture baking
+#include "Raytracer/HeadlessRenderer.h" //CPU rendering
+#include "Utilities/ThreadPool.h"
 #include "Input\InputManager.h" //input manager
 
 #undef main
 int main(int argc, char* args[])
 {
+	//bake the texture cache and exit, no window is created
+	if (argc > 1 && std::string(args[1]) == "--bake")
+	{
+		Workers.Initialize();
+		TextureCache::BakeDirectory(argc > 2 ? args[2] : "Resources");
+		return 0;
+	}
+
+	//render (or benchmark the packet kernel) with the CPU tracer and exit, no window is created
+	if (argc > 1 && (std::string(args[1]) == "--render" || std::string(args[1]) == "--benchmark"))
+	{
+		Workers.Initialize();
+		return HeadlessRenderer::Run(argc, args);
+	}
+
 	//variables for wireframe and texture mode
 	bool quit = false;
 
+	//limit the skybox resolution on memory constrained machines
+	for (int i = 1; i + 1 < argc; ++i)
+		if (std::string(args[i]) == "--max-sky")
+			GfxManager.SetMaxSkySize(std::atoi(args[i + 1]));
+
 	GfxManager.Initialize(1280, 720);
 	while (!quit)
 	{
@@ -31,5 +55,7 @@ int main(int argc, char* args[])
 		GfxManager.EndFrame();
 	}
 
+	//before returning, the singletons it releases into are destroyed first
+	GfxManager.Shutdown();
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,63 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		Command line tool that bakes the texture archive. It does
+//					not create any window nor touch OpenGL, so it runs on
+//					build machines without a display or GPU
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include <cstdlib> //std::atoi
+#include <iostream> //std::cout
+#include <string>
+#include <vector>
+#include "Graphics/TextureArchive.h"
+#include "Utilities/ThreadPool.h"
+
+/**
+ * Prints the usage of the tool
+*/
+static void PrintUsage()
+{
+	std::cout << "usage: bake_tool [--out <archive>] [--max-size <pixels>] [--jobs <threads>] [directories...]" << std::endl
+		<< "  --out       archive to write (default Cache/Resources.bpak)" << std::endl
+		<< "  --max-size  largest width/height stored, larger images keep a smaller mip as level 0" << std::endl
+		<< "  --jobs      worker threads (default: one per core)" << std::endl
+		<< "  directories are walked recursively (default Resources/Textures Resources/Cubemaps)" << std::endl
+		<< "paths are stored as given, run it from the directory the application runs from" << std::endl;
+}
+
+int main(int argc, char* args[])
+{
+	std::string out = "Cache/Resources.bpak";
+	int maxSize = 0;
+	unsigned jobs = 0;
+	std::vector<std::string> roots;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = args[i];
+		if (arg == "--out" && i + 1 < argc)
+			out = args[++i];
+		else if (arg == "--max-size" && i + 1 < argc)
+			maxSize = std::atoi(args[++i]);
+		else if (arg == "--jobs" && i + 1 < argc)
+			jobs = static_cast<unsigned>(std::atoi(args[++i]));
+		else if (arg == "--help" || arg == "-h" || arg.compare(0, 2, "--") == 0)
+		{
+			PrintUsage();
+			return arg == "--help" || arg == "-h" ? 0 : 1;
+		}
+		else
+			roots.push_back(arg);
+	}
+	if (roots.empty())
+		roots = { "Resources/Textures", "Resources/Cubemaps" };
+
+	Workers.Initialize(jobs);
+	bool success = TextureArchive::Write(out, roots, maxSize);
+	Workers.Shutdown();
+	return success ? 0 : 1;
+}
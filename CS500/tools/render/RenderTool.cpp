@@ -0,0 +1,22 @@
+// ----------------------------------------------------------------------------
+//	Copyright (C)DigiPen Institute of Technology.
+//	Reproduction or disclosure of this file or its contents without the prior
+//	written consent of DigiPen Institute of Technology is prohibited.
+//
+//	Purpose:		Command line tool that renders frames with the CPU tracer.
+//					Same as "cs500_j.zapata --render", for machines without a
+//					display or GPU
+//	Project:		cs500_j.zapata
+//	Author:			Jon Zapata (j.zapata@digipen.edu)
+// ----------------------------------------------------------------------------
+
+#include "Raytracer/HeadlessRenderer.h"
+#include "Utilities/ThreadPool.h"
+
+int main(int argc, char* args[])
+{
+	Workers.Initialize();
+	int result = HeadlessRenderer::Run(argc, args);
+	Workers.Shutdown();
+	return result;
+}